@@ -29,131 +29,503 @@
 //
 ////////////////////////////////////////////////////////////////////////
 
+
 #include <mcontainer.h>
+#include "histogram.h"
+#include "oplog.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <math.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <pthread.h>
 #include <sys/wait.h>
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <sys/syscall.h>
 
-int main(int argc, char *argv[])
+enum op
 {
-    // variable initialization
-    int i = 0; 
-    int number_of_processes = 1, number_of_objects = 1024, max_size_of_objects = 8192, number_of_containers = 1;
-    int a, j, cid, size, stat, child_pid, devfd, max_size_of_objects_with_buffer;
-    char filename[256];
-    char *mapped_data, *data;
-    unsigned long long msec_time;
-    FILE *fp;
-    struct timeval current_time;
-    pid_t *pid; 
+    OP_LOCK,
+    OP_ALLOC,
+    OP_WRITE,
+    OP_READ,
+    OP_UNLOCK,
+    OP_FREE,
+    NR_OPS
+};
 
-    // takes arguments from command line interface.
-    if (argc < 4)
+static const char *op_names[NR_OPS] = {"lock", "alloc", "write", "read", "unlock", "free"};
+
+enum size_distribution
+{
+    SIZE_FIXED,
+    SIZE_UNIFORM,
+    SIZE_BIMODAL
+};
+
+static const char *size_names[] = {"fixed", "uniform", "bimodal"};
+
+// what every worker does, set once from the command line.
+static struct
+{
+    int number_of_objects, max_size_of_objects, number_of_workers, number_of_containers;
+    int operations, warmup, read_percent, free_percent, threads;
+    enum size_distribution sizes;
+    double zipf_theta;
+    const char *json;
+} config = {1024, 8192, 1, 1, 0, 0, 50, 0, 0, SIZE_FIXED, 0.0, NULL};
+
+// per-worker results, in memory shared with forked workers.
+struct result
+{
+    struct histogram latency[NR_OPS];
+    __u64 operations;
+    double elapsed;
+};
+
+static struct result *results;
+static volatile int *ready;
+static double *zipf_cdf;
+static int devfd;
+
+static __u64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static __u64 next_random(__u64 *state)
+{
+    // xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static double next_uniform(__u64 *state)
+{
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// cumulative popularity of oids 0..n-1 with a zipfian skew of theta.
+static void zipf_setup(void)
+{
+    double sum = 0;
+    int i;
+
+    zipf_cdf = (double *)malloc(config.number_of_objects * sizeof(double));
+    for (i = 0; i < config.number_of_objects; i++)
+    {
+        sum += 1.0 / pow(i + 1, config.zipf_theta);
+        zipf_cdf[i] = sum;
+    }
+    for (i = 0; i < config.number_of_objects; i++)
+    {
+        zipf_cdf[i] /= sum;
+    }
+}
+
+static int next_oid(__u64 *state)
+{
+    double u = next_uniform(state);
+    int low = 0, high = config.number_of_objects - 1;
+
+    if (config.zipf_theta == 0)
+        return (int)(u * config.number_of_objects);
+    while (low < high)
     {
-        fprintf(stderr, "Usage: %s number_of_objects max_size_of_objects number_of_processes number_of_containers\n", argv[0]);
+        int mid = (low + high) / 2;
+        if (zipf_cdf[mid] < u)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+// every worker has to agree on an object's size, so it only depends on the oid.
+static int object_size(int oid)
+{
+    __u64 hash = (__u64)oid * 11400714819323198485ULL + 1;
+    int pages = (config.max_size_of_objects + getpagesize() - 1) / getpagesize(), size;
+
+    hash = next_random(&hash);
+    switch (config.sizes)
+    {
+    case SIZE_UNIFORM:
+        size = (int)(hash % pages + 1) * getpagesize();
+        break;
+    case SIZE_BIMODAL:
+        // mostly single pages with the odd large object
+        size = hash % 10 ? getpagesize() : config.max_size_of_objects;
+        break;
+    default:
+        size = config.max_size_of_objects;
+    }
+    return size < config.max_size_of_objects ? size : config.max_size_of_objects;
+}
+
+// fill data with the decimal digits of a, repeated, as validate expects.
+static void make_payload(char *data, int size, int a)
+{
+    char unit[16];
+    int length = sprintf(unit, "%d", a), i;
+
+    for (i = 0; i + length < size; i += length)
+    {
+        memcpy(data + i, unit, length);
+    }
+    memcpy(data + i, unit, size - 1 - i);
+    data[size - 1] = '\0';
+}
+
+struct worker
+{
+    int id, cid, pid;
+    __u64 random;
+    char *data;
+    struct oplog_writer *log;
+    struct result *result;
+};
+
+static void record(struct worker *w, enum op op, __u64 start, __u64 end, int measured)
+{
+    if (measured)
+        histogram_record(&w->result->latency[op], end - start);
+}
+
+static void do_write(struct worker *w, int oid, int measured)
+{
+    int size = object_size(oid);
+    char *mapped_data;
+    __u64 t0, t1, t2, t3, t4, t5, checksum;
+
+    make_payload(w->data, size, (int)(next_random(&w->random) & 0x7fffffff) + 1);
+    checksum = oplog_checksum(w->data, size - 1);
+    t0 = now_ns();
+    mcontainer_lock(devfd, oid);
+    t1 = now_ns();
+    mapped_data = (char *)mcontainer_alloc(devfd, oid, size);
+    t2 = now_ns();
+    if (mapped_data == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed in mcontainer_alloc()\n");
         exit(1);
     }
+    memcpy(mapped_data, w->data, size);
+    t3 = now_ns();
+    // the log is replayed in timestamp order, so stamp it while holding the lock.
+    oplog_append(w->log, OPLOG_STORE, w->pid, w->cid, t3, oid, size, size - 1, checksum);
+    t4 = now_ns();
+    mcontainer_unlock(devfd, oid);
+    t5 = now_ns();
+    munmap(mapped_data, size);
 
-    number_of_objects = atoi(argv[1]);
-    max_size_of_objects = atoi(argv[2]);
-    number_of_processes = atoi(argv[3]);
-    number_of_containers = atoi(argv[4]);
+    record(w, OP_LOCK, t0, t1, measured);
+    record(w, OP_ALLOC, t1, t2, measured);
+    record(w, OP_WRITE, t2, t3, measured);
+    record(w, OP_UNLOCK, t4, t5, measured);
+}
 
-    max_size_of_objects_with_buffer = max_size_of_objects + 100;
-    pid = (pid_t *) calloc(number_of_processes - 1, sizeof(pid_t));
+static void do_read(struct worker *w, int oid, int measured)
+{
+    int size = object_size(oid);
+    char *mapped_data;
+    __u64 t0, t1, t2, t3, t4;
+    volatile char sink;
 
-    // open the kernel module to use it
-    devfd = open("/dev/mcontainer", O_RDWR);
-    if (devfd < 0)
+    t0 = now_ns();
+    mcontainer_lock(devfd, oid);
+    t1 = now_ns();
+    mapped_data = (char *)mcontainer_alloc(devfd, oid, size);
+    t2 = now_ns();
+    if (mapped_data == MAP_FAILED)
     {
-        fprintf(stderr, "Device open failed");
+        fprintf(stderr, "Failed in mcontainer_alloc()\n");
         exit(1);
     }
+    memcpy(w->data, mapped_data, size);
+    sink = w->data[size - 1];
+    (void)sink;
+    t3 = now_ns();
+    mcontainer_unlock(devfd, oid);
+    t4 = now_ns();
+    munmap(mapped_data, size);
+
+    record(w, OP_LOCK, t0, t1, measured);
+    record(w, OP_ALLOC, t1, t2, measured);
+    record(w, OP_READ, t2, t3, measured);
+    record(w, OP_UNLOCK, t3, t4, measured);
+}
 
-    // parent process forks children
-    for (i = 0; i < (number_of_processes - 1); i++)
+static void do_free(struct worker *w, int oid, int measured)
+{
+    __u64 t0, t1;
+
+    mcontainer_lock(devfd, oid);
+    t0 = now_ns();
+    mcontainer_free(devfd, oid);
+    t1 = now_ns();
+    oplog_append(w->log, OPLOG_DELETE, w->pid, w->cid, t1, oid, object_size(oid), 0, oplog_checksum("", 0));
+    mcontainer_unlock(devfd, oid);
+    record(w, OP_FREE, t0, t1, measured);
+}
+
+static void do_mixed(struct worker *w, int measured)
+{
+    int oid = next_oid(&w->random);
+    int dice = (int)(next_random(&w->random) % 100);
+
+    if (dice < config.free_percent)
+        do_free(w, oid, measured);
+    else if (dice < config.free_percent + config.read_percent)
+        do_read(w, oid, measured);
+    else
+        do_write(w, oid, measured);
+}
+
+static void *run_worker(void *arg)
+{
+    struct worker *w = (struct worker *)arg;
+    char filename[256];
+    __u64 start;
+    int i;
+
+    w->pid = config.threads ? (int)syscall(SYS_gettid) : (int)getpid();
+    w->cid = w->pid % config.number_of_containers;
+    w->random = ((__u64)w->pid << 32) ^ (__u64)time(NULL) ^ 0x9e3779b97f4a7c15ULL;
+    w->result = &results[w->id];
+    for (i = 0; i < NR_OPS; i++)
     {
-        child_pid = fork();
-        if (child_pid == 0)
+        histogram_init(&w->result->latency[i]);
+    }
+    w->data = (char *)malloc(config.max_size_of_objects);
+    w->log = (struct oplog_writer *)malloc(sizeof(struct oplog_writer));
+    sprintf(filename, "mcontainer.%d.log", w->pid);
+    if (oplog_open(w->log, filename) < 0)
+    {
+        perror(filename);
+        exit(1);
+    }
+
+    // create/link this task to a container.
+    mcontainer_create(devfd, w->cid);
+
+    // start everybody at once.
+    __sync_fetch_and_add(ready, 1);
+    while (*ready < config.number_of_workers)
+        ;
+
+    // without a mix, writing every object once is the measured workload.
+    start = now_ns();
+    for (i = 0; i < config.number_of_objects; i++)
+    {
+        do_write(w, i, config.operations == 0);
+    }
+    for (i = 0; i < config.warmup; i++)
+    {
+        do_mixed(w, 0);
+    }
+    if (config.operations)
+    {
+        start = now_ns();
+        for (i = 0; i < config.operations; i++)
         {
-            break;
+            do_mixed(w, 1);
         }
-        else
+    }
+    w->result->operations = config.operations ? config.operations : config.number_of_objects;
+    w->result->elapsed = (now_ns() - start) / 1e9;
+
+    // try delete something; it is outside the measured window.
+    do_free(w, (int)(next_random(&w->random) % config.number_of_objects), 0);
+
+    // done with works, cleanup.
+    mcontainer_delete(devfd);
+    if (oplog_close(w->log) < 0)
+    {
+        fprintf(stderr, "Failed to write the log of task %d\n", w->pid);
+    }
+    free(w->log);
+    free(w->data);
+    return NULL;
+}
+
+static void report(FILE *fp)
+{
+    struct histogram total[NR_OPS];
+    __u64 operations = 0;
+    double elapsed = 0;
+    int i, j;
+
+    for (j = 0; j < NR_OPS; j++)
+    {
+        histogram_init(&total[j]);
+        for (i = 0; i < config.number_of_workers; i++)
         {
-            pid[i] = child_pid;
+            histogram_merge(&total[j], &results[i].latency[j]);
         }
     }
+    for (i = 0; i < config.number_of_workers; i++)
+    {
+        operations += results[i].operations;
+        if (results[i].elapsed > elapsed)
+            elapsed = results[i].elapsed;
+    }
 
-    data = (char *) malloc(max_size_of_objects_with_buffer * sizeof(char));
+    if (!config.json)
+    {
+        fprintf(fp, "%llu operations in %.3f s, %.0f ops/s\n", (unsigned long long)operations, elapsed,
+                operations / elapsed);
+        histogram_print_header(fp);
+        for (j = 0; j < NR_OPS; j++)
+        {
+            histogram_print(fp, op_names[j], &total[j]);
+        }
+        return;
+    }
+    fprintf(fp, "{\n  \"config\": {\"objects\": %d, \"max_size\": %d, \"workers\": %d, \"containers\": %d, "
+                "\"worker_type\": \"%s\", \"operations\": %d, \"warmup\": %d, \"read_percent\": %d, "
+                "\"free_percent\": %d, \"sizes\": \"%s\", \"zipf_theta\": %g},\n",
+            config.number_of_objects, config.max_size_of_objects, config.number_of_workers,
+            config.number_of_containers, config.threads ? "thread" : "process", config.operations, config.warmup,
+            config.read_percent, config.free_percent, size_names[config.sizes], config.zipf_theta);
+    fprintf(fp, "  \"operations\": %llu,\n  \"elapsed_s\": %.6f,\n  \"ops_per_s\": %.1f,\n  \"latency\": {\n",
+            (unsigned long long)operations, elapsed, operations / elapsed);
+    for (j = 0; j < NR_OPS; j++)
+    {
+        fprintf(fp, "    \"%s\": ", op_names[j]);
+        histogram_print_json(fp, &total[j]);
+        fprintf(fp, "%s\n", j + 1 < NR_OPS ? "," : "");
+    }
+    fprintf(fp, "  }\n}\n");
+}
 
-    // create the log file
-    srand((int)time(NULL) + (int)getpid());
-    sprintf(filename, "mcontainer.%d.log", (int)getpid());
-    fp = fopen(filename, "w");
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options] number_of_objects max_size_of_objects number_of_processes number_of_containers\n"
+                    "  -n ops      mixed operations per worker after writing every object once\n"
+                    "              (default 0: the initial writes are what gets measured)\n"
+                    "  -w ops      unmeasured mixed operations before the measured ones\n"
+                    "  -r percent  reads in the mix (default 50)\n"
+                    "  -f percent  frees in the mix (default 0), the rest are writes\n"
+                    "  -z theta    zipfian skew of oid popularity (default 0, uniform)\n"
+                    "  -s sizes    object sizes: fixed, uniform or bimodal (default fixed)\n"
+                    "  -t          run the workers as threads of one process\n"
+                    "  -j file     write the results as JSON to file, - for stdout\n", name);
+    exit(1);
+}
 
-    // create/link this process to a container.
-    cid = getpid() % number_of_containers;
-    mcontainer_create(devfd, cid);
+int main(int argc, char *argv[])
+{
+    struct worker *workers;
+    pthread_t *threads;
+    pid_t *pid;
+    FILE *fp;
+    int i, opt, stat, child_pid = 1;
 
-    // Writing to objects
-    for (i = 0; i < number_of_objects; i++)
+    // takes arguments from command line interface.
+    while ((opt = getopt(argc, argv, "n:w:r:f:z:s:tj:")) != -1)
     {
-        mcontainer_lock(devfd, i);
-        mapped_data = (char *)mcontainer_alloc(devfd, i, max_size_of_objects);
-
-        // error handling
-        if (!mapped_data)
+        switch (opt)
         {
-            fprintf(stderr, "Failed in mcontainer_alloc()\n");
-            exit(1);
+        case 'n': config.operations = atoi(optarg); break;
+        case 'w': config.warmup = atoi(optarg); break;
+        case 'r': config.read_percent = atoi(optarg); break;
+        case 'f': config.free_percent = atoi(optarg); break;
+        case 'z': config.zipf_theta = atof(optarg); break;
+        case 's':
+            for (i = 0; i < 3 && strcmp(optarg, size_names[i]); i++)
+                ;
+            if (i == 3)
+                usage(argv[0]);
+            config.sizes = (enum size_distribution)i;
+            break;
+        case 't': config.threads = 1; break;
+        case 'j': config.json = optarg; break;
+        default: usage(argv[0]);
         }
+    }
+    if (argc - optind < 4)
+        usage(argv[0]);
+    config.number_of_objects = atoi(argv[optind]);
+    config.max_size_of_objects = atoi(argv[optind + 1]);
+    config.number_of_workers = atoi(argv[optind + 2]);
+    config.number_of_containers = atoi(argv[optind + 3]);
+    if (config.number_of_objects < 1 || config.max_size_of_objects < 2 || config.number_of_workers < 1 ||
+        config.number_of_containers < 1 || config.read_percent + config.free_percent > 100)
+        usage(argv[0]);
+    zipf_setup();
+
+    // open the kernel module to use it
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
 
-        // generate a random number to write into the object.
-        a = rand() + 1;
+    results = (struct result *)mmap(0, config.number_of_workers * sizeof(struct result) + sizeof(int),
+                                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    ready = (volatile int *)(results + config.number_of_workers);
+    workers = (struct worker *)calloc(config.number_of_workers, sizeof(struct worker));
+    for (i = 0; i < config.number_of_workers; i++)
+    {
+        workers[i].id = i;
+    }
 
-        // starts to write the data to that address.
-        gettimeofday(&current_time, NULL);
-        for (j = 0; j < max_size_of_objects_with_buffer - 10; j = strlen(data))
+    if (config.threads)
+    {
+        threads = (pthread_t *)calloc(config.number_of_workers, sizeof(pthread_t));
+        for (i = 0; i < config.number_of_workers; i++)
         {
-            sprintf(data, "%s%d", data, a);
+            pthread_create(&threads[i], NULL, run_worker, &workers[i]);
         }
-        strncpy(mapped_data, data, max_size_of_objects-1);
-        mapped_data[max_size_of_objects-1] = '\0';
-        
-        // prints out the result into the log
-        fprintf(fp, "S\t%d\t%d\t%ld\t%d\t%d\t%s\n", getpid(), cid, current_time.tv_sec * 1000000 + current_time.tv_usec, i, max_size_of_objects, mapped_data);
-        mcontainer_unlock(devfd, i);
-        memset(data, 0, max_size_of_objects_with_buffer);
-    }
-
-    // try delete something
-    i = rand() % number_of_objects;
-    mcontainer_lock(devfd, i);
-    gettimeofday(&current_time, NULL);
-    mcontainer_free(devfd, i);
-    fprintf(fp, "D\t%d\t%d\t%ld\t%d\t%d\t%s\n", getpid(), cid, current_time.tv_sec * 1000000 + current_time.tv_usec, i, max_size_of_objects, "delete_an_object");
-    mcontainer_unlock(devfd, i);
-    
-    
-    // done with works, cleanup and wait for other processes.
-    mcontainer_delete(devfd);
-    close(devfd);
-    if (child_pid != 0)
+        for (i = 0; i < config.number_of_workers; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+    }
+    else
     {
-        for (i = 0; i < (number_of_processes - 1); i++)
+        // parent process forks children
+        pid = (pid_t *)calloc(config.number_of_workers, sizeof(pid_t));
+        for (i = 1; i < config.number_of_workers; i++)
+        {
+            child_pid = fork();
+            if (child_pid == 0)
+            {
+                break;
+            }
+            pid[i] = child_pid;
+        }
+        run_worker(&workers[child_pid == 0 ? i : 0]);
+        if (child_pid == 0)
+        {
+            exit(0);
+        }
+        for (i = 1; i < config.number_of_workers; i++)
         {
-            waitpid(pid[i], &stat, 0);  
+            waitpid(pid[i], &stat, 0);
         }
+        free(pid);
     }
-    free(pid);
-    free(data);
+
+    fp = config.json && strcmp(config.json, "-") ? fopen(config.json, "w") : stdout;
+    report(fp);
+    if (fp != stdout)
+    {
+        fclose(fp);
+    }
+    close(devfd);
+    free(workers);
+    free(zipf_cdf);
     return 0;
 }
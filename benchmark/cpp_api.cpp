@@ -0,0 +1,131 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     The C++ Interface v.s. the C Calls It Wraps
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+static const int objects = 64;
+static const std::size_t count = 1024;
+
+static double now_ns()
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char *name, double c_ns, double cpp_ns, long iterations)
+{
+    std::printf("%-20s C %8.1f ns/op   C++ %8.1f ns/op   (%+.1f%%)\n", name, c_ns / iterations,
+                cpp_ns / iterations, (cpp_ns - c_ns) / c_ns * 100);
+}
+
+int main(int argc, char *argv[])
+{
+    long iterations = argc > 1 ? std::atol(argv[1]) : 1000000;
+    long maps = iterations / 100;
+    volatile long sink = 0;
+    double start, c_ns, cpp_ns;
+    long i;
+
+    mcontainer::Container container(0);
+    int devfd = container.fd();
+
+    // map, touch and unmap an object.
+    start = now_ns();
+    for (i = 0; i < maps; i++)
+    {
+        long *data = (long *)mcontainer_alloc(devfd, i % objects, count * sizeof(long));
+        data[0]++;
+        munmap(data, count * sizeof(long));
+    }
+    c_ns = now_ns() - start;
+    start = now_ns();
+    for (i = 0; i < maps; i++)
+    {
+        mcontainer::Object<long> object = container.map<long>(i % objects, count);
+        object[0]++;
+    }
+    cpp_ns = now_ns() - start;
+    report("map/unmap", c_ns, cpp_ns, maps);
+
+    // update an element under the object's lock.
+    long *data = (long *)mcontainer_alloc(devfd, 0, count * sizeof(long));
+    start = now_ns();
+    for (i = 0; i < iterations; i++)
+    {
+        mcontainer_lock(devfd, 0);
+        data[i % count]++;
+        mcontainer_unlock(devfd, 0);
+    }
+    c_ns = now_ns() - start;
+    munmap(data, count * sizeof(long));
+
+    mcontainer::Object<long> object = container.map<long>(0, count);
+    start = now_ns();
+    for (i = 0; i < iterations; i++)
+    {
+        std::lock_guard<mcontainer::ObjectLock> guard(object.mutex());
+        object[i % count]++;
+    }
+    cpp_ns = now_ns() - start;
+    report("locked update", c_ns, cpp_ns, iterations);
+
+    // walk the whole object.
+    data = object.data();
+    start = now_ns();
+    for (i = 0; i < iterations / 100; i++)
+    {
+        long sum = 0;
+        for (std::size_t j = 0; j < count; j++)
+            sum += data[j];
+        sink += sum;
+    }
+    c_ns = now_ns() - start;
+    start = now_ns();
+    for (i = 0; i < iterations / 100; i++)
+    {
+        long sum = 0;
+        for (long value : object.span())
+            sum += value;
+        sink += sum;
+    }
+    cpp_ns = now_ns() - start;
+    report("span sum", c_ns, cpp_ns, iterations / 100);
+
+    for (i = 0; i < objects; i++)
+    {
+        container.free(i);
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Memory Saved by Merging Duplicate Pages, and What Writes Pay for It
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "histogram.h"
+
+static int objects = 256, pages = 64, distinct = 16;
+static double timeout = 60.0;
+
+static __u64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// page k of object i holds one of distinct contents.
+static void fill(char *page, int i, int k)
+{
+    int pattern = (i * pages + k) % distinct;
+    memset(page, pattern & 0xff, getpagesize());
+    ((int *)page)[0] = pattern;
+}
+
+// map every object afresh and time the first write to each page. With
+// unique set, every page gets a value of its own; otherwise the data stays.
+static void touch(int devfd, const char *name, int unique)
+{
+    size_t size = (size_t)pages * getpagesize();
+    struct histogram h;
+    volatile int *word;
+    char *mapped_data;
+    __u64 start;
+    int i, k;
+
+    histogram_init(&h);
+    for (i = 0; i < objects; i++)
+    {
+        mapped_data = (char *)mcontainer_alloc(devfd, i, size);
+        if (mapped_data == MAP_FAILED)
+        {
+            fprintf(stderr, "Failed in mcontainer_alloc()\n");
+            exit(1);
+        }
+        for (k = 0; k < pages; k++)
+        {
+            word = (volatile int *)(mapped_data + (size_t)k * getpagesize());
+            start = now_ns();
+            word[1] = unique ? i * pages + k + 1 : word[1];
+            histogram_record(&h, now_ns() - start);
+        }
+        munmap(mapped_data, size);
+    }
+    histogram_print(stdout, name, &h);
+}
+
+int main(int argc, char *argv[])
+{
+    struct memory_container_dedup_stats stats;
+    size_t size;
+    char *mapped_data;
+    __u64 start, passes = 0, merges = 0;
+    double elapsed;
+    int devfd, opt, i, k;
+
+    while ((opt = getopt(argc, argv, "n:p:k:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': objects = atoi(optarg); break;
+        case 'p': pages = atoi(optarg); break;
+        case 'k': distinct = atoi(optarg); break;
+        case 't': timeout = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n objects] [-p pages per object] [-k distinct pages] [-t seconds]\n",
+                    argv[0]);
+            exit(1);
+        }
+    }
+    if (objects < 1 || pages < 1 || distinct < 1)
+    {
+        fprintf(stderr, "need at least one object, page and distinct page\n");
+        exit(1);
+    }
+    size = (size_t)pages * getpagesize();
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+    for (i = 0; i < objects; i++)
+    {
+        mapped_data = (char *)mcontainer_alloc(devfd, i, size);
+        if (mapped_data == MAP_FAILED)
+        {
+            fprintf(stderr, "Failed in mcontainer_alloc()\n");
+            exit(1);
+        }
+        for (k = 0; k < pages; k++)
+            fill(mapped_data + (size_t)k * getpagesize(), i, k);
+        munmap(mapped_data, size);
+    }
+
+    histogram_print_header(stdout);
+    touch(devfd, "write private", 0);
+
+    if (mcontainer_dedup(devfd, 1) < 0)
+    {
+        // the mock has no scanner.
+        printf("%-16s unsupported\n", "dedup");
+        goto out;
+    }
+    // wait until a whole pass has gone by without merging anything.
+    start = now_ns();
+    do
+    {
+        usleep(100000);
+        mcontainer_dedup_stats(devfd, &stats);
+        if (stats.merges != merges)
+        {
+            merges = stats.merges;
+            passes = stats.passes;
+        }
+        elapsed = (now_ns() - start) / 1e9;
+    } while (stats.passes < passes + 2 && elapsed < timeout);
+    printf("%-16s %.2f s, %llu merges, %llu of %llu pages saved (%.1f MB)\n", "merge", elapsed,
+           (unsigned long long)stats.merges, (unsigned long long)stats.saved_pages,
+           (unsigned long long)objects * pages, stats.saved_pages * getpagesize() / (double)(1 << 20));
+
+    touch(devfd, "write merged", 1);
+    mcontainer_dedup_stats(devfd, &stats);
+    printf("%-16s %llu unmerges, %llu pages still saved\n", "after writes", (unsigned long long)stats.unmerges,
+           (unsigned long long)stats.saved_pages);
+    mcontainer_dedup(devfd, 0);
+
+out:
+    for (i = 0; i < objects; i++)
+        mcontainer_free(devfd, i);
+    mcontainer_delete(devfd);
+    close(devfd);
+    return 0;
+}
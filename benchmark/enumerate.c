@@ -0,0 +1,123 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Listing a Container: Enumeration v.s. Probing Every oid
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    struct memory_container_object_info infos[MCONTAINER_ENUMERATE_MAX];
+    struct memory_container_size size;
+    __u64 i, number_of_objects = 1000000, found, resident, cursor;
+    double start, elapsed;
+    char *mapped_data;
+    int devfd, n, j;
+
+    if (argc > 1)
+    {
+        number_of_objects = strtoull(argv[1], NULL, 0);
+    }
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+
+    // every other oid, so that probing also pays for the holes.
+    for (i = 0; i < number_of_objects; i++)
+    {
+        mapped_data = (char *)mcontainer_alloc(devfd, 2 * i, getpagesize());
+        if (mapped_data == MAP_FAILED)
+        {
+            fprintf(stderr, "Failed in mcontainer_alloc()\n");
+            exit(1);
+        }
+        mapped_data[0] = 1;
+        munmap(mapped_data, getpagesize());
+    }
+
+    found = resident = cursor = 0;
+    start = now_sec();
+    while ((n = mcontainer_enumerate(devfd, &cursor, infos, MCONTAINER_ENUMERATE_MAX)) > 0)
+    {
+        found += n;
+        for (j = 0; j < n; j++)
+        {
+            resident += infos[j].resident_pages;
+        }
+    }
+    elapsed = now_sec() - start;
+    if (n < 0)
+    {
+        perror("mcontainer_enumerate");
+        exit(1);
+    }
+    printf("enumerate  %10.0f objects/s  (%llu objects, %llu resident pages, %.3f s)\n", found / elapsed,
+           (unsigned long long)found, (unsigned long long)resident, elapsed);
+    if (found != number_of_objects)
+    {
+        fprintf(stderr, "enumerate found %llu objects, not %llu\n", (unsigned long long)found,
+                (unsigned long long)number_of_objects);
+    }
+
+    // the way to find them without enumeration that creates nothing.
+    found = 0;
+    start = now_sec();
+    for (i = 0; i < 2 * number_of_objects; i++)
+    {
+        if (mcontainer_size(devfd, i, &size) == 0)
+        {
+            found++;
+        }
+    }
+    elapsed = now_sec() - start;
+    printf("probe size %10.0f objects/s  (%llu objects, %.3f s)\n", found / elapsed, (unsigned long long)found,
+           elapsed);
+
+    mcontainer_destroy(devfd);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,182 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Persisting an Object to a File: Copy v.s. Zero-Copy Paths
+//
+////////////////////////////////////////////////////////////////////////
+
+#define _GNU_SOURCE
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+
+#define CHUNK (1 << 20)
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// open the target file afresh so every method starts from an empty file.
+static int open_target(const char *path, int flags)
+{
+    unlink(path);
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC | flags, 0644);
+}
+
+static void report(const char *method, __u64 size, double seconds)
+{
+    printf("%-24s %10.1f MB/s\n", method, size / seconds / (1 << 20));
+}
+
+int main(int argc, char *argv[])
+{
+    __u64 size = 256ULL << 20, offset;
+    const char *path = "mcontainer.export";
+    char *mapped_data, *buffer;
+    double start;
+    off_t file_offset;
+    int devfd, fd, objfd;
+
+    if (argc > 1)
+    {
+        size = strtoull(argv[1], NULL, 0) << 20;
+    }
+    if (argc > 2)
+    {
+        path = argv[2];
+    }
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+    mapped_data = (char *)mcontainer_alloc(devfd, 0, size);
+    if (mapped_data == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed in mcontainer_alloc()\n");
+        exit(1);
+    }
+    memset(mapped_data, 'E', size);
+    buffer = (char *)malloc(CHUNK);
+
+    // copy through a private user buffer before writing it out.
+    fd = open_target(path, 0);
+    start = now_sec();
+    for (offset = 0; offset < size; offset += CHUNK)
+    {
+        memcpy(buffer, mapped_data + offset, CHUNK);
+        if (write(fd, buffer, CHUNK) != CHUNK)
+        {
+            perror("write");
+            exit(1);
+        }
+    }
+    fsync(fd);
+    report("bounce buffer + write", size, now_sec() - start);
+    close(fd);
+
+    // write straight from the mapping.
+    fd = open_target(path, 0);
+    start = now_sec();
+    for (offset = 0; offset < size; offset += CHUNK)
+    {
+        if (write(fd, mapped_data + offset, CHUNK) != CHUNK)
+        {
+            perror("write");
+            exit(1);
+        }
+    }
+    fsync(fd);
+    report("write from mapping", size, now_sec() - start);
+    close(fd);
+
+    // let the kernel move the object's pages through a pipe.
+    objfd = mcontainer_export(devfd, 0);
+    if (objfd < 0)
+    {
+        perror("mcontainer_export");
+        exit(1);
+    }
+    fd = open_target(path, 0);
+    file_offset = 0;
+    start = now_sec();
+    while ((__u64)file_offset < size)
+    {
+        if (sendfile(fd, objfd, &file_offset, size - file_offset) <= 0)
+        {
+            perror("sendfile");
+            exit(1);
+        }
+    }
+    fsync(fd);
+    report("sendfile from export", size, now_sec() - start);
+    close(fd);
+    close(objfd);
+
+    // O_DIRECT needs refcounted pages behind the mapping and skips the page cache.
+    fd = open_target(path, O_DIRECT);
+    if (fd < 0)
+    {
+        printf("%-24s %15s\n", "O_DIRECT from mapping", "unsupported");
+    }
+    else
+    {
+        start = now_sec();
+        for (offset = 0; offset < size; offset += CHUNK)
+        {
+            if (write(fd, mapped_data + offset, CHUNK) != CHUNK)
+            {
+                perror("O_DIRECT write");
+                exit(1);
+            }
+        }
+        fsync(fd);
+        report("O_DIRECT from mapping", size, now_sec() - start);
+        close(fd);
+    }
+
+    unlink(path);
+    munmap(mapped_data, size);
+    mcontainer_free(devfd, 0);
+    mcontainer_delete(devfd);
+    close(devfd);
+    free(buffer);
+    return 0;
+}
@@ -0,0 +1,198 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Read Fan-Out: Sealed Objects v.s. Lock-Protected Objects
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define DATA_OID 0
+#define CONTROL_OID 1
+
+// shared by everybody taking part in a run.
+struct control
+{
+    __u64 go, stop, reads, wrong;
+};
+
+static int devfd;
+static __u64 object_size = 4096;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// every reader goes through lock/unlock; for a sealed object they cost nothing.
+static void reader(const __u64 *data, struct control *control, __u64 expected)
+{
+    __u64 n = object_size / sizeof(__u64), reads = 0, wrong = 0, sum, i;
+
+    while (!__atomic_load_n(&control->stop, __ATOMIC_ACQUIRE))
+    {
+        if (mcontainer_lock(devfd, DATA_OID) < 0)
+        {
+            perror("mcontainer_lock");
+            break;
+        }
+        for (sum = 0, i = 0; i < n; i++)
+            sum += data[i];
+        mcontainer_unlock(devfd, DATA_OID);
+        wrong += sum != expected;
+        reads++;
+    }
+    __atomic_fetch_add(&control->reads, reads, __ATOMIC_ACQ_REL);
+    __atomic_fetch_add(&control->wrong, wrong, __ATOMIC_ACQ_REL);
+}
+
+static double run(const char *name, int readers, double seconds, __u64 expected)
+{
+    struct control *control;
+    const __u64 *data;
+    pid_t *pid = (pid_t *)calloc(readers, sizeof(pid_t));
+    double start, elapsed, rate;
+    int i, stat;
+
+    mcontainer_free(devfd, CONTROL_OID);
+    control = (struct control *)mcontainer_alloc(devfd, CONTROL_OID, sizeof(struct control));
+    if (control == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed in mcontainer_alloc()\n");
+        exit(1);
+    }
+    memset(control, 0, sizeof(*control));
+
+    for (i = 0; i < readers; i++)
+    {
+        pid[i] = fork();
+        if (pid[i] == 0)
+        {
+            // a forked task is not in any container until it joins one.
+            mcontainer_create(devfd, 0);
+            data = (const __u64 *)mcontainer_alloc(devfd, DATA_OID, object_size);
+            if (data == MAP_FAILED)
+            {
+                fprintf(stderr, "Failed in mcontainer_alloc()\n");
+                _exit(1);
+            }
+            while (!__atomic_load_n(&control->go, __ATOMIC_ACQUIRE))
+                sched_yield();
+            reader(data, control, expected);
+            mcontainer_delete(devfd);
+            _exit(0);
+        }
+    }
+
+    start = now_sec();
+    __atomic_store_n(&control->go, 1, __ATOMIC_RELEASE);
+    usleep((useconds_t)(seconds * 1e6));
+    __atomic_store_n(&control->stop, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < readers; i++)
+    {
+        waitpid(pid[i], &stat, 0);
+    }
+    elapsed = now_sec() - start;
+    rate = control->reads / elapsed;
+    printf("%-8s %3d readers %12.0f reads/s\n", name, readers, rate);
+    if (control->wrong)
+    {
+        printf("%-8s %llu reads saw the wrong contents\n", name, (unsigned long long)control->wrong);
+    }
+    fflush(stdout);
+
+    munmap(control, sizeof(struct control));
+    free(pid);
+    return rate;
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    int readers = argc > 2 ? atoi(argv[2]) : 4;
+    double locked, sealed;
+    __u64 *data, i, expected = 0;
+
+    if (argc > 3)
+    {
+        object_size = strtoull(argv[3], NULL, 0) << 10;
+    }
+    if (object_size < sizeof(__u64))
+    {
+        object_size = sizeof(__u64);
+    }
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+
+    // publish the object once, then only ever read it.
+    mcontainer_free(devfd, DATA_OID);
+    data = (__u64 *)mcontainer_alloc(devfd, DATA_OID, object_size);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed in mcontainer_alloc()\n");
+        exit(1);
+    }
+    for (i = 0; i < object_size / sizeof(__u64); i++)
+    {
+        data[i] = i;
+        expected += i;
+    }
+    munmap(data, object_size);
+
+    locked = run("locked", readers, seconds, expected);
+    if (mcontainer_seal(devfd, DATA_OID) < 0)
+    {
+        perror("mcontainer_seal");
+        exit(1);
+    }
+    sealed = run("sealed", readers, seconds, expected);
+    printf("sealed reads are %.1fx as fast\n", locked > 0 ? sealed / locked : 0.0);
+
+    mcontainer_free(devfd, DATA_OID);
+    mcontainer_free(devfd, CONTROL_OID);
+    mcontainer_delete(devfd);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,148 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Log-Linear Latency Histograms for the Benchmarks
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef MCONTAINER_HISTOGRAM_H
+#define MCONTAINER_HISTOGRAM_H
+
+#include <stdio.h>
+#include <string.h>
+#include <linux/types.h>
+
+// Values below 2^HISTOGRAM_SUB_BITS nanoseconds are exact; above that every
+// power of two is split into 2^HISTOGRAM_SUB_BITS buckets, so a bucket is
+// never off by more than about 3%.
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+struct histogram
+{
+    __u64 count, sum, min, max;
+    __u64 buckets[HISTOGRAM_BUCKETS];
+};
+
+static inline void histogram_init(struct histogram *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = ~0ULL;
+}
+
+static inline int histogram_index(__u64 value)
+{
+    int e;
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return (int)value;
+    e = 63 - __builtin_clzll(value);
+    return (e - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS +
+           (int)((value >> (e - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+// the largest value that lands in bucket index.
+static inline __u64 histogram_bucket_high(int index)
+{
+    int e, sub;
+    if (index < HISTOGRAM_SUB_BUCKETS)
+        return index;
+    e = index / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+    sub = index % HISTOGRAM_SUB_BUCKETS;
+    return ((__u64)(HISTOGRAM_SUB_BUCKETS + sub + 1) << (e - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+static inline void histogram_record(struct histogram *h, __u64 value)
+{
+    h->buckets[histogram_index(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value < h->min)
+        h->min = value;
+    if (value > h->max)
+        h->max = value;
+}
+
+static inline void histogram_merge(struct histogram *into, const struct histogram *from)
+{
+    int i;
+    if (!from->count)
+        return;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+        into->buckets[i] += from->buckets[i];
+    into->count += from->count;
+    into->sum += from->sum;
+    if (from->min < into->min)
+        into->min = from->min;
+    if (from->max > into->max)
+        into->max = from->max;
+}
+
+// value at or below which a fraction p of the samples fall.
+static inline __u64 histogram_percentile(const struct histogram *h, double p)
+{
+    __u64 rank = (__u64)(p * h->count + 0.999999), seen = 0;
+    int i;
+    if (!h->count)
+        return 0;
+    if (rank < 1)
+        rank = 1;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += h->buckets[i];
+        if (seen >= rank)
+            return histogram_bucket_high(i) < h->max ? histogram_bucket_high(i) : h->max;
+    }
+    return h->max;
+}
+
+static inline void histogram_print_json(FILE *fp, const struct histogram *h)
+{
+    fprintf(fp, "{\"count\": %llu, \"mean_ns\": %.1f, \"min_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, "
+                "\"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+            (unsigned long long)h->count, h->count ? (double)h->sum / h->count : 0.0,
+            (unsigned long long)(h->count ? h->min : 0),
+            (unsigned long long)histogram_percentile(h, 0.5), (unsigned long long)histogram_percentile(h, 0.9),
+            (unsigned long long)histogram_percentile(h, 0.99), (unsigned long long)histogram_percentile(h, 0.999),
+            (unsigned long long)h->max);
+}
+
+static inline void histogram_print(FILE *fp, const char *name, const struct histogram *h)
+{
+    fprintf(fp, "%-8s %10llu %10.0f %10llu %10llu %10llu %10llu %10llu\n", name, (unsigned long long)h->count,
+            h->count ? (double)h->sum / h->count : 0.0, (unsigned long long)histogram_percentile(h, 0.5),
+            (unsigned long long)histogram_percentile(h, 0.9), (unsigned long long)histogram_percentile(h, 0.99),
+            (unsigned long long)histogram_percentile(h, 0.999), (unsigned long long)h->max);
+}
+
+static inline void histogram_print_header(FILE *fp)
+{
+    fprintf(fp, "%-8s %10s %10s %10s %10s %10s %10s %10s\n", "op", "count", "mean(ns)", "p50", "p90", "p99",
+            "p99.9", "max");
+}
+
+#endif
@@ -0,0 +1,190 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Per-Call Cost of the Control ioctls Under Parallel Load
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define OBJECT_SIZE 4096
+
+static int max_tasks = 8;
+static double seconds = 2.0;
+
+static __u64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// one call of each kind; every task works on its own object, so what is
+// measured is the cost of getting in and out of the module, not waiting.
+static int call_lock(int devfd, __u64 oid)
+{
+    int ret = mcontainer_lock(devfd, oid);
+    mcontainer_unlock(devfd, oid);
+    return ret;
+}
+
+static int call_size(int devfd, __u64 oid)
+{
+    struct memory_container_size size;
+    return mcontainer_size(devfd, oid, &size);
+}
+
+static int call_stats(int devfd, __u64 oid)
+{
+    struct memory_container_stats stats;
+    (void)oid;
+    return mcontainer_stats(devfd, &stats);
+}
+
+static const struct
+{
+    const char *name;
+    int (*call)(int devfd, __u64 oid);
+} calls[] = {
+    { "lock+unlock", call_lock },
+    { "size", call_size },
+    { "stats", call_stats },
+};
+
+#define NR_CALLS (sizeof(calls) / sizeof(calls[0]))
+
+static void worker(__u64 oid, __u64 start, long *ops, long *errors)
+{
+    __u64 deadline = start + (__u64)(seconds * 1e9);
+    char *mapped_data;
+    unsigned int c;
+    long n;
+    int devfd;
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        _exit(1);
+    }
+    mcontainer_create(devfd, 0);
+    mapped_data = (char *)mcontainer_alloc(devfd, oid, OBJECT_SIZE);
+    if (mapped_data == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed in mcontainer_alloc()\n");
+        _exit(1);
+    }
+    mapped_data[0] = 1;
+    // start together so the tasks really overlap.
+    while (now_ns() < start)
+        ;
+    for (c = 0; c < NR_CALLS; c++)
+    {
+        for (n = 0; now_ns() < deadline + c * (__u64)(seconds * 1e9); n++)
+            errors[c] += calls[c].call(devfd, oid) < 0;
+        ops[c] = n;
+    }
+    munmap(mapped_data, OBJECT_SIZE);
+    mcontainer_free(devfd, oid);
+    mcontainer_delete(devfd);
+    close(devfd);
+}
+
+static void run(int tasks)
+{
+    size_t size = 2 * tasks * NR_CALLS * sizeof(long);
+    long *ops = (long *)mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    long *errors = ops + tasks * NR_CALLS;
+    __u64 start = now_ns() + 100000000ULL;
+    unsigned int c;
+    int i, status;
+
+    memset(ops, 0, size);
+    for (i = 0; i < tasks; i++)
+    {
+        if (fork() == 0)
+        {
+            worker(i, start, &ops[i * NR_CALLS], &errors[i * NR_CALLS]);
+            _exit(0);
+        }
+    }
+    while (wait(&status) > 0)
+        ;
+    for (c = 0; c < NR_CALLS; c++)
+    {
+        long total = 0, failed = 0;
+
+        for (i = 0; i < tasks; i++)
+        {
+            total += ops[i * NR_CALLS + c];
+            failed += errors[i * NR_CALLS + c];
+        }
+        // wall time per call in each task, and calls/s across all of them.
+        printf("%-6d %-12s %10.0f ns/op %12.0f ops/s", tasks, calls[c].name,
+               total ? seconds * 1e9 * tasks / total : 0.0, total / seconds);
+        if (failed)
+            printf("  (%ld failed)", failed);
+        printf("\n");
+    }
+    munmap(ops, size);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt, tasks;
+
+    while ((opt = getopt(argc, argv, "t:d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': max_tasks = atoi(optarg); break;
+        case 'd': seconds = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-t max tasks] [-d seconds per call]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (max_tasks < 1)
+    {
+        fprintf(stderr, "need at least one task\n");
+        exit(1);
+    }
+
+    printf("%-6s %-12s %16s %16s\n", "tasks", "call", "latency", "throughput");
+    for (tasks = 1; tasks < max_tasks; tasks *= 2)
+        run(tasks);
+    run(max_tasks);
+    return 0;
+}
@@ -0,0 +1,269 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Passing Messages Between Processes: Lock-Free Rings v.s. mcontainer_lock
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+#include <mcontainer_lockfree.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define CAPACITY 1024
+#define RING_OID 0
+#define CONTROL_OID 1
+
+enum mode
+{
+    MODE_SPSC,
+    MODE_MPMC,
+    MODE_LOCKED
+};
+
+// what the ring looks like when mcontainer_lock protects it.
+struct locked_ring
+{
+    __u64 head, tail;
+    __u64 slots[CAPACITY];
+};
+
+// shared by everybody taking part in a run.
+struct control
+{
+    __u64 go, consumed, sum;
+};
+
+static int devfd;
+static long messages;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t ring_bytes(void)
+{
+    size_t bytes = mcontainer_ring_bytes(CAPACITY, sizeof(__u64));
+    if (bytes < mcontainer_spsc_bytes(CAPACITY, sizeof(__u64)))
+        bytes = mcontainer_spsc_bytes(CAPACITY, sizeof(__u64));
+    if (bytes < sizeof(struct locked_ring))
+        bytes = sizeof(struct locked_ring);
+    return bytes;
+}
+
+static int enqueue(enum mode mode, void *ring, __u64 value)
+{
+    struct locked_ring *locked = (struct locked_ring *)ring;
+    int ret = -1;
+
+    switch (mode)
+    {
+    case MODE_SPSC:
+        return mcontainer_spsc_enqueue((struct mcontainer_spsc *)ring, &value);
+    case MODE_MPMC:
+        return mcontainer_ring_enqueue((struct mcontainer_ring *)ring, &value);
+    default:
+        mcontainer_lock(devfd, RING_OID);
+        if (locked->tail - locked->head < CAPACITY)
+        {
+            locked->slots[locked->tail++ % CAPACITY] = value;
+            ret = 0;
+        }
+        mcontainer_unlock(devfd, RING_OID);
+        return ret;
+    }
+}
+
+static int dequeue(enum mode mode, void *ring, __u64 *value)
+{
+    struct locked_ring *locked = (struct locked_ring *)ring;
+    int ret = -1;
+
+    switch (mode)
+    {
+    case MODE_SPSC:
+        return mcontainer_spsc_dequeue((struct mcontainer_spsc *)ring, value);
+    case MODE_MPMC:
+        return mcontainer_ring_dequeue((struct mcontainer_ring *)ring, value);
+    default:
+        mcontainer_lock(devfd, RING_OID);
+        if (locked->head != locked->tail)
+        {
+            *value = locked->slots[locked->head++ % CAPACITY];
+            ret = 0;
+        }
+        mcontainer_unlock(devfd, RING_OID);
+        return ret;
+    }
+}
+
+static void producer(enum mode mode, void *ring, struct control *control, long count)
+{
+    long i;
+
+    while (!__atomic_load_n(&control->go, __ATOMIC_ACQUIRE))
+        sched_yield();
+    for (i = 0; i < count; i++)
+    {
+        while (enqueue(mode, ring, (__u64)i + 1) < 0)
+            sched_yield();
+    }
+}
+
+// consumers share the work: stop once everybody together has seen all messages.
+static void consumer(enum mode mode, void *ring, struct control *control, __u64 *sum)
+{
+    __u64 value;
+
+    while (__atomic_load_n(&control->consumed, __ATOMIC_ACQUIRE) < (__u64)messages)
+    {
+        if (dequeue(mode, ring, &value) < 0)
+        {
+            sched_yield();
+            continue;
+        }
+        *sum += value;
+        __atomic_fetch_add(&control->consumed, 1, __ATOMIC_ACQ_REL);
+    }
+}
+
+static void run(const char *name, enum mode mode, int producers, int consumers)
+{
+    void *ring;
+    struct control *control;
+    pid_t *pid = (pid_t *)calloc(producers + consumers, sizeof(pid_t));
+    double start, elapsed;
+    __u64 expected = 0, count;
+    int i, stat;
+
+    // each run starts from fresh objects.
+    mcontainer_free(devfd, RING_OID);
+    mcontainer_free(devfd, CONTROL_OID);
+    ring = mcontainer_alloc(devfd, RING_OID, ring_bytes());
+    control = (struct control *)mcontainer_alloc(devfd, CONTROL_OID, sizeof(struct control));
+    if (ring == MAP_FAILED || control == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed in mcontainer_alloc()\n");
+        exit(1);
+    }
+    memset(control, 0, sizeof(*control));
+    if (mode == MODE_SPSC)
+        mcontainer_spsc_init(ring, ring_bytes(), CAPACITY, sizeof(__u64));
+    else if (mode == MODE_MPMC)
+        mcontainer_ring_init(ring, ring_bytes(), CAPACITY, sizeof(__u64));
+    else
+        memset(ring, 0, sizeof(struct locked_ring));
+
+    for (i = 0; i < producers + consumers; i++)
+    {
+        pid[i] = fork();
+        if (pid[i] == 0)
+        {
+            __u64 sum = 0;
+            // a forked task is not in any container until it joins one.
+            mcontainer_create(devfd, 0);
+            if (i < producers)
+                producer(mode, ring, control, messages / producers + (i < messages % producers));
+            else
+                consumer(mode, ring, control, &sum);
+            __atomic_fetch_add(&control->sum, sum, __ATOMIC_ACQ_REL);
+            mcontainer_delete(devfd);
+            _exit(0);
+        }
+    }
+
+    start = now_sec();
+    __atomic_store_n(&control->go, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < producers + consumers; i++)
+    {
+        waitpid(pid[i], &stat, 0);
+    }
+    elapsed = now_sec() - start;
+    printf("%-8s %d -> %d   %12.0f messages/s\n", name, producers, consumers, messages / elapsed);
+    // every producer sends 1..count, so the consumers must have seen exactly that.
+    for (i = 0; i < producers; i++)
+    {
+        count = messages / producers + (i < messages % producers);
+        expected += count * (count + 1) / 2;
+    }
+    if (control->sum != expected)
+    {
+        printf("%-8s lost or duplicated messages\n", name);
+    }
+    fflush(stdout);
+
+    munmap(ring, ring_bytes());
+    munmap(control, sizeof(struct control));
+    free(pid);
+}
+
+int main(int argc, char *argv[])
+{
+    int producers = 1, consumers = 1;
+
+    messages = argc > 1 ? atol(argv[1]) : 1000000;
+    if (argc > 2)
+    {
+        producers = atoi(argv[2]);
+    }
+    if (argc > 3)
+    {
+        consumers = atoi(argv[3]);
+    }
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+
+    if (producers == 1 && consumers == 1)
+    {
+        run("spsc", MODE_SPSC, 1, 1);
+    }
+    run("mpmc", MODE_MPMC, producers, consumers);
+    run("locked", MODE_LOCKED, producers, consumers);
+
+    mcontainer_free(devfd, RING_OID);
+    mcontainer_free(devfd, CONTROL_OID);
+    mcontainer_delete(devfd);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,222 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Multi-Object Locking: lock_many v.s. Taking Locks One by One
+//
+////////////////////////////////////////////////////////////////////////
+
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define MAX_SPAN 16
+
+static int objects = 64, span = 4, workers = 8, transactions = 10000, timeout = 10;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// pick span distinct objects in random order.
+static void pick(__u64 *oids, unsigned int *seed)
+{
+    int i, j;
+    for (i = 0; i < span; i++)
+    {
+        do
+        {
+            oids[i] = rand_r(seed) % objects;
+            for (j = 0; j < i && oids[j] != oids[i]; j++)
+                ;
+        } while (j < i);
+    }
+}
+
+// each transaction adds one to the first word of every object it holds.
+static void worker(int devfd, int naive, unsigned int seed)
+{
+    __u64 oids[MAX_SPAN];
+    long *data[MAX_SPAN];
+    char **mapped;
+    int t, i;
+
+    // containers are per task, so every worker joins the parent's.
+    mcontainer_create(devfd, 0);
+    mapped = (char **)calloc(objects, sizeof(char *));
+    for (i = 0; i < objects; i++)
+    {
+        mapped[i] = (char *)mcontainer_alloc(devfd, i, getpagesize());
+        if (mapped[i] == MAP_FAILED)
+        {
+            fprintf(stderr, "Failed in mcontainer_alloc()\n");
+            _exit(1);
+        }
+    }
+    for (t = 0; t < transactions; t++)
+    {
+        pick(oids, &seed);
+        if (naive)
+        {
+            for (i = 0; i < span; i++)
+                mcontainer_lock(devfd, oids[i]);
+        }
+        else if (mcontainer_lock_many(devfd, oids, span) < 0)
+        {
+            perror("mcontainer_lock_many");
+            _exit(1);
+        }
+        for (i = 0; i < span; i++)
+        {
+            data[i] = (long *)mapped[oids[i]];
+            (*data[i])++;
+        }
+        if (naive)
+        {
+            for (i = 0; i < span; i++)
+                mcontainer_unlock(devfd, oids[i]);
+        }
+        else
+            mcontainer_unlock_many(devfd, oids, span);
+    }
+    _exit(0);
+}
+
+// run one round; returns 0 if every worker finished, -1 on a deadlock.
+static int run(int devfd, int naive, const char *name)
+{
+    pid_t pids[workers];
+    double start, deadline, elapsed;
+    long total = 0;
+    char *mapped;
+    int i, status, running = workers, stuck = 0;
+
+    for (i = 0; i < objects; i++)
+    {
+        mapped = (char *)mcontainer_alloc(devfd, i, getpagesize());
+        memset(mapped, 0, getpagesize());
+        munmap(mapped, getpagesize());
+    }
+    start = now_sec();
+    deadline = start + timeout;
+    for (i = 0; i < workers; i++)
+    {
+        pids[i] = fork();
+        if (pids[i] == 0)
+            worker(devfd, naive, 0x9e3779b9u * (i + 1));
+    }
+    // poll rather than block so that a deadlocked round can be given up on.
+    while (running)
+    {
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid > 0)
+        {
+            running--;
+            continue;
+        }
+        if (now_sec() > deadline)
+        {
+            stuck = 1;
+            break;
+        }
+        usleep(1000);
+    }
+    elapsed = now_sec() - start;
+    if (stuck)
+    {
+        for (i = 0; i < workers; i++)
+            kill(pids[i], SIGKILL);
+        while (wait(&status) > 0)
+            ;
+        printf("%-12s deadlocked after %.1f s (%d of %d workers stuck)\n", name, elapsed, running, workers);
+        return -1;
+    }
+
+    for (i = 0; i < objects; i++)
+    {
+        mapped = (char *)mcontainer_alloc(devfd, i, getpagesize());
+        total += *(long *)mapped;
+        munmap(mapped, getpagesize());
+    }
+    printf("%-12s %10.0f txn/s  %s\n", name, (double)workers * transactions / elapsed,
+           total == (long)workers * transactions * span ? "consistent" : "LOST UPDATES");
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int devfd, opt, i, ret;
+
+    while ((opt = getopt(argc, argv, "o:s:w:n:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'o': objects = atoi(optarg); break;
+        case 's': span = atoi(optarg); break;
+        case 'w': workers = atoi(optarg); break;
+        case 'n': transactions = atoi(optarg); break;
+        case 't': timeout = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-o objects] [-s span] [-w workers] [-n transactions] [-t timeout]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (span < 1 || span > MAX_SPAN || span > objects)
+    {
+        fprintf(stderr, "span must be between 1 and %d and at most the number of objects\n", MAX_SPAN);
+        exit(1);
+    }
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+
+    ret = run(devfd, 0, "lock_many");
+    // locks left behind by killed workers are never released, so this goes last.
+    if (run(devfd, 1, "one by one") < 0)
+        exit(ret != 0);
+
+    for (i = 0; i < objects; i++)
+        mcontainer_free(devfd, i);
+    mcontainer_delete(devfd);
+    close(devfd);
+    return ret != 0;
+}
@@ -0,0 +1,171 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Lock Acquire Latency of a Normal Task Among Niced Lock Hogs
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "histogram.h"
+
+#define PRIORITY_PARAMETER "/sys/module/memory_container/parameters/lock_priority"
+
+static int workers = 8, hold_us = 20;
+static double seconds = 5.0;
+
+static __u64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// keep the lock for hold_us without sleeping, like a short critical section.
+static void hold(void)
+{
+    __u64 until = now_ns() + hold_us * 1000ULL;
+    while (now_ns() < until)
+        ;
+}
+
+// niced workers take object 0 back to back; the normal task takes it once
+// a millisecond and times how long it waits.
+static void contend(int devfd, int hog, struct histogram *h, long *ops)
+{
+    __u64 deadline = now_ns() + (__u64)(seconds * 1e9), start;
+
+    mcontainer_create(devfd, 0);
+    if (hog && nice(19) < 0)
+        perror("nice");
+    while (now_ns() < deadline)
+    {
+        if (!hog)
+            usleep(1000);
+        start = now_ns();
+        mcontainer_lock(devfd, 0);
+        if (!hog)
+            histogram_record(h, now_ns() - start);
+        hold();
+        mcontainer_unlock(devfd, 0);
+        (*ops)++;
+    }
+    mcontainer_delete(devfd);
+}
+
+static void run(const char *name)
+{
+    struct histogram *h = (struct histogram *)mmap(0, sizeof(struct histogram), PROT_READ | PROT_WRITE,
+                                                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    long *ops = (long *)mmap(0, (workers + 1) * sizeof(long), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    long hog_ops = 0;
+    int i, status, devfd;
+
+    histogram_init(h);
+    memset(ops, 0, (workers + 1) * sizeof(long));
+    for (i = 0; i <= workers; i++)
+    {
+        if (fork() == 0)
+        {
+            devfd = mcontainer_open();
+            if (devfd < 0)
+            {
+                fprintf(stderr, "Device open failed");
+                _exit(1);
+            }
+            contend(devfd, i < workers, h, &ops[i]);
+            _exit(0);
+        }
+    }
+    while (wait(&status) > 0)
+        ;
+    histogram_print(stdout, name, h);
+    for (i = 0; i < workers; i++)
+        hog_ops += ops[i];
+    printf("%-16s %ld niced acquires/s\n", "", (long)(hog_ops / seconds));
+    munmap(ops, (workers + 1) * sizeof(long));
+    munmap(h, sizeof(struct histogram));
+}
+
+// switch priority hand-off on or off, returning 0 if it cannot be changed.
+static int set_priority(int on)
+{
+    int fd = open(PRIORITY_PARAMETER, O_WRONLY);
+    int ok;
+
+    if (fd < 0)
+        return 0;
+    ok = write(fd, on ? "Y" : "N", 1) == 1;
+    close(fd);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:h:d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w': workers = atoi(optarg); break;
+        case 'h': hold_us = atoi(optarg); break;
+        case 'd': seconds = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-w niced workers] [-h hold us] [-d seconds]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (workers < 1)
+    {
+        fprintf(stderr, "need at least one niced worker\n");
+        exit(1);
+    }
+
+    histogram_print_header(stdout);
+    if (!set_priority(0))
+    {
+        // the mock, or no permission to change the wakeup order.
+        run("acquire");
+        return 0;
+    }
+    run("fifo");
+    set_priority(1);
+    run("priority");
+    set_priority(0);
+    return 0;
+}
@@ -0,0 +1,272 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     mcstat: Live Memory Container Statistics, vmstat Style
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define STATS_PARAMETER "/sys/module/memory_container/parameters/stats"
+#define POOL_PARAMETER "/sys/module/memory_container/parameters/pool_high"
+#define BYPASS_PARAMETER "/sys/module/memory_container/parameters/pool_memcg_bypass"
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static __u64 delta(const struct memory_container_stats *now, const struct memory_container_stats *then, int item)
+{
+    return now->count[item] - then->count[item];
+}
+
+static void header(void)
+{
+    printf("%8s %8s %8s %8s %9s %9s %6s %9s %9s %6s %9s %9s %9s\n", "create/s", "delete/s", "mmap/s",
+           "free/s", "lock/s", "unlock/s", "cont%", "fault/s", "allocMB/s", "pool%", "other/s", "objects",
+           "residentMB");
+}
+
+// one line of rates over elapsed seconds, plus the live totals.
+static void report(const struct memory_container_stats *now, const struct memory_container_stats *then,
+                   double elapsed)
+{
+    double mb = getpagesize() / (double)(1 << 20);
+    __u64 locks = delta(now, then, MCONTAINER_STAT_LOCK);
+    __u64 contended = delta(now, then, MCONTAINER_STAT_LOCK_CONTENDED);
+    __u64 hits = delta(now, then, MCONTAINER_STAT_POOL_HIT);
+    __u64 misses = delta(now, then, MCONTAINER_STAT_POOL_MISS);
+
+    printf("%8.0f %8.0f %8.0f %8.0f %9.0f %9.0f %6.1f %9.0f %9.1f %6.1f %9.0f %9lld %9.1f\n",
+           delta(now, then, MCONTAINER_STAT_CREATE) / elapsed, delta(now, then, MCONTAINER_STAT_DELETE) / elapsed,
+           delta(now, then, MCONTAINER_STAT_MMAP) / elapsed, delta(now, then, MCONTAINER_STAT_FREE) / elapsed,
+           locks / elapsed, delta(now, then, MCONTAINER_STAT_UNLOCK) / elapsed,
+           locks + contended ? 100.0 * contended / (locks + contended) : 0.0,
+           delta(now, then, MCONTAINER_STAT_FAULT) / elapsed,
+           delta(now, then, MCONTAINER_STAT_PAGE_ALLOC) * mb / elapsed,
+           hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+           (delta(now, then, MCONTAINER_STAT_OTHER) + delta(now, then, MCONTAINER_STAT_TRANSFER) +
+            delta(now, then, MCONTAINER_STAT_RESIZE)) / elapsed,
+           (long long)(now->count[MCONTAINER_STAT_OBJECT_ALLOC] - now->count[MCONTAINER_STAT_OBJECT_FREE]),
+           (long long)(now->count[MCONTAINER_STAT_PAGE_ALLOC] - now->count[MCONTAINER_STAT_PAGE_FREE]) * mb);
+    fflush(stdout);
+}
+
+static int monitor(double interval, int count)
+{
+    struct memory_container_stats then, now;
+    double start, elapsed;
+    int devfd, line;
+
+    devfd = mcontainer_open();
+    if (devfd < 0 || mcontainer_stats(devfd, &then) < 0)
+    {
+        perror("mcontainer_stats");
+        return 1;
+    }
+    start = now_sec();
+    for (line = 0; count == 0 || line < count; line++)
+    {
+        if (line % 20 == 0)
+            header();
+        usleep((useconds_t)(interval * 1e6));
+        if (mcontainer_stats(devfd, &now) < 0)
+        {
+            perror("mcontainer_stats");
+            return 1;
+        }
+        elapsed = now_sec() - start;
+        start += elapsed;
+        report(&now, &then, elapsed);
+        then = now;
+    }
+    close(devfd);
+    return 0;
+}
+
+// switch counting on or off, in the module and in mock backends forked after this.
+static void set_counting(int enable)
+{
+    int fd = open(STATS_PARAMETER, O_WRONLY);
+
+    setenv("MCONTAINER_MOCK_STATS", enable ? "1" : "0", 1);
+    if (fd >= 0)
+    {
+        if (write(fd, enable ? "Y" : "N", 1) != 1)
+            perror(STATS_PARAMETER);
+        close(fd);
+    }
+}
+
+// time ops lock/unlock pairs and ops map/unmap pairs in a fresh child.
+static double measure(int ops, int enable)
+{
+    double *elapsed = (double *)mmap(0, sizeof(double), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    double result;
+    int status;
+
+    set_counting(enable);
+    if (fork() == 0)
+    {
+        int devfd = mcontainer_open(), i;
+        double start;
+        char *mapped_data;
+
+        mcontainer_create(devfd, 0);
+        start = now_sec();
+        for (i = 0; i < ops; i++)
+        {
+            mcontainer_lock(devfd, 0);
+            mcontainer_unlock(devfd, 0);
+            mapped_data = (char *)mcontainer_alloc(devfd, 0, getpagesize());
+            mapped_data[0]++;
+            munmap(mapped_data, getpagesize());
+        }
+        *elapsed = now_sec() - start;
+        mcontainer_free(devfd, 0);
+        mcontainer_delete(devfd);
+        _exit(0);
+    }
+    wait(&status);
+    result = *elapsed;
+    munmap(elapsed, sizeof(double));
+    return result;
+}
+
+static int overhead(int ops)
+{
+    double off = 1e30, on = 1e30, t;
+    int round;
+
+    if (access(STATS_PARAMETER, W_OK) < 0 &&
+        !(getenv("MCONTAINER_BACKEND") && strcmp(getenv("MCONTAINER_BACKEND"), "mock") == 0))
+    {
+        fprintf(stderr, "counting can only be switched off through %s\n", STATS_PARAMETER);
+        return 1;
+    }
+    // best of five, alternating, to keep frequency changes out of the comparison.
+    for (round = 0; round < 5; round++)
+    {
+        t = measure(ops, 0);
+        off = t < off ? t : off;
+        t = measure(ops, 1);
+        on = t < on ? t : on;
+    }
+    set_counting(1);
+    printf("counting off %10.0f op cycles/s\n", ops / off);
+    printf("counting on  %10.0f op cycles/s\n", ops / on);
+    printf("overhead     %10.2f %%\n", 100.0 * (on - off) / off);
+    return 0;
+}
+
+// read a module parameter into value, returning 0 if there is none.
+static int read_parameter(const char *path, char *value, size_t len)
+{
+    int fd = open(path, O_RDONLY);
+    ssize_t n;
+
+    if (fd < 0)
+        return 0;
+    n = read(fd, value, len - 1);
+    close(fd);
+    value[n > 0 ? n : 0] = '\0';
+    return 1;
+}
+
+// report the pool's hits and misses so far; fails if the pool is on for
+// every task but every page was zeroed inline anyway. Tasks in a memory
+// cgroup go around the pool while pool_memcg_bypass is set, so then a
+// run without hits is expected.
+static int pool_check(void)
+{
+    struct memory_container_stats stats;
+    __u64 hits, misses;
+    char value[32], bypass[32] = "N";
+    int devfd;
+
+    devfd = mcontainer_open();
+    if (devfd < 0 || mcontainer_stats(devfd, &stats) < 0)
+    {
+        perror("mcontainer_stats");
+        return 1;
+    }
+    close(devfd);
+    hits = stats.count[MCONTAINER_STAT_POOL_HIT];
+    misses = stats.count[MCONTAINER_STAT_POOL_MISS];
+    printf("pool: %llu hits, %llu misses\n", (unsigned long long)hits, (unsigned long long)misses);
+
+    // the mock has no pool.
+    if (!read_parameter(POOL_PARAMETER, value, sizeof(value)))
+        return 0;
+    read_parameter(BYPASS_PARAMETER, bypass, sizeof(bypass));
+    if (atoi(value) > 0 && bypass[0] != 'Y' && misses && !hits)
+    {
+        fprintf(stderr, "pool: enabled but never hit\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    double interval = 1.0;
+    int count = 0, ops = 0, opt;
+
+    while ((opt = getopt(argc, argv, "i:c:m:p")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i': interval = atof(optarg); break;
+        case 'c': count = atoi(optarg); break;
+        case 'm': ops = atoi(optarg); break;
+        case 'p': return pool_check();
+        default:
+            fprintf(stderr, "usage: %s [-i interval] [-c count] [-m ops] [-p]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (interval <= 0)
+    {
+        fprintf(stderr, "interval must be positive\n");
+        exit(1);
+    }
+    if (ops)
+        return overhead(ops);
+    return monitor(interval, count);
+}
@@ -0,0 +1,209 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Change Notification: poll() v.s. Busy-Polling the Metadata Page
+//
+////////////////////////////////////////////////////////////////////////
+
+#define _GNU_SOURCE
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static int iterations = 1000;
+static int interval_us = 1000;
+static volatile double unlocked_at;
+static volatile int ready;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double thread_cpu_sec(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+struct result
+{
+    double latency_sum, latency_max, cpu;
+    int wakeups;
+};
+
+static void record(struct result *r)
+{
+    double latency = now_sec() - unlocked_at;
+    r->latency_sum += latency;
+    if (latency > r->latency_max)
+        r->latency_max = latency;
+    r->wakeups++;
+}
+
+// wait for changes of object 0 by sleeping in poll() on the device.
+static void *poll_consumer(void *arg)
+{
+    struct result *r = (struct result *)arg;
+    struct memory_container_event events[16];
+    struct pollfd pfd;
+    double cpu;
+    int devfd = mcontainer_open();
+
+    mcontainer_create(devfd, 0);
+    mcontainer_watch(devfd, 0, 1);
+    pfd.fd = devfd;
+    pfd.events = POLLIN;
+    ready = 1;
+    cpu = thread_cpu_sec();
+    while (r->wakeups < iterations)
+    {
+        if (poll(&pfd, 1, -1) <= 0)
+            continue;
+        if (read(devfd, events, sizeof(events)) > 0)
+            record(r);
+    }
+    r->cpu = thread_cpu_sec() - cpu;
+    mcontainer_delete(devfd);
+    close(devfd);
+    return NULL;
+}
+
+// spin on object 0's slot of the metadata page.
+static void *spin_consumer(void *arg)
+{
+    struct result *r = (struct result *)arg;
+    const struct memory_container_meta *meta;
+    __u64 seen;
+    double cpu;
+    int devfd = mcontainer_open();
+
+    mcontainer_create(devfd, 0);
+    meta = mcontainer_map_meta(devfd);
+    if (meta == MAP_FAILED)
+    {
+        perror("mcontainer_map_meta");
+        exit(1);
+    }
+    seen = ((volatile const struct memory_container_meta *)meta)[0].generation;
+    ready = 1;
+    cpu = thread_cpu_sec();
+    while (r->wakeups < iterations)
+    {
+        __u64 generation = ((volatile const struct memory_container_meta *)meta)[0].generation;
+        if (generation != seen)
+        {
+            seen = generation;
+            record(r);
+        }
+    }
+    r->cpu = thread_cpu_sec() - cpu;
+    munmap((void *)meta, MCONTAINER_META_PAGES * getpagesize());
+    mcontainer_delete(devfd);
+    close(devfd);
+    return NULL;
+}
+
+static void run(const char *name, void *(*consumer)(void *), int devfd, __u64 *data)
+{
+    struct result r;
+    pthread_t thread;
+    int i;
+
+    memset(&r, 0, sizeof(r));
+    ready = 0;
+    pthread_create(&thread, NULL, consumer, &r);
+    while (!ready)
+        usleep(1000);
+    for (i = 0; i < iterations; i++)
+    {
+        usleep(interval_us);
+        mcontainer_lock(devfd, 0);
+        data[0]++;
+        unlocked_at = now_sec();
+        mcontainer_unlock(devfd, 0);
+        // the spinning consumer may miss a generation if we go again too soon
+        while (r.wakeups <= i && consumer == spin_consumer)
+            ;
+    }
+    pthread_join(thread, NULL);
+    printf("%-12s wakeup %8.1f us avg %8.1f us max   consumer cpu %6.1f%%\n", name,
+           r.latency_sum / r.wakeups * 1e6, r.latency_max * 1e6,
+           r.cpu / (iterations * interval_us / 1e6) * 100);
+}
+
+int main(int argc, char *argv[])
+{
+    __u64 *data;
+    int devfd;
+
+    if (argc > 1)
+    {
+        iterations = atoi(argv[1]);
+    }
+    if (argc > 2)
+    {
+        interval_us = atoi(argv[2]);
+    }
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+    data = (__u64 *)mcontainer_alloc(devfd, 0, getpagesize());
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed in mcontainer_alloc()\n");
+        exit(1);
+    }
+
+    run("poll()", poll_consumer, devfd, data);
+    run("busy-poll", spin_consumer, devfd, data);
+
+    munmap(data, getpagesize());
+    mcontainer_free(devfd, 0);
+    mcontainer_delete(devfd);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,146 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Binary Operation Log Written by benchmark and Replayed by validate
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef MCONTAINER_OPLOG_H
+#define MCONTAINER_OPLOG_H
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <linux/types.h>
+
+#define OPLOG_MAGIC 0x474f4c504f434d00ULL
+#define OPLOG_VERSION 1
+#define OPLOG_BUFFER_RECORDS 4096
+
+#define OPLOG_STORE 'S'
+#define OPLOG_DELETE 'D'
+
+struct oplog_header
+{
+    __u64 magic;
+    __u32 version, record_size;
+};
+
+// one operation; the payload itself is replaced by its checksum and length.
+struct oplog_record
+{
+    __u64 time;
+    __u64 oid;
+    __u64 checksum;
+    __u32 pid, cid;
+    __u32 size, length;
+    __u32 op, pad;
+};
+
+struct oplog_writer
+{
+    int fd, count;
+    struct oplog_record buffer[OPLOG_BUFFER_RECORDS];
+};
+
+// checksum of the first length bytes of an object, a word at a time.
+static inline __u64 oplog_checksum(const char *data, size_t length)
+{
+    __u64 h = 0x9e3779b97f4a7c15ULL ^ length, word;
+    size_t i;
+
+    for (i = 0; i + 8 <= length; i += 8)
+    {
+        memcpy(&word, data + i, 8);
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    if (i < length)
+    {
+        word = 0;
+        memcpy(&word, data + i, length - i);
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+static inline int oplog_flush(struct oplog_writer *w)
+{
+    const char *p = (const char *)w->buffer;
+    size_t left = w->count * sizeof(struct oplog_record);
+    ssize_t n;
+
+    while (left)
+    {
+        n = write(w->fd, p, left);
+        if (n <= 0)
+            return -1;
+        p += n;
+        left -= n;
+    }
+    w->count = 0;
+    return 0;
+}
+
+static inline int oplog_open(struct oplog_writer *w, const char *path)
+{
+    struct oplog_header header = {OPLOG_MAGIC, OPLOG_VERSION, sizeof(struct oplog_record)};
+
+    w->count = 0;
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0 || write(w->fd, &header, sizeof(header)) != sizeof(header))
+        return -1;
+    return 0;
+}
+
+static inline void oplog_append(struct oplog_writer *w, int op, int pid, int cid, __u64 time, __u64 oid,
+                                int size, int length, __u64 checksum)
+{
+    struct oplog_record *r = &w->buffer[w->count++];
+
+    r->time = time;
+    r->oid = oid;
+    r->checksum = checksum;
+    r->pid = pid;
+    r->cid = cid;
+    r->size = size;
+    r->length = length;
+    r->op = op;
+    r->pad = 0;
+    if (w->count == OPLOG_BUFFER_RECORDS)
+        oplog_flush(w);
+}
+
+static inline int oplog_close(struct oplog_writer *w)
+{
+    int ret = oplog_flush(w);
+    close(w->fd);
+    return ret;
+}
+
+#endif
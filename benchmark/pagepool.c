@@ -0,0 +1,183 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     First-Touch Latency Under an Allocation Storm, With and Without
+//     the Pool of Pre-Zeroed Pages
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "histogram.h"
+
+#define POOL_PARAMETER "/sys/module/memory_container/parameters/pool_high"
+
+static int workers = 4, pages = 16;
+static double seconds = 5.0;
+
+static __u64 now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// allocate, touch and free fresh objects until the time is up, timing
+// every first write to a page.
+static void storm(int devfd, int worker, struct histogram *h)
+{
+    __u64 deadline = now_ns() + (__u64)(seconds * 1e9), start, oid;
+    size_t size = (size_t)pages * getpagesize();
+    char *mapped_data;
+    int i, n;
+
+    mcontainer_create(devfd, 0);
+    for (n = 0; now_ns() < deadline; n++)
+    {
+        oid = (__u64)worker * 1000000 + n % 1000000;
+        mapped_data = (char *)mcontainer_alloc(devfd, oid, size);
+        if (mapped_data == MAP_FAILED)
+        {
+            fprintf(stderr, "Failed in mcontainer_alloc()\n");
+            _exit(1);
+        }
+        for (i = 0; i < pages; i++)
+        {
+            start = now_ns();
+            mapped_data[(size_t)i * getpagesize()] = 1;
+            histogram_record(h, now_ns() - start);
+        }
+        munmap(mapped_data, size);
+        mcontainer_free(devfd, oid);
+    }
+    mcontainer_delete(devfd);
+}
+
+static void run(const char *name)
+{
+    struct histogram *h = (struct histogram *)mmap(0, workers * sizeof(struct histogram), PROT_READ | PROT_WRITE,
+                                                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    struct histogram total;
+    int i, status, devfd;
+
+    for (i = 0; i < workers; i++)
+    {
+        histogram_init(&h[i]);
+        if (fork() == 0)
+        {
+            devfd = mcontainer_open();
+            if (devfd < 0)
+            {
+                fprintf(stderr, "Device open failed");
+                _exit(1);
+            }
+            storm(devfd, i, &h[i]);
+            _exit(0);
+        }
+    }
+    while (wait(&status) > 0)
+        ;
+    histogram_init(&total);
+    for (i = 0; i < workers; i++)
+        histogram_merge(&total, &h[i]);
+    histogram_print(stdout, name, &total);
+    munmap(h, workers * sizeof(struct histogram));
+}
+
+// set the pool's high watermark, returning the old one or -1 if it cannot be changed.
+static long set_pool(long high)
+{
+    char buffer[32];
+    long old;
+    int fd = open(POOL_PARAMETER, O_RDWR);
+    ssize_t len;
+
+    if (fd < 0)
+        return -1;
+    len = read(fd, buffer, sizeof(buffer) - 1);
+    if (len <= 0)
+    {
+        close(fd);
+        return -1;
+    }
+    buffer[len] = 0;
+    old = atol(buffer);
+    len = snprintf(buffer, sizeof(buffer), "%ld", high);
+    if (write(fd, buffer, len) != len)
+        old = -1;
+    close(fd);
+    return old;
+}
+
+int main(int argc, char *argv[])
+{
+    long high;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:p:d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w': workers = atoi(optarg); break;
+        case 'p': pages = atoi(optarg); break;
+        case 'd': seconds = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-w workers] [-p pages per object] [-d seconds]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (workers < 1 || pages < 1)
+    {
+        fprintf(stderr, "need at least one worker and one page per object\n");
+        exit(1);
+    }
+
+    histogram_print_header(stdout);
+    high = set_pool(0);
+    if (high < 0)
+    {
+        // the mock, or no permission to switch the pool off.
+        run("touch");
+        return 0;
+    }
+    run("no pool");
+    set_pool(high ? high : 1024);
+    // give the thread a moment to fill the pool before the storm starts.
+    sleep(1);
+    run("pool");
+    set_pool(high);
+    return 0;
+}
@@ -0,0 +1,153 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Saving and Restoring a Container Image
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    __u64 total_size = 1024ULL << 20, object_size = 1 << 20, offset;
+    __u64 i, number_of_objects;
+    const char *path = "mcontainer.image";
+    double start, elapsed;
+    char *mapped_data;
+    int devfd, fd, error = 0;
+
+    if (argc > 1)
+    {
+        total_size = strtoull(argv[1], NULL, 0) << 20;
+    }
+    if (argc > 2)
+    {
+        object_size = strtoull(argv[2], NULL, 0) << 10;
+    }
+    if (argc > 3)
+    {
+        path = argv[3];
+    }
+    number_of_objects = total_size / object_size;
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+
+    // fill the container; each object holds its own oid.
+    for (i = 0; i < number_of_objects; i++)
+    {
+        mapped_data = (char *)mcontainer_alloc(devfd, i, object_size);
+        if (mapped_data == MAP_FAILED)
+        {
+            fprintf(stderr, "Failed in mcontainer_alloc()\n");
+            exit(1);
+        }
+        memset(mapped_data, (int)(i & 0xff), object_size);
+        munmap(mapped_data, object_size);
+    }
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    start = now_sec();
+    if (mcontainer_save(devfd, fd) < 0)
+    {
+        perror("mcontainer_save");
+        exit(1);
+    }
+    fsync(fd);
+    elapsed = now_sec() - start;
+    printf("save          %10.1f MB/s  (%llu objects, %.2f s)\n", total_size / elapsed / (1 << 20),
+           (unsigned long long)number_of_objects, elapsed);
+
+    // pretend the module was reloaded: drop the objects and the image's page cache.
+    for (i = 0; i < number_of_objects; i++)
+    {
+        mcontainer_free(devfd, i);
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    start = now_sec();
+    if (mcontainer_restore(devfd, fd) < 0)
+    {
+        perror("mcontainer_restore");
+        exit(1);
+    }
+    printf("restore       %10.3f ms\n", (now_sec() - start) * 1e3);
+
+    start = now_sec();
+    mapped_data = (char *)mcontainer_alloc(devfd, 0, object_size);
+    error += mapped_data[0] != 0;
+    printf("first access  %10.1f us\n", (now_sec() - start) * 1e6);
+    munmap(mapped_data, object_size);
+
+    // touch every page of every object and check it came back intact.
+    start = now_sec();
+    for (i = 0; i < number_of_objects; i++)
+    {
+        mapped_data = (char *)mcontainer_alloc(devfd, i, object_size);
+        for (offset = 0; offset < object_size; offset += getpagesize())
+        {
+            error += mapped_data[offset] != (char)(i & 0xff);
+        }
+        munmap(mapped_data, object_size);
+    }
+    elapsed = now_sec() - start;
+    printf("read back     %10.1f MB/s\n", total_size / elapsed / (1 << 20));
+    if (error)
+    {
+        fprintf(stderr, "%d pages came back with a wrong value\n", error);
+    }
+
+    for (i = 0; i < number_of_objects; i++)
+    {
+        mcontainer_free(devfd, i);
+    }
+    mcontainer_delete(devfd);
+    close(devfd);
+    close(fd);
+    unlink(path);
+    return error != 0;
+}
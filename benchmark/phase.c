@@ -0,0 +1,282 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Phase Synchronization: Container Barriers and Condition Variables
+//     v.s. Pipes and Semaphores
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define MAX_TASKS 64
+
+// what the tasks of one run share, outside any container.
+struct shared
+{
+    sem_t mutex;
+    sem_t gate[2];
+    int arrived;
+    int pipes[MAX_TASKS][2];
+    double elapsed;
+};
+
+// the phase counter the condition variable run keeps in object 0.
+struct phase
+{
+    int arrived;
+    int generation;
+};
+
+static int rounds = 2000;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void barrier_container(int devfd, struct shared *s, int task, int n, int round, struct phase *p)
+{
+    (void)s, (void)task, (void)round, (void)p;
+    mcontainer_barrier_wait(devfd, 1, n);
+}
+
+// the last one in bumps the generation and wakes the rest.
+static void barrier_cond(int devfd, struct shared *s, int task, int n, int round, struct phase *p)
+{
+    int generation;
+
+    (void)s, (void)task, (void)round;
+    mcontainer_lock(devfd, 0);
+    generation = p->generation;
+    if (++p->arrived == n)
+    {
+        p->arrived = 0;
+        p->generation++;
+        mcontainer_cond_broadcast(devfd, 1);
+    }
+    while (p->generation == generation)
+    {
+        if (mcontainer_cond_wait(devfd, 1, 0) < 0)
+        {
+            perror("mcontainer_cond_wait");
+            _exit(1);
+        }
+    }
+    mcontainer_unlock(devfd, 0);
+}
+
+// two gates, so a fast task in the next round cannot take this one's posts.
+static void barrier_semaphore(int devfd, struct shared *s, int task, int n, int round, struct phase *p)
+{
+    sem_t *gate = &s->gate[round & 1];
+    int i;
+
+    (void)devfd, (void)task, (void)p;
+    sem_wait(&s->mutex);
+    if (++s->arrived == n)
+    {
+        s->arrived = 0;
+        sem_post(&s->mutex);
+        for (i = 1; i < n; i++)
+            sem_post(gate);
+        return;
+    }
+    sem_post(&s->mutex);
+    sem_wait(gate);
+}
+
+// everyone reports to task 0, which then lets each of them go.
+static void barrier_pipe(int devfd, struct shared *s, int task, int n, int round, struct phase *p)
+{
+    char byte = 0;
+    int i;
+
+    (void)devfd, (void)round, (void)p;
+    if (task)
+    {
+        if (write(s->pipes[0][1], &byte, 1) != 1 || read(s->pipes[task][0], &byte, 1) != 1)
+            _exit(1);
+        return;
+    }
+    for (i = 1; i < n; i++)
+    {
+        if (read(s->pipes[0][0], &byte, 1) != 1)
+            _exit(1);
+    }
+    for (i = 1; i < n; i++)
+    {
+        if (write(s->pipes[i][1], &byte, 1) != 1)
+            _exit(1);
+    }
+}
+
+typedef void (*barrier_fn)(int devfd, struct shared *s, int task, int n, int round, struct phase *p);
+
+static void task_main(struct shared *s, int task, int n, barrier_fn barrier)
+{
+    struct phase *p = NULL;
+    double start;
+    int devfd, round;
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        _exit(1);
+    }
+    mcontainer_create(devfd, 0);
+    p = (struct phase *)mcontainer_alloc(devfd, 0, getpagesize());
+    if (p == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed in mcontainer_alloc()\n");
+        _exit(1);
+    }
+    // one round to get everybody started.
+    barrier(devfd, s, task, n, 0, p);
+    start = now_sec();
+    for (round = 1; round <= rounds; round++)
+        barrier(devfd, s, task, n, round, p);
+    if (task == 0)
+        s->elapsed = now_sec() - start;
+    munmap(p, getpagesize());
+    mcontainer_delete(devfd);
+    close(devfd);
+}
+
+static double run(int n, barrier_fn barrier)
+{
+    struct shared *s = (struct shared *)mmap(0, sizeof(struct shared), PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    double elapsed;
+    int i, status;
+
+    sem_init(&s->mutex, 1, 1);
+    sem_init(&s->gate[0], 1, 0);
+    sem_init(&s->gate[1], 1, 0);
+    for (i = 0; i < n; i++)
+    {
+        if (pipe(s->pipes[i]) < 0)
+        {
+            perror("pipe");
+            exit(1);
+        }
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (fork() == 0)
+        {
+            task_main(s, i, n, barrier);
+            _exit(0);
+        }
+    }
+    while (wait(&status) > 0)
+        ;
+    elapsed = s->elapsed;
+    for (i = 0; i < n; i++)
+    {
+        close(s->pipes[i][0]);
+        close(s->pipes[i][1]);
+    }
+    sem_destroy(&s->mutex);
+    sem_destroy(&s->gate[0]);
+    sem_destroy(&s->gate[1]);
+    munmap(s, sizeof(struct shared));
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    static const int tasks[] = {2, 4, 8, 16, 32, 64};
+    static const struct
+    {
+        const char *name;
+        barrier_fn barrier;
+    } methods[] = {
+        {"barrier", barrier_container},
+        {"condvar", barrier_cond},
+        {"semaphore", barrier_semaphore},
+        {"pipe", barrier_pipe},
+    };
+    int max_tasks = MAX_TASKS, opt, i, m, devfd;
+
+    while ((opt = getopt(argc, argv, "r:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r': rounds = atoi(optarg); break;
+        case 't': max_tasks = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-r rounds] [-t most tasks]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (rounds < 1 || max_tasks < 2 || max_tasks > MAX_TASKS)
+    {
+        fprintf(stderr, "need at least one round and 2 to %d tasks\n", MAX_TASKS);
+        exit(1);
+    }
+
+    // the phase counter starts out zeroed for every run.
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+
+    printf("%-6s", "tasks");
+    for (m = 0; m < (int)(sizeof(methods) / sizeof(methods[0])); m++)
+        printf(" %12s", methods[m].name);
+    printf("   (us per phase)\n");
+    for (i = 0; i < (int)(sizeof(tasks) / sizeof(tasks[0])) && tasks[i] <= max_tasks; i++)
+    {
+        printf("%-6d", tasks[i]);
+        for (m = 0; m < (int)(sizeof(methods) / sizeof(methods[0])); m++)
+        {
+            mcontainer_free(devfd, 0);
+            printf(" %12.2f", run(tasks[i], methods[m].barrier) / rounds * 1e6);
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    mcontainer_free(devfd, 0);
+    mcontainer_delete(devfd);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,191 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Growing Objects: Resizing in Place v.s. Free + Realloc + Copy
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the byte at offset i of a grown object, wherever it was written.
+static char pattern(__u64 i)
+{
+    return (char)(i * 131 + 7);
+}
+
+// write the part of the object that is new since it was size bytes.
+static void fill(char *mapped_data, __u64 from, __u64 to)
+{
+    __u64 i;
+    for (i = from; i < to; i++)
+        mapped_data[i] = pattern(i);
+}
+
+static int check(const char *mapped_data, __u64 size)
+{
+    __u64 i;
+    for (i = 0; i < size; i++)
+    {
+        if (mapped_data[i] != pattern(i))
+            return 1;
+    }
+    return 0;
+}
+
+// grow oid 0 step bytes at a time up to max_size with mcontainer_resize.
+static double grow_in_place(int devfd, __u64 step, __u64 max_size, int *error)
+{
+    __u64 size = step;
+    char *mapped_data;
+    double start;
+
+    start = now_sec();
+    mapped_data = (char *)mcontainer_alloc(devfd, 0, size);
+    fill(mapped_data, 0, size);
+    while (size < max_size)
+    {
+        mapped_data = (char *)mcontainer_resize(devfd, 0, mapped_data, size, size + step);
+        if (mapped_data == MAP_FAILED)
+        {
+            perror("mcontainer_resize");
+            exit(1);
+        }
+        fill(mapped_data, size, size + step);
+        size += step;
+    }
+    start = now_sec() - start;
+    *error += check(mapped_data, size);
+    munmap(mapped_data, size);
+    mcontainer_free(devfd, 0);
+    return start;
+}
+
+// the same growth, moving the data to a fresh object every time.
+static double grow_by_copy(int devfd, __u64 step, __u64 max_size, int *error)
+{
+    __u64 size = step, oid = 1;
+    char *mapped_data, *new_data;
+    double start;
+
+    start = now_sec();
+    mapped_data = (char *)mcontainer_alloc(devfd, oid, size);
+    fill(mapped_data, 0, size);
+    while (size < max_size)
+    {
+        new_data = (char *)mcontainer_alloc(devfd, oid ^ 3, size + step);
+        if (new_data == MAP_FAILED)
+        {
+            fprintf(stderr, "Failed in mcontainer_alloc()\n");
+            exit(1);
+        }
+        memcpy(new_data, mapped_data, size);
+        munmap(mapped_data, size);
+        mcontainer_free(devfd, oid);
+        oid ^= 3;
+        mapped_data = new_data;
+        fill(mapped_data, size, size + step);
+        size += step;
+    }
+    start = now_sec() - start;
+    *error += check(mapped_data, size);
+    munmap(mapped_data, size);
+    mcontainer_free(devfd, oid);
+    return start;
+}
+
+int main(int argc, char *argv[])
+{
+    __u64 step = getpagesize(), max_size = 64ULL << 20;
+    struct memory_container_size size;
+    double elapsed;
+    int devfd, error = 0;
+    char *mapped_data;
+
+    if (argc > 1)
+    {
+        max_size = strtoull(argv[1], NULL, 0) << 20;
+    }
+    if (argc > 2)
+    {
+        step = strtoull(argv[2], NULL, 0) << 10;
+    }
+    if (step == 0 || step > max_size)
+    {
+        fprintf(stderr, "usage: %s [max_size MB] [step KB]\n", argv[0]);
+        exit(1);
+    }
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+
+    elapsed = grow_in_place(devfd, step, max_size, &error);
+    printf("resize in place       %10.1f grows/s  %8.3f s\n", max_size / step / elapsed, elapsed);
+    elapsed = grow_by_copy(devfd, step, max_size, &error);
+    printf("free + realloc + copy %10.1f grows/s  %8.3f s\n", max_size / step / elapsed, elapsed);
+
+    // a mapping bigger than the object is refused, and the size can be asked for.
+    mapped_data = (char *)mcontainer_alloc(devfd, 2, step);
+    munmap(mapped_data, step);
+    if (mcontainer_alloc(devfd, 2, 2 * step + getpagesize()) != MAP_FAILED)
+    {
+        fprintf(stderr, "mapping past the end of an object succeeded\n");
+        error++;
+    }
+    if (mcontainer_size(devfd, 2, &size) < 0 || size.size < step)
+    {
+        fprintf(stderr, "mcontainer_size reported %llu bytes\n", (unsigned long long)size.size);
+        error++;
+    }
+    mcontainer_free(devfd, 2);
+
+    if (error)
+    {
+        fprintf(stderr, "%d objects came back with wrong contents\n", error);
+    }
+    mcontainer_delete(devfd);
+    close(devfd);
+    return error != 0;
+}
@@ -0,0 +1,213 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Many Readers and One Writer: Sequence-Count Reads v.s. mcontainer_lock
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define DATA_OID 0
+#define CONTROL_OID 1
+
+// shared by everybody taking part in a run.
+struct control
+{
+    __u64 go, stop, reads, retries, writes, torn;
+};
+
+static int devfd;
+static __u64 object_size = 4096;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the writer fills the whole object with one value at a time.
+static void writer(__u64 *data, struct control *control)
+{
+    __u64 i, value = 0, n = object_size / sizeof(__u64);
+
+    while (!__atomic_load_n(&control->stop, __ATOMIC_ACQUIRE))
+    {
+        mcontainer_lock(devfd, DATA_OID);
+        value++;
+        for (i = 0; i < n; i++)
+            data[i] = value;
+        mcontainer_unlock(devfd, DATA_OID);
+        control->writes++;
+    }
+}
+
+// a copy is torn if it holds more than one of the writer's values.
+static void reader(int locked, __u64 *data, struct control *control)
+{
+    __u64 *buffer = (__u64 *)malloc(object_size), reads = 0, retries = 0, torn = 0, i;
+    __u64 n = object_size / sizeof(__u64);
+    int ret;
+
+    while (!__atomic_load_n(&control->stop, __ATOMIC_ACQUIRE))
+    {
+        if (locked)
+        {
+            mcontainer_lock(devfd, DATA_OID);
+            memcpy(buffer, data, object_size);
+            mcontainer_unlock(devfd, DATA_OID);
+        }
+        else
+        {
+            ret = mcontainer_read_consistent(devfd, DATA_OID, buffer, object_size);
+            if (ret < 0)
+            {
+                perror("mcontainer_read_consistent");
+                break;
+            }
+            retries += ret;
+        }
+        for (i = 1; i < n; i++)
+        {
+            if (buffer[i] != buffer[0])
+            {
+                torn++;
+                break;
+            }
+        }
+        reads++;
+    }
+    __atomic_fetch_add(&control->reads, reads, __ATOMIC_ACQ_REL);
+    __atomic_fetch_add(&control->retries, retries, __ATOMIC_ACQ_REL);
+    __atomic_fetch_add(&control->torn, torn, __ATOMIC_ACQ_REL);
+    free(buffer);
+}
+
+static void run(const char *name, int locked, int readers, double seconds)
+{
+    struct control *control;
+    __u64 *data;
+    pid_t *pid = (pid_t *)calloc(readers + 1, sizeof(pid_t));
+    double start, elapsed;
+    int i, stat;
+
+    // each run starts from fresh objects.
+    mcontainer_free(devfd, DATA_OID);
+    mcontainer_free(devfd, CONTROL_OID);
+    data = (__u64 *)mcontainer_alloc(devfd, DATA_OID, object_size);
+    control = (struct control *)mcontainer_alloc(devfd, CONTROL_OID, sizeof(struct control));
+    if (data == MAP_FAILED || control == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed in mcontainer_alloc()\n");
+        exit(1);
+    }
+    memset(control, 0, sizeof(*control));
+    memset(data, 0, object_size);
+
+    for (i = 0; i <= readers; i++)
+    {
+        pid[i] = fork();
+        if (pid[i] == 0)
+        {
+            // a forked task is not in any container until it joins one.
+            mcontainer_create(devfd, 0);
+            while (!__atomic_load_n(&control->go, __ATOMIC_ACQUIRE))
+                sched_yield();
+            if (i == 0)
+                writer(data, control);
+            else
+                reader(locked, data, control);
+            mcontainer_delete(devfd);
+            _exit(0);
+        }
+    }
+
+    start = now_sec();
+    __atomic_store_n(&control->go, 1, __ATOMIC_RELEASE);
+    usleep((useconds_t)(seconds * 1e6));
+    __atomic_store_n(&control->stop, 1, __ATOMIC_RELEASE);
+    for (i = 0; i <= readers; i++)
+    {
+        waitpid(pid[i], &stat, 0);
+    }
+    elapsed = now_sec() - start;
+    printf("%-10s %3d readers %12.0f reads/s %10.0f writes/s %8.3f retries/read", name, readers,
+           control->reads / elapsed, control->writes / elapsed,
+           control->reads ? (double)control->retries / control->reads : 0.0);
+    if (control->torn)
+    {
+        printf("   %llu torn reads", (unsigned long long)control->torn);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    munmap(data, object_size);
+    munmap(control, sizeof(struct control));
+    free(pid);
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    int readers = argc > 2 ? atoi(argv[2]) : 4;
+
+    if (argc > 3)
+    {
+        object_size = strtoull(argv[3], NULL, 0) << 10;
+    }
+    if (object_size < sizeof(__u64))
+    {
+        object_size = sizeof(__u64);
+    }
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+
+    run("seqcount", 0, readers, seconds);
+    run("locked", 1, readers, seconds);
+
+    mcontainer_free(devfd, DATA_OID);
+    mcontainer_free(devfd, CONTROL_OID);
+    mcontainer_delete(devfd);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,279 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Concurrency Stress: Racing Maps, Frees and Locks
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+static struct
+{
+    int processes, threads, containers, objects, max_size;
+    int free_percent, race_percent;
+    double seconds;
+    const char *csv;
+} config = {4, 1, 1, 64, 16384, 5, 10, 5.0, NULL};
+
+// per-task counters, in memory shared with forked processes.
+struct result
+{
+    __u64 operations, errors;
+};
+
+static struct result *results;
+static int devfd;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// every task maps an oid with the same size, which only depends on the oid.
+static __u64 object_size(int oid)
+{
+    __u64 size = ((__u64)oid * 2654435761u) % config.max_size;
+    return size < sizeof(__u64) * 2 ? sizeof(__u64) * 2 : size;
+}
+
+// an object's first, middle and last words always hold the same count of
+// updates; a fresh object is all zeroes, which also qualifies.
+static int update(__u64 *words, __u64 nr_words)
+{
+    __u64 count = words[0];
+    int torn = words[nr_words / 2] != count || words[nr_words - 1] != count;
+
+    count++;
+    words[0] = count;
+    words[nr_words / 2] = count;
+    words[nr_words - 1] = count;
+    return torn;
+}
+
+static void error(struct result *r, const char *what, int oid)
+{
+    if (r->errors++ < 10)
+        fprintf(stderr, "task %d: %s on object %d (%s)\n", (int)getpid(), what, oid, strerror(errno));
+}
+
+static void *run_task(void *arg)
+{
+    int task = (int)(long)arg;
+    struct result *r = &results[task];
+    unsigned int seed = (unsigned int)(task * 7919 + time(NULL));
+    double deadline = now_sec() + config.seconds;
+    __u64 size;
+    void *mapped_data;
+    int oid, dice;
+
+    mcontainer_create(devfd, task % config.containers);
+    while (now_sec() < deadline)
+    {
+        oid = rand_r(&seed) % config.objects;
+        size = object_size(oid);
+        dice = rand_r(&seed) % 100;
+        if (dice < config.race_percent)
+        {
+            // map without the lock, racing creation and frees; never touch it.
+            mapped_data = mcontainer_alloc(devfd, oid, size);
+            if (mapped_data == MAP_FAILED)
+                error(r, "unlocked mmap failed", oid);
+            else
+                munmap(mapped_data, size);
+        }
+        else if (mcontainer_lock(devfd, oid) < 0)
+        {
+            error(r, "lock failed", oid);
+        }
+        else
+        {
+            if (dice < config.race_percent + config.free_percent)
+            {
+                mcontainer_free(devfd, oid);
+            }
+            else
+            {
+                mapped_data = mcontainer_alloc(devfd, oid, size);
+                if (mapped_data == MAP_FAILED)
+                    error(r, "mmap failed", oid);
+                else
+                {
+                    if (update((__u64 *)mapped_data, size / sizeof(__u64)))
+                        error(r, "torn object", oid);
+                    munmap(mapped_data, size);
+                }
+            }
+            if (mcontainer_unlock(devfd, oid) < 0)
+                error(r, "unlock failed", oid);
+        }
+        r->operations++;
+    }
+    mcontainer_delete(devfd);
+    return NULL;
+}
+
+// start and end with every object gone, so runs with other sizes can follow.
+static void free_objects(void)
+{
+    int cid, oid;
+
+    for (cid = 0; cid < config.containers; cid++)
+    {
+        mcontainer_create(devfd, cid);
+        for (oid = 0; oid < config.objects; oid++)
+            mcontainer_free(devfd, oid);
+        mcontainer_delete(devfd);
+    }
+}
+
+// one process of the run: its tasks are threads, numbered from first.
+static void run_process(int first)
+{
+    pthread_t threads[config.threads];
+    int i;
+
+    for (i = 0; i < config.threads; i++)
+        pthread_create(&threads[i], NULL, run_task, (void *)(long)(first + i));
+    for (i = 0; i < config.threads; i++)
+        pthread_join(threads[i], NULL);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options]\n"
+                    "  -p n        processes (default 4)\n"
+                    "  -t n        threads per process (default 1)\n"
+                    "  -c n        containers, tasks are spread over them (default 1)\n"
+                    "  -o n        objects per container (default 64)\n"
+                    "  -s bytes    largest object (default 16384)\n"
+                    "  -f percent  locked frees (default 5)\n"
+                    "  -r percent  unlocked maps racing everything else (default 10)\n"
+                    "  -d seconds  how long to run (default 5)\n"
+                    "  -C file     append the configuration and throughput to a CSV file\n", name);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    __u64 operations = 0, errors = 0;
+    int i, opt, status, crashed = 0, tasks;
+    double start, elapsed;
+    FILE *fp;
+
+    while ((opt = getopt(argc, argv, "p:t:c:o:s:f:r:d:C:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p': config.processes = atoi(optarg); break;
+        case 't': config.threads = atoi(optarg); break;
+        case 'c': config.containers = atoi(optarg); break;
+        case 'o': config.objects = atoi(optarg); break;
+        case 's': config.max_size = atoi(optarg); break;
+        case 'f': config.free_percent = atoi(optarg); break;
+        case 'r': config.race_percent = atoi(optarg); break;
+        case 'd': config.seconds = atof(optarg); break;
+        case 'C': config.csv = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (config.processes < 1 || config.threads < 1 || config.containers < 1 || config.objects < 1 ||
+        config.max_size < 1 || config.free_percent + config.race_percent > 100)
+        usage(argv[0]);
+    tasks = config.processes * config.threads;
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    results = (struct result *)mmap(0, tasks * sizeof(struct result), PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    free_objects();
+    start = now_sec();
+    for (i = 0; i < config.processes; i++)
+    {
+        if (fork() == 0)
+        {
+            run_process(i * config.threads);
+            _exit(0);
+        }
+    }
+    // a task killed by SIGBUS or SIGSEGV takes its whole process with it.
+    while (wait(&status) > 0)
+    {
+        if (!WIFEXITED(status) || WEXITSTATUS(status))
+            crashed++;
+    }
+    elapsed = now_sec() - start;
+    free_objects();
+
+    for (i = 0; i < tasks; i++)
+    {
+        operations += results[i].operations;
+        errors += results[i].errors;
+    }
+    printf("%d processes x %d threads, %d containers, %d objects up to %d bytes: %.0f ops/s, %llu errors, "
+           "%d crashed\n",
+           config.processes, config.threads, config.containers, config.objects, config.max_size,
+           operations / elapsed, (unsigned long long)errors, crashed);
+
+    if (config.csv)
+    {
+        fp = fopen(config.csv, "a");
+        if (!fp)
+        {
+            perror(config.csv);
+            exit(1);
+        }
+        // a header goes in first when the file is new.
+        if (ftell(fp) == 0)
+            fprintf(fp, "processes,threads,containers,objects,max_size,free_percent,race_percent,seconds,"
+                        "operations,ops_per_s,errors,crashed\n");
+        fprintf(fp, "%d,%d,%d,%d,%d,%d,%d,%.3f,%llu,%.1f,%llu,%d\n", config.processes, config.threads,
+                config.containers, config.objects, config.max_size, config.free_percent, config.race_percent,
+                elapsed, (unsigned long long)operations, operations / elapsed, (unsigned long long)errors,
+                crashed);
+        fclose(fp);
+    }
+    close(devfd);
+    return errors || crashed;
+}
@@ -0,0 +1,120 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Tearing Down a Container: Object by Object v.s. Ranged Free v.s. Destroy
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// join the container and give it number_of_objects one-page objects, each
+// with its page touched.
+static void fill(int devfd, __u64 number_of_objects)
+{
+    __u64 i;
+    char *mapped_data;
+    double start = now_sec();
+
+    mcontainer_create(devfd, 0);
+    for (i = 0; i < number_of_objects; i++)
+    {
+        mapped_data = (char *)mcontainer_alloc(devfd, i, getpagesize());
+        if (mapped_data == MAP_FAILED)
+        {
+            fprintf(stderr, "Failed in mcontainer_alloc()\n");
+            exit(1);
+        }
+        mapped_data[0] = 1;
+        munmap(mapped_data, getpagesize());
+    }
+    printf("fill                %10.1f ms\n", (now_sec() - start) * 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+    __u64 i, number_of_objects = 1000000;
+    double start;
+    int devfd, freed;
+
+    if (argc > 1)
+    {
+        number_of_objects = strtoull(argv[1], NULL, 0);
+    }
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+
+    // what it takes without either: one free per object, then leave.
+    fill(devfd, number_of_objects);
+    start = now_sec();
+    for (i = 0; i < number_of_objects; i++)
+    {
+        mcontainer_free(devfd, i);
+    }
+    mcontainer_delete(devfd);
+    printf("free each + delete  %10.1f ms\n", (now_sec() - start) * 1e3);
+
+    fill(devfd, number_of_objects);
+    start = now_sec();
+    freed = mcontainer_free_range(devfd, 0, number_of_objects);
+    mcontainer_delete(devfd);
+    printf("free range + delete %10.1f ms\n", (now_sec() - start) * 1e3);
+    if (freed >= 0 && (__u64)freed != number_of_objects)
+    {
+        fprintf(stderr, "free range freed %d objects, not %llu\n", freed, (unsigned long long)number_of_objects);
+    }
+
+    // the pages of the last two go back in the background.
+    fill(devfd, number_of_objects);
+    start = now_sec();
+    if (mcontainer_destroy(devfd) < 0)
+    {
+        perror("mcontainer_destroy");
+        exit(1);
+    }
+    printf("destroy             %10.1f ms\n", (now_sec() - start) * 1e3);
+
+    close(devfd);
+    return freed < 0;
+}
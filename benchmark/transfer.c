@@ -0,0 +1,186 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Moving Objects between Containers: Transfer v.s. Copy
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define SENDER_CID 0
+#define RECEIVER_CID 1
+
+static int devfd;
+static pthread_barrier_t barrier;
+static __u64 object_size;
+static char *bounce;
+static int iterations;
+static volatile int done;
+static double touch_us, copy_in_us;
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// read one byte per page so every page of the object gets faulted in.
+static unsigned long touch(volatile char *data, __u64 size)
+{
+    unsigned long sum = 0;
+    __u64 i;
+    for (i = 0; i < size; i += getpagesize())
+    {
+        sum += data[i];
+    }
+    return sum;
+}
+
+// the receiving task lives in its own container and picks up whatever
+// the sender left for it: oid 0 by transfer, oid 1 through the bounce buffer.
+static void *receiver(void *arg)
+{
+    char *mapped_data;
+    double start;
+
+    (void)arg;
+    mcontainer_create(devfd, RECEIVER_CID);
+    while (1)
+    {
+        pthread_barrier_wait(&barrier);
+        if (done)
+        {
+            break;
+        }
+
+        start = now_us();
+        mapped_data = (char *)mcontainer_alloc(devfd, 0, object_size);
+        touch(mapped_data, object_size);
+        touch_us += now_us() - start;
+        if (mapped_data[0] != 'T')
+        {
+            fprintf(stderr, "Transferred object has a wrong value\n");
+        }
+        munmap(mapped_data, object_size);
+        mcontainer_free(devfd, 0);
+        pthread_barrier_wait(&barrier);
+
+        pthread_barrier_wait(&barrier);
+        start = now_us();
+        mapped_data = (char *)mcontainer_alloc(devfd, 1, object_size);
+        memcpy(mapped_data, bounce, object_size);
+        copy_in_us += now_us() - start;
+        munmap(mapped_data, object_size);
+        mcontainer_free(devfd, 1);
+        pthread_barrier_wait(&barrier);
+    }
+    mcontainer_delete(devfd);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    __u64 min_size = 4096, max_size = 64ULL << 20;
+    double start, transfer_us, copy_out_us;
+    char *mapped_data;
+    pthread_t thread;
+    int i;
+
+    if (argc > 1)
+    {
+        iterations = atoi(argv[1]);
+    }
+    if (iterations <= 0)
+    {
+        iterations = 16;
+    }
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, SENDER_CID);
+    pthread_barrier_init(&barrier, NULL, 2);
+    pthread_create(&thread, NULL, receiver, NULL);
+    bounce = (char *)malloc(max_size);
+
+    printf("%12s %14s %18s %14s\n", "size", "transfer(us)", "transfer+map(us)", "copy(us)");
+    for (object_size = min_size; object_size <= max_size; object_size *= 4)
+    {
+        transfer_us = copy_out_us = touch_us = copy_in_us = 0;
+        for (i = 0; i < iterations; i++)
+        {
+            // zero-copy path: hand the pages over, the receiver maps them.
+            mapped_data = (char *)mcontainer_alloc(devfd, 0, object_size);
+            memset(mapped_data, 'T', object_size);
+            munmap(mapped_data, object_size);
+            start = now_us();
+            if (mcontainer_transfer(devfd, 0, RECEIVER_CID, 0) < 0)
+            {
+                perror("mcontainer_transfer");
+                exit(1);
+            }
+            transfer_us += now_us() - start;
+            pthread_barrier_wait(&barrier);
+            pthread_barrier_wait(&barrier);
+
+            // copy path: out through a user buffer and into a new object.
+            mapped_data = (char *)mcontainer_alloc(devfd, 1, object_size);
+            memset(mapped_data, 'C', object_size);
+            start = now_us();
+            memcpy(bounce, mapped_data, object_size);
+            copy_out_us += now_us() - start;
+            munmap(mapped_data, object_size);
+            mcontainer_free(devfd, 1);
+            pthread_barrier_wait(&barrier);
+            pthread_barrier_wait(&barrier);
+        }
+        printf("%12llu %14.2f %18.2f %14.2f\n", (unsigned long long)object_size,
+               transfer_us / iterations, (transfer_us + touch_us) / iterations,
+               (copy_out_us + copy_in_us) / iterations);
+    }
+
+    done = 1;
+    pthread_barrier_wait(&barrier);
+    pthread_join(thread, NULL);
+    mcontainer_delete(devfd);
+    close(devfd);
+    free(bounce);
+    return 0;
+}
@@ -36,126 +36,401 @@
 #include <mcontainer.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <string.h>
-#include <sys/wait.h>
+#include <pthread.h>
+#include "oplog.h"
 
+// the latest value of an object is kept as a checksum of its contents.
+struct expected
+{
+    __u64 hash;
+    __u32 length, size;
+};
 
-int main(int argc, char *argv[])
+// one log being merged: a read-only mapping and the record at its head.
+// Binary logs carry checksums, text traces the payload itself.
+struct stream
 {
-    int i = 0, j = 0, error = 0;
-    int number_of_objects = 1024, max_size_of_objects = 8192, number_of_containers = 1;
-    int child_pid, cid, stat, devfd;
-    long size;
-    __u64 object_id, current_time;
-    char *data, op, *mapped_data;
-    char ***containers;
-    pid_t *pid;
+    const char *p, *end;
+    int binary;
+    char op;
+    int cid;
+    __u64 time, oid, size, checksum;
+    const char *data;
+    size_t length;
+};
 
-    // takes arguments from command line interface.
-    if (argc < 3)
+static int number_of_objects = 1024, max_size_of_objects = 8192, number_of_containers = 1;
+static int number_of_threads;
+static struct expected *objects;
+static int devfd, errors;
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *skip_blanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+        p++;
+    return p;
+}
+
+static const char *next_token(const char *p, const char *end, const char **token)
+{
+    p = skip_blanks(p, end);
+    *token = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+        p++;
+    return p;
+}
+
+static const char *next_number(const char *p, const char *end, __u64 *value)
+{
+    const char *token;
+    p = next_token(p, end, &token);
+    *value = 0;
+    if (token < p && *token == '-')
+        token++;
+    for (; token < p; token++)
+        *value = *value * 10 + (*token - '0');
+    return p;
+}
+
+// parse the record at the head of s; returns 0 at the end of the log.
+// Text records are S <pid> <cid> <time> <oid> <size> <data>, or D ... for a free.
+static int stream_next(struct stream *s)
+{
+    const char *p, *token;
+    __u64 pid, cid;
+
+    if (s->binary)
     {
-        fprintf(stderr, "Usage: %s number_of_objects max_size_of_objects number_of_containers\n", argv[0]);
-        exit(1);
+        struct oplog_record r;
+        if (s->end - s->p < (long)sizeof(r))
+            return 0;
+        memcpy(&r, s->p, sizeof(r));
+        s->p += sizeof(r);
+        s->op = (char)r.op;
+        s->cid = (int)r.cid;
+        s->time = r.time;
+        s->oid = r.oid;
+        s->size = r.size;
+        s->checksum = r.checksum;
+        s->data = NULL;
+        s->length = r.length;
+        return 1;
     }
 
-    number_of_objects = atoi(argv[1]);
-    max_size_of_objects = atoi(argv[2]);
-    number_of_containers = atoi(argv[3]);
+    p = skip_blanks(s->p, s->end);
+    if (p >= s->end)
+        return 0;
+    s->op = *p++;
+    p = next_number(p, s->end, &pid);
+    p = next_number(p, s->end, &cid);
+    p = next_number(p, s->end, &s->time);
+    p = next_number(p, s->end, &s->oid);
+    p = next_number(p, s->end, &s->size);
+    // the payload is the bulk of the log; find its end with memchr.
+    token = skip_blanks(p, s->end);
+    p = token < s->end ? (const char *)memchr(token, '\n', (size_t)(s->end - token)) : NULL;
+    if (!p)
+        p = s->end;
+    while (p > token && (p[-1] == ' ' || p[-1] == '\t' || p[-1] == '\r'))
+        p--;
+    s->cid = (int)cid;
+    s->data = token;
+    s->length = p - token;
+    s->p = p;
+    return 1;
+}
 
-    pid = (pid_t *) calloc(number_of_containers - 1, sizeof(pid_t));
+static void apply(struct stream *s)
+{
+    struct expected *e;
 
-    // allocate memory spaces
-    data = (char *)malloc(max_size_of_objects * sizeof(char));
-    containers = (char ***)calloc(number_of_containers, sizeof(char **));
+    if (s->cid < 0 || s->cid >= number_of_containers || s->oid >= (__u64)number_of_objects)
+    {
+        fprintf(stderr, "Record for container %d object %llu is out of range\n", s->cid,
+                (unsigned long long)s->oid);
+        return;
+    }
+    e = &objects[(size_t)s->cid * number_of_objects + s->oid];
+    e->size = (__u32)s->size;
+    if (s->op == OPLOG_STORE)
+    {
+        e->hash = s->data ? oplog_checksum(s->data, s->length) : s->checksum;
+        e->length = (__u32)s->length;
+    }
+    else if (s->op == OPLOG_DELETE)
+    {
+        e->hash = oplog_checksum("", 0);
+        e->length = 0;
+    }
+}
 
-    for (i = 0; i < number_of_containers; i++)
+// min-heap of streams on the time of their head record.
+static void heap_sift_down(struct stream **heap, int n, int i)
+{
+    for (;;)
     {
-        containers[i] = (char **)calloc(number_of_objects, sizeof(char *));
-        for (j = 0; j < number_of_objects; j++)
-        {
-            containers[i][j] = (char *)malloc(max_size_of_objects * sizeof(char));
-            memset(containers[i][j], 0, max_size_of_objects);
-        }
+        int smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        struct stream *temp;
+        if (left < n && heap[left]->time < heap[smallest]->time)
+            smallest = left;
+        if (right < n && heap[right]->time < heap[smallest]->time)
+            smallest = right;
+        if (smallest == i)
+            return;
+        temp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = temp;
+        i = smallest;
+    }
+}
+
+// replay the logs, each sorted by time on its own, in global time order.
+static void merge(struct stream *streams, int k)
+{
+    struct stream **heap = (struct stream **)malloc(k * sizeof(struct stream *));
+    int i, n = 0;
+
+    for (i = 0; i < k; i++)
+    {
+        if (stream_next(&streams[i]))
+            heap[n++] = &streams[i];
     }
+    for (i = n / 2 - 1; i >= 0; i--)
+        heap_sift_down(heap, n, i);
+    while (n)
+    {
+        apply(heap[0]);
+        if (!stream_next(heap[0]))
+            heap[0] = heap[--n];
+        heap_sift_down(heap, n, 0);
+    }
+    free(heap);
+}
 
-    // Replay the log to validate the results in containers.
-    while (scanf("%c %d %d %llu %llu %ld %s", &op, &child_pid, &cid, &current_time, &object_id, &size, &data[0]) != EOF)
+static int map_log(const char *path, struct stream *s, size_t *bytes)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        perror(path);
+        return -1;
+    }
+    s->p = s->end = NULL;
+    if (st.st_size)
     {
-        if (op == 'S')
+        s->p = (const char *)mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (s->p == MAP_FAILED)
         {
-            strcpy(containers[cid][(int)object_id], data);
-            memset(data, 0, max_size_of_objects);
+            perror(path);
+            close(fd);
+            return -1;
         }
-        else if (op == 'D')
+        madvise((void *)s->p, st.st_size, MADV_SEQUENTIAL);
+        s->end = s->p + st.st_size;
+    }
+    // benchmark writes binary logs; anything else is taken as a text trace.
+    if (st.st_size >= (off_t)sizeof(struct oplog_header))
+    {
+        struct oplog_header header;
+        memcpy(&header, s->p, sizeof(header));
+        if (header.magic == OPLOG_MAGIC)
         {
-            memset(containers[cid][(int)object_id], 0, max_size_of_objects);
+            if (header.version != OPLOG_VERSION || header.record_size != sizeof(struct oplog_record))
+            {
+                fprintf(stderr, "%s: unsupported log version\n", path);
+                close(fd);
+                return -1;
+            }
+            s->binary = 1;
+            s->p += sizeof(header);
         }
     }
+    *bytes += st.st_size;
+    close(fd);
+    return 0;
+}
 
-    // open the container kernel module to check the results.
-    devfd = open("/dev/mcontainer", O_RDWR);
-    if (devfd < 0)
+// a trace that was already merged and sorted, as test.sh used to pass it.
+static int read_stdin(struct stream *s, size_t *bytes)
+{
+    size_t capacity = 1 << 20, length = 0, n;
+    char *buffer = (char *)malloc(capacity);
+
+    while ((n = fread(buffer + length, 1, capacity - length, stdin)) > 0)
     {
-        fprintf(stderr, "Device open failed");
-        exit(1);
+        length += n;
+        if (length == capacity)
+        {
+            capacity *= 2;
+            buffer = (char *)realloc(buffer, capacity);
+        }
     }
+    s->p = buffer;
+    s->end = buffer + length;
+    *bytes += length;
+    return 0;
+}
 
-    // parent process forks children to validate the results in containers.
-    for (i = 0; i < (number_of_containers - 1) && pid != 0; i++)
+// check every object of the containers c with c % number_of_threads == id.
+static void *verify(void *arg)
+{
+    int id = (int)(long)arg, cid, i, j, n, error;
+    struct memory_container_object_info *infos =
+        (struct memory_container_object_info *)malloc(MCONTAINER_ENUMERATE_MAX * sizeof(*infos));
+    __u64 *sizes = (__u64 *)malloc(number_of_objects * sizeof(__u64)), cursor;
+    char *mapped_data;
+
+    for (cid = id; cid < number_of_containers; cid += number_of_threads)
     {
-        child_pid = fork();
-        if (child_pid == 0)
+        error = 0;
+        mcontainer_create(devfd, cid);
+        // learn which objects exist and their sizes without creating any;
+        // without enumeration every object is mapped, creating the missing.
+        memset(sizes, 0, number_of_objects * sizeof(__u64));
+        cursor = 0;
+        while ((n = mcontainer_enumerate(devfd, &cursor, infos, MCONTAINER_ENUMERATE_MAX)) > 0)
         {
-            break;
+            for (j = 0; j < n; j++)
+            {
+                if (infos[j].oid < (__u64)number_of_objects)
+                {
+                    sizes[infos[j].oid] = infos[j].size;
+                    continue;
+                }
+                fprintf(stderr, "Container %d has an unexpected object %llu\n", cid,
+                        (unsigned long long)infos[j].oid);
+                error++;
+            }
         }
-        else
+        for (i = 0; i < number_of_objects; i++)
         {
-            pid[i] = child_pid;
-        }    
-    }
+            struct expected *e = &objects[(size_t)cid * number_of_objects + i];
+            size_t size = e->size ? e->size : (size_t)max_size_of_objects, length;
 
-    cid = getpid() % number_of_containers;
-    mcontainer_create(devfd, cid);
+            if (n == 0 && sizes[i] == 0)
+            {
+                if (e->length)
+                {
+                    fprintf(stderr, "Container %d Object %d does not exist\n", cid, i);
+                    error++;
+                }
+                continue;
+            }
+            if (n == 0)
+                size = sizes[i];
+            mapped_data = (char *)mcontainer_alloc(devfd, n == 0 ? (__u64)i | MCONTAINER_MAP_EXISTING : (__u64)i, size);
+            if (mapped_data == MAP_FAILED)
+            {
+                fprintf(stderr, "Container %d Object %d could not be mapped\n", cid, i);
+                error++;
+                continue;
+            }
+            length = strnlen(mapped_data, size);
+            if (length != e->length || oplog_checksum(mapped_data, length) != e->hash)
+            {
+                fprintf(stderr, "Container %d Object %d has a wrong value %.*s%s\n", cid, i,
+                        (int)(length < 64 ? length : 64), mapped_data, length < 64 ? "" : "...");
+                error++;
+            }
+            munmap(mapped_data, size);
+        }
+        mcontainer_delete(devfd);
 
-    for (i = 0; i < number_of_objects; i++)
-    {
-        mapped_data = (char *)mcontainer_alloc(devfd, i, max_size_of_objects);
-        if (strcmp(mapped_data, containers[cid][i]) != 0)
+        pthread_mutex_lock(&report_lock);
+        if (error == 0)
         {
-            fprintf(stderr, "Container %d Object %d has a wrong value %s v.s. %s\n", cid, i, mapped_data, containers[cid][i]);
-            error++;
+            fprintf(stderr, "Container %d Pass\n", cid);
         }
+        errors += error;
+        pthread_mutex_unlock(&report_lock);
     }
+    free(infos);
+    free(sizes);
+    return NULL;
+}
 
-    // cleanup
-    if (error == 0)
+int main(int argc, char *argv[])
+{
+    struct stream *streams;
+    pthread_t *threads;
+    size_t bytes = 0, i;
+    double start, merged, verified;
+    int k;
+
+    // takes arguments from command line interface.
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s number_of_objects max_size_of_objects number_of_containers [log ...]\n"
+                        "  Merges the per-task logs given, or reads one sorted text trace from stdin.\n"
+                        "  VALIDATE_THREADS sets how many containers are checked at once.\n", argv[0]);
+        exit(1);
+    }
+
+    number_of_objects = atoi(argv[1]);
+    max_size_of_objects = atoi(argv[2]);
+    number_of_containers = atoi(argv[3]);
+    number_of_threads = getenv("VALIDATE_THREADS") ? atoi(getenv("VALIDATE_THREADS")) :
+                        (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (number_of_threads < 1)
+        number_of_threads = 1;
+
+    objects = (struct expected *)calloc((size_t)number_of_containers * number_of_objects, sizeof(struct expected));
+    for (i = 0; i < (size_t)number_of_containers * number_of_objects; i++)
     {
-        fprintf(stderr, "Container %d Pass\n", cid);
+        objects[i].hash = oplog_checksum("", 0);
     }
 
-    mcontainer_delete(devfd);
-    
-    close(devfd);
-    free(data);
-    for (i = 0; i < number_of_containers; i++)
+    // Replay the logs to learn what the containers should hold.
+    start = now_sec();
+    k = argc > 4 ? argc - 4 : 1;
+    streams = (struct stream *)calloc(k, sizeof(struct stream));
+    for (i = 0; i < (size_t)k; i++)
     {
-        for (j = 0; j < number_of_objects; j++)
-        {
-            free(containers[i][j]);
-        }
-        free(containers[i]);
+        if ((argc > 4 ? map_log(argv[4 + i], &streams[i], &bytes) : read_stdin(&streams[i], &bytes)) < 0)
+            exit(1);
+    }
+    merge(streams, k);
+    merged = now_sec() - start;
+
+    // open the container kernel module to check the results.
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
     }
-    free(containers);
 
-    if (child_pid != 0)
+    start = now_sec();
+    threads = (pthread_t *)calloc(number_of_threads, sizeof(pthread_t));
+    for (i = 0; i < (size_t)number_of_threads; i++)
     {
-        for (i = 0; i < (number_of_containers - 1); i++)
-        {
-            waitpid(pid[i], &stat, 0);  
-        }
+        pthread_create(&threads[i], NULL, verify, (void *)(long)i);
+    }
+    for (i = 0; i < (size_t)number_of_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
     }
+    verified = now_sec() - start;
+    fprintf(stderr, "Replayed %.1f MB from %d log(s) in %.3f s (%.1f MB/s), checked %d container(s) in %.3f s\n",
+            bytes / 1048576.0, k, merged, bytes / 1048576.0 / merged, number_of_containers, verified);
 
-    free(pid);
-    return 0;
+    // cleanup
+    close(devfd);
+    free(threads);
+    free(streams);
+    free(objects);
+    return errors != 0;
 }
@@ -0,0 +1,215 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Many Small Objects: One Mapping Each v.s. One Window for All
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <mcontainer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static int devfd;
+static __u64 number_of_objects = 100000;
+static __u64 *order;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int count_vmas(void)
+{
+    FILE *maps = fopen("/proc/self/maps", "r");
+    int c, lines = 0;
+
+    if (!maps)
+        return -1;
+    while ((c = fgetc(maps)) != EOF)
+        lines += c == '\n';
+    fclose(maps);
+    return lines;
+}
+
+// visit the objects in a random order so neither way gets help from the TLB.
+static void shuffle(__u64 n)
+{
+    __u64 i, j, t, x = 88172645463325252ULL;
+
+    for (i = 0; i < n; i++)
+        order[i] = i;
+    for (i = n - 1; i > 0; i--)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        j = x % (i + 1);
+        t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+}
+
+static void report(const char *name, __u64 n, int vmas, double setup, double first, double steady, int wrong)
+{
+    printf("%-10s %8llu objects %8d VMAs   setup %8.0f ns/object   first touch %8.0f ns/object   "
+           "access %6.1f ns/object\n",
+           name, (unsigned long long)n, vmas, setup * 1e9 / n, first * 1e9 / n, steady * 1e9 / n);
+    if (wrong)
+    {
+        printf("%-10s %d objects held the wrong oid\n", name, wrong);
+    }
+}
+
+static void free_objects(void)
+{
+    __u64 i;
+
+    for (i = 0; i < number_of_objects; i++)
+        mcontainer_free(devfd, i);
+}
+
+static void one_mapping_each(void)
+{
+    __u64 **objects = (__u64 **)calloc(number_of_objects, sizeof(__u64 *));
+    __u64 i, n, sum = 0;
+    double start, setup, first, steady;
+    int vmas, wrong = 0;
+
+    start = now_sec();
+    for (n = 0; n < number_of_objects; n++)
+    {
+        objects[n] = (__u64 *)mcontainer_alloc(devfd, n, getpagesize());
+        if (objects[n] == MAP_FAILED)
+            break;
+    }
+    setup = now_sec() - start;
+    vmas = count_vmas();
+    if (n < number_of_objects)
+    {
+        // most likely vm.max_map_count
+        printf("%-10s only %llu of %llu objects could be mapped\n", "mmap each", (unsigned long long)n,
+               (unsigned long long)number_of_objects);
+    }
+    if (n == 0)
+    {
+        free(objects);
+        return;
+    }
+
+    shuffle(n);
+    start = now_sec();
+    for (i = 0; i < n; i++)
+        objects[order[i]][0] = order[i];
+    first = now_sec() - start;
+    start = now_sec();
+    for (i = 0; i < n; i++)
+        sum += objects[order[i]][0];
+    steady = now_sec() - start;
+    for (i = 0; i < n; i++)
+        wrong += objects[i][0] != i;
+    report("mmap each", n, vmas, setup, first, steady, wrong || sum != n * (n - 1) / 2);
+
+    for (i = 0; i < n; i++)
+        munmap(objects[i], getpagesize());
+    free(objects);
+}
+
+static void window(void)
+{
+    __u64 i, n = number_of_objects, sum = 0;
+    double start, setup, first, steady;
+    int vmas, wrong = 0;
+    char *w;
+
+    start = now_sec();
+    w = (char *)mcontainer_map_window(devfd, 0, n);
+    setup = now_sec() - start;
+    if (w == MAP_FAILED)
+    {
+        printf("%-10s unsupported\n", "window");
+        return;
+    }
+    vmas = count_vmas();
+
+    shuffle(n);
+    start = now_sec();
+    for (i = 0; i < n; i++)
+        *(__u64 *)mcontainer_window_object(w, 0, order[i]) = order[i];
+    first = now_sec() - start;
+    start = now_sec();
+    for (i = 0; i < n; i++)
+        sum += *(__u64 *)mcontainer_window_object(w, 0, order[i]);
+    steady = now_sec() - start;
+    for (i = 0; i < n; i++)
+        wrong += *(__u64 *)mcontainer_window_object(w, 0, i) != i;
+    report("window", n, vmas, setup, first, steady, wrong || sum != n * (n - 1) / 2);
+
+    munmap(w, n * getpagesize());
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+    {
+        number_of_objects = strtoull(argv[1], NULL, 0);
+    }
+    if (number_of_objects == 0)
+    {
+        fprintf(stderr, "need at least one object\n");
+        exit(1);
+    }
+    order = (__u64 *)malloc(number_of_objects * sizeof(__u64));
+
+    devfd = mcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed");
+        exit(1);
+    }
+    mcontainer_create(devfd, 0);
+    printf("%d VMAs before mapping any object\n", count_vmas());
+
+    free_objects();
+    one_mapping_each();
+    free_objects();
+    window();
+    free_objects();
+
+    mcontainer_delete(devfd);
+    close(devfd);
+    free(order);
+    return 0;
+}
@@ -41,10 +41,242 @@ struct memory_container_cmd
     __u64 oid;
 };
 
+//Per-container statistics of the memory pressure shrinker
+struct memory_container_reclaim_stats
+{
+    __u64 resident_pages;
+    __u64 compressed_pages;
+    __u64 compressed_bytes;
+    __u64 compressions;
+    __u64 decompressions;
+    __u64 decompress_ns;
+    __u64 decompress_max_ns;
+};
+
+//Container image written by MCONTAINER_IOCTL_SAVE: this header, one entry
+//per object, then the objects' pages starting at a page boundary. Pages
+//that were never touched are left as holes, but the file always reaches
+//the end of the last object.
+#define MCONTAINER_IMAGE_MAGIC 0x474d49524e544e4dULL
+#define MCONTAINER_IMAGE_VERSION 1
+
+struct memory_container_image_header
+{
+    __u64 magic;
+    __u64 version;
+    __u64 page_size;
+    __u64 cid;
+    __u64 nr_objects;
+};
+
+struct memory_container_image_entry
+{
+    __u64 oid;
+    __u64 nr_pages;
+    __u64 offset;
+};
+
+//Objects below MCONTAINER_META_SLOTS have a slot in the read-only metadata
+//pages a task can map at MCONTAINER_META_OID of its container.
+//Offsets from MCONTAINER_RESERVED_OID up are not objects.
+#define MCONTAINER_RESERVED_OID (1ULL << 40)
+#define MCONTAINER_META_OID MCONTAINER_RESERVED_OID
+#define MCONTAINER_META_PAGES 16
+
+//Or'ed into the oid given to mmap, maps the object only if it exists
+//instead of creating it, failing with ENOENT
+#define MCONTAINER_MAP_EXISTING (1ULL << 48)
+
+struct memory_container_meta
+{
+    //Moves up every time the object is unlocked, never back to a value an
+    //earlier object with this oid had; 0 if there is no object
+    __u64 generation;
+    //Bumped when the object is locked and again when it is unlocked, so it
+    //is odd while a writer holds the lock. Readers copy the object without
+    //locking it and retry if seq was odd or changed under them.
+    __u64 seq;
+    //MCONTAINER_META_* flags of the object
+    __u64 flags;
+    __u64 reserved;
+};
+
+//The object is read-only for good and cannot be locked
+#define MCONTAINER_META_SEALED 0x1
+
+#define MCONTAINER_META_SLOTS (MCONTAINER_META_PAGES * 4096 / sizeof(struct memory_container_meta))
+
+//A window maps every object of a container at once: object oid shows up
+//(oid << size_class) pages into the window mapped at offset
+//MCONTAINER_WINDOW_OID(size_class) pages, which shows its first
+//1 << size_class pages. Touching an object that does not exist through a
+//window creates it with that many pages.
+#define MCONTAINER_WINDOW_SPAN (1ULL << 40)
+#define MCONTAINER_WINDOW_OID(size_class) (MCONTAINER_RESERVED_OID + MCONTAINER_WINDOW_SPAN * (1 + (size_class)))
+#define MCONTAINER_WINDOW_MAX_CLASS 10
+
+//What read() on the device returns for a watched object that changed
+struct memory_container_event
+{
+    __u64 oid;
+    __u64 generation;
+};
+
+//Several object locks taken or released in one call. oids points to nr
+//object ids; all of them are acquired together or none is.
+struct memory_container_lock_many
+{
+    __u64 oids;
+    __u32 nr;
+    __u32 flags;
+};
+
+#define MCONTAINER_LOCK_MANY_MAX 64
+
+//Fail with EBUSY instead of waiting if any of the locks is held
+#define MCONTAINER_LOCK_TRY 0x1
+
+//A barrier or condition variable of the caller's container, named by id.
+//MCONTAINER_IOCTL_BARRIER waits until count tasks have reached barrier id.
+//MCONTAINER_IOCTL_COND_WAIT releases the lock of object oid, which the
+//caller holds, waits for a signal on id and takes the lock again.
+struct memory_container_sync
+{
+    __u64 id;
+    __u64 oid;
+    __u32 count;
+    __u32 flags;
+};
+
+//Wake every task waiting on the condition variable, not just one
+#define MCONTAINER_COND_BROADCAST 0x1
+
+//The size of an object, as MCONTAINER_IOCTL_SIZE reports it and
+//MCONTAINER_IOCTL_RESIZE takes it in size. Objects come in size classes of
+//a power of two pages, so most resizes do not move anything.
+struct memory_container_size
+{
+    __u64 oid;
+    __u64 size;
+    __u64 nr_pages;
+    __u64 size_class;
+};
+
+//One object as MCONTAINER_IOCTL_ENUMERATE reports it
+struct memory_container_object_info
+{
+    __u64 oid;
+    __u64 size;
+    __u64 resident_pages;
+    //The task holding its lock, 0 if nobody does
+    __s32 lock_holder;
+    //MCONTAINER_META_* flags of the object
+    __u32 flags;
+};
+
+//A batch of the objects of a container in oid order. objects points to
+//room for nr records, which are filled for the objects from oid cursor on;
+//the ioctl returns how many and moves cursor past the last, so calling it
+//until it returns 0 walks the whole container.
+struct memory_container_enumerate
+{
+    __u64 cursor;
+    __u64 objects;
+    __u32 nr;
+    __u32 flags;
+};
+
+#define MCONTAINER_ENUMERATE_MAX 1024
+
+//Per-container statistics of the page deduplication scanner. Pages saved
+//are merges less the copies writes have made of merged pages since.
+struct memory_container_dedup_stats
+{
+    __u64 scanned_pages;
+    __u64 merges;
+    __u64 unmerges;
+    __u64 saved_pages;
+    __u64 passes;
+};
+
+//Module-wide event counters reported by MCONTAINER_IOCTL_STATS, indexes
+//into memory_container_stats.count. Everything counts from module load.
+enum
+{
+    MCONTAINER_STAT_CREATE,
+    MCONTAINER_STAT_DELETE,
+    MCONTAINER_STAT_MMAP,
+    MCONTAINER_STAT_FREE,
+    //Objects locked and unlocked, one per object of a *_MANY call
+    MCONTAINER_STAT_LOCK,
+    MCONTAINER_STAT_UNLOCK,
+    //Lock attempts that found an object locked by someone else
+    MCONTAINER_STAT_LOCK_CONTENDED,
+    MCONTAINER_STAT_TRANSFER,
+    MCONTAINER_STAT_RESIZE,
+    //Every other ioctl
+    MCONTAINER_STAT_OTHER,
+    MCONTAINER_STAT_FAULT,
+    MCONTAINER_STAT_PAGE_ALLOC,
+    MCONTAINER_STAT_PAGE_FREE,
+    MCONTAINER_STAT_OBJECT_ALLOC,
+    MCONTAINER_STAT_OBJECT_FREE,
+    //First touches served by the pool of zeroed pages, and ones that were not
+    MCONTAINER_STAT_POOL_HIT,
+    MCONTAINER_STAT_POOL_MISS,
+    MCONTAINER_STAT_NR
+};
+
+//Room for counters added later without changing the ioctl
+#define MCONTAINER_STAT_MAX 32
+
+struct memory_container_stats
+{
+    __u64 count[MCONTAINER_STAT_MAX];
+};
+
 #define MCONTAINER_IOCTL_DELETE _IOWR('N', 0x45, struct memory_container_cmd)
 #define MCONTAINER_IOCTL_CREATE _IOWR('N', 0x46, struct memory_container_cmd)
 #define MCONTAINER_IOCTL_LOCK _IOWR('N', 0x47, struct memory_container_cmd)
 #define MCONTAINER_IOCTL_UNLOCK _IOWR('N', 0x48, struct memory_container_cmd)
 #define MCONTAINER_IOCTL_FREE _IOWR('N', 0x49, struct memory_container_cmd)
+//op != 0 lets the shrinker compress idle objects of the caller's container
+#define MCONTAINER_IOCTL_RECLAIM _IOWR('N', 0x4a, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_RECLAIM_STATS _IOWR('N', 0x4b, struct memory_container_reclaim_stats)
+//Hands object oid over to container cid, op takes MCONTAINER_TRANSFER_* flags
+#define MCONTAINER_IOCTL_TRANSFER _IOWR('N', 0x4c, struct memory_container_cmd)
+
+//Returns a read-only file descriptor onto object oid for read()/sendfile()/splice()
+#define MCONTAINER_IOCTL_EXPORT _IOWR('N', 0x4d, struct memory_container_cmd)
+
+//Save the caller's container to, or restore it from, the file descriptor in op
+#define MCONTAINER_IOCTL_SAVE _IOWR('N', 0x4e, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_RESTORE _IOWR('N', 0x4f, struct memory_container_cmd)
+
+//Start (op != 0) or stop (op == 0) watching object oid through this file
+#define MCONTAINER_IOCTL_WATCH _IOWR('N', 0x50, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_LOCK_MANY _IOWR('N', 0x51, struct memory_container_lock_many)
+#define MCONTAINER_IOCTL_UNLOCK_MANY _IOWR('N', 0x52, struct memory_container_lock_many)
+#define MCONTAINER_IOCTL_SIZE _IOWR('N', 0x53, struct memory_container_size)
+//Grow or shrink an object in place; its pages are kept up to the new size
+#define MCONTAINER_IOCTL_RESIZE _IOWR('N', 0x54, struct memory_container_size)
+#define MCONTAINER_IOCTL_STATS _IOWR('N', 0x55, struct memory_container_stats)
+//Make object oid read-only for every task from now on
+#define MCONTAINER_IOCTL_SEAL _IOWR('N', 0x56, struct memory_container_cmd)
+//Free the caller's container with all of its objects; no task is in it after
+#define MCONTAINER_IOCTL_DESTROY _IOWR('N', 0x57, struct memory_container_cmd)
+//Free the objects from oid to oid + op - 1 that exist, returning how many
+#define MCONTAINER_IOCTL_FREE_RANGE _IOWR('N', 0x58, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_ENUMERATE _IOWR('N', 0x59, struct memory_container_enumerate)
+//op != 0 lets the scanner merge identical pages of the caller's container
+#define MCONTAINER_IOCTL_DEDUP _IOWR('N', 0x5a, struct memory_container_cmd)
+#define MCONTAINER_IOCTL_DEDUP_STATS _IOWR('N', 0x5b, struct memory_container_dedup_stats)
+//Returns 1 to the task that completes the barrier and 0 to the others
+#define MCONTAINER_IOCTL_BARRIER _IOWR('N', 0x5c, struct memory_container_sync)
+#define MCONTAINER_IOCTL_COND_WAIT _IOWR('N', 0x5d, struct memory_container_sync)
+#define MCONTAINER_IOCTL_COND_SIGNAL _IOWR('N', 0x5e, struct memory_container_sync)
+
+//Keep a read-only copy-on-write alias of a transferred object behind
+#define MCONTAINER_TRANSFER_ALIAS 0x1
 
 #endif
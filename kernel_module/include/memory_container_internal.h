@@ -0,0 +1,315 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Data Structures Shared by the Kernel Module Sources
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef MEMORY_CONTAINER_INTERNAL_H
+#define MEMORY_CONTAINER_INTERNAL_H
+
+#include "memory_container.h"
+
+#include <linux/types.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/kref.h>
+#include <linux/atomic.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/percpu.h>
+#include <linux/radix-tree.h>
+#include <linux/workqueue.h>
+
+//Memory that makes up a container's objects is charged to the memory
+//cgroup of the task whose fault or call allocates it, on kernels that can.
+//Pages from the zeroed pool are not, once pool_memcg_bypass is turned off.
+#ifdef __GFP_ACCOUNT
+#define GFP_MCONTAINER (GFP_KERNEL | __GFP_ACCOUNT)
+#else
+#define GFP_MCONTAINER GFP_KERNEL
+#endif
+
+//Declaring a list to store task ids
+struct task{
+    struct task_struct* currTask;
+    struct task *next;
+};
+
+//A page the shrinker has compressed out of an object
+struct object_zpage{
+    void *data;
+    unsigned int len;
+};
+
+//Objects are backed by individual pages that are faulted into user space
+//on demand, so the shrinker can take them away and give them back later.
+//Pages marked in cow may be shared with another object and are copied
+//before this object writes to them. Restored objects read the first
+//backing_pages pages from their image instead of starting them zeroed.
+//readonly objects, aliases and sealed objects, never change again.
+//The per-page arrays have room for the whole size class, 1 << size_class
+//pages, so an object can grow within its class without reallocating them.
+//page_lock protects size, nr_pages, size_class, pages, zpages, cow,
+//backing_pages, readonly and dead.
+struct object{
+    unsigned long long int oid;
+    __u64 size;
+    unsigned long nr_pages;
+    unsigned int size_class;
+    struct page **pages;
+    struct object_zpage *zpages;
+    unsigned long *cow;
+    struct file *backing;
+    loff_t backing_offset;
+    unsigned long backing_pages;
+    unsigned long last_access;
+    __u64 generation;
+    int readonly;
+    int dead;
+    struct mutex page_lock;
+    struct kref refcount;
+    struct container *container;
+    struct object *prev;
+    struct object *next;
+};
+
+static inline unsigned long object_capacity(struct object *obj)
+{
+    return 1UL << obj->size_class;
+}
+
+//A task waiting for an object lock, on its own stack
+struct lock_waiter{
+    int prio;
+    struct lock_waiter *next;
+};
+
+//The lock of one object, held by the task with pid holder (0 if free).
+//Entries only exist while the lock is held or waited for. Waiters sleep
+//until wakeups moves on; waiter_list has them most urgent first.
+struct object_lock{
+    unsigned long long int oid;
+    pid_t holder;
+    int waiters;
+    unsigned int wakeups;
+    struct lock_waiter *waiter_list;
+    wait_queue_head_t wait;
+    struct object_lock *next;
+};
+
+#define OBJECT_LOCK_BUCKETS 64
+
+#define SYNC_BARRIER 0
+#define SYNC_COND 1
+
+//A barrier or condition variable, only there while somebody waits on it.
+//A barrier wakes everyone by moving seq on once arrived reaches count. A
+//signal moves seq on and adds a token, which one task that was waiting
+//before it takes.
+struct container_sync{
+    unsigned long long int id;
+    int type;
+    unsigned int waiters;
+    unsigned int arrived;
+    unsigned int count;
+    unsigned int tokens;
+    unsigned int seq;
+    wait_queue_head_t wait;
+    struct container_sync *next;
+};
+
+//Container flags
+#define CONTAINER_RECLAIM 0x1
+//Destroyed: off the list of containers, its objects on their way out
+#define CONTAINER_DEAD 0x2
+//Identical pages of different objects get merged by the dedup scanner
+#define CONTAINER_DEDUP 0x4
+
+//Declaring a list to store container ids and a pointer to associated task ids
+struct container {
+    unsigned long long int cid;
+    struct task *task_list;
+    //Objects, and the same objects indexed on oid; both under my_mutex
+    struct object *object_list;
+    struct radix_tree_root object_tree;
+    //Object locks, hashed on oid; lock_table_lock protects the table
+    struct mutex lock_table_lock;
+    struct object_lock *lock_table[OBJECT_LOCK_BUCKETS];
+    //Barriers and condition variables, under lock_table_lock as well
+    struct container_sync *sync_table[OBJECT_LOCK_BUCKETS];
+    unsigned long flags;
+    //Reclaim statistics, reported by MCONTAINER_IOCTL_RECLAIM_STATS
+    atomic64_t resident_pages;
+    atomic64_t compressed_pages;
+    atomic64_t compressed_bytes;
+    atomic64_t compressions;
+    atomic64_t decompressions;
+    atomic64_t decompress_ns;
+    atomic64_t decompress_max_ns;
+    //Dedup statistics, reported by MCONTAINER_IOCTL_DEDUP_STATS
+    atomic64_t dedup_scanned;
+    atomic64_t dedup_merges;
+    atomic64_t dedup_unmerges;
+    atomic64_t dedup_passes;
+    //Change notification: metadata pages once mapped, and a wait queue
+    //woken with generation_changes bumped whenever an object changes
+    struct page **meta_pages;
+    wait_queue_head_t generation_wait;
+    atomic64_t generation_changes;
+    //Last generation given to any of its objects, so a freed and recreated
+    //oid never repeats one a watcher has already seen
+    atomic64_t generation_counter;
+    //Held by the list of containers, its objects, mappings and watchers
+    struct kref refcount;
+    struct work_struct destroy_work;
+    struct container *next;
+};
+
+extern struct container *container_head;
+extern struct mutex my_mutex;
+
+//Event counters, per CPU so that counting never bounces a cache line
+struct mcontainer_stat_cpu{
+    unsigned long count[MCONTAINER_STAT_NR];
+};
+
+DECLARE_PER_CPU(struct mcontainer_stat_cpu, mcontainer_stat_cpu);
+extern bool mcontainer_stats_enabled;
+
+static inline void mcontainer_stat_add(int item, unsigned long n)
+{
+    if (mcontainer_stats_enabled)
+        this_cpu_add(mcontainer_stat_cpu.count[item], n);
+}
+
+static inline void mcontainer_stat_inc(int item)
+{
+    mcontainer_stat_add(item, 1);
+}
+
+//ioctl.c
+struct container * findcontainer(int pid);
+void * object_array_alloc(unsigned long n, size_t size);
+struct object * addobject(struct object **head, struct container *owner, unsigned long long int oid, unsigned long nr_pages);
+struct object * findobject(struct container *owner, unsigned long long int oid);
+void unlinkobject(struct container *owner, struct object *obj);
+void deleteobject(struct container *owner, unsigned long long int oid);
+void killobject(struct object *obj);
+struct container * deletecontainer(struct container **head, unsigned long long int cid);
+void container_get(struct container *owner);
+void container_put(struct container *owner);
+void object_get(struct object *obj);
+void object_put(struct object *obj);
+void object_zap(struct object *obj);
+void object_zap_range(struct object *obj, unsigned long first, unsigned long nr);
+int object_populate_page(struct object *obj, unsigned long index);
+int object_fault(struct object *obj, unsigned long index, struct vm_fault *vmf);
+int object_page_mkwrite(struct object *obj, unsigned long index, struct vm_fault *vmf);
+int memory_container_seal(const struct memory_container_cmd *cmd);
+
+//lock.c
+int object_lock_held(struct container *owner, unsigned long long int oid);
+int memory_container_lock(const struct memory_container_cmd *cmd);
+int memory_container_unlock(const struct memory_container_cmd *cmd);
+int memory_container_lock_many(struct memory_container_lock_many __user *user_req);
+int memory_container_unlock_many(struct memory_container_lock_many __user *user_req);
+pid_t object_lock_holder(struct container *owner, unsigned long long int oid);
+void lock_release_all(struct container *owner);
+int object_lock(struct container *owner, unsigned long long int oid);
+int object_unlock_held(struct container *owner, unsigned long long int oid);
+void lock_notify(struct container *owner, unsigned long long int *oids, int nr);
+
+//sync.c
+void sync_release_all(struct container *owner);
+void sync_free_all(struct container *owner);
+int memory_container_barrier(struct memory_container_sync __user *user_sync);
+int memory_container_cond_wait(struct memory_container_sync __user *user_sync);
+int memory_container_cond_signal(struct memory_container_sync __user *user_sync);
+
+//destroy.c
+int memory_container_destroy_init(void);
+void memory_container_destroy_exit(void);
+int memory_container_destroy(const struct memory_container_cmd *cmd);
+int memory_container_free_range(const struct memory_container_cmd *cmd);
+
+//enumerate.c
+int memory_container_enumerate(struct memory_container_enumerate __user *user_enum);
+
+//dedup.c
+int memory_container_dedup_init(void);
+void memory_container_dedup_exit(void);
+int memory_container_dedup(const struct memory_container_cmd *cmd);
+int memory_container_dedup_stats(struct memory_container_dedup_stats __user *user_stats);
+
+//window.c
+int window_mmap(struct container *owner, struct vm_area_struct *vma);
+void window_zap(struct address_space *mapping, struct object *obj, unsigned long first, unsigned long nr);
+
+//size.c
+unsigned int object_size_class(unsigned long nr_pages);
+int memory_container_size(struct memory_container_size __user *user_size);
+int memory_container_resize(struct memory_container_size __user *user_size);
+
+//stats.c
+int memory_container_stats(struct memory_container_stats __user *user_stats);
+
+//pool.c
+int memory_container_pool_init(void);
+void memory_container_pool_exit(void);
+struct page * pool_get_page(void);
+
+//reclaim.c
+int memory_container_reclaim_init(void);
+void memory_container_reclaim_exit(void);
+int reclaim_copy_zpage(struct object_zpage *zpage, void *buf);
+int reclaim_decompress_page(struct object *obj, unsigned long index);
+void reclaim_free_zpages(struct object *obj);
+int memory_container_reclaim(const struct memory_container_cmd *cmd);
+int memory_container_reclaim_stats(struct memory_container_reclaim_stats __user *user_stats);
+
+//export.c
+int memory_container_export(const struct memory_container_cmd *cmd);
+
+//notify.c
+void notify_object_changed(struct container *owner, unsigned long long int oid, struct object *obj);
+void notify_object_seq(struct container *owner, unsigned long long int oid);
+int notify_mmap_meta(struct container *owner, struct vm_area_struct *vma);
+void notify_free_meta(struct container *owner);
+int memory_container_open(struct inode *inode, struct file *filp);
+int memory_container_release(struct inode *inode, struct file *filp);
+unsigned int memory_container_poll(struct file *filp, poll_table *wait);
+ssize_t memory_container_read(struct file *filp, char __user *buf, size_t len, loff_t *ppos);
+int memory_container_watch(struct file *filp, const struct memory_container_cmd *cmd);
+
+//persist.c
+int persist_load_page(struct object *obj, unsigned long index);
+int memory_container_save(const struct memory_container_cmd *cmd);
+int memory_container_restore(const struct memory_container_cmd *cmd);
+
+#endif
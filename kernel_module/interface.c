@@ -43,10 +43,12 @@
 #include <linux/poll.h>
 #include <linux/mutex.h>
 
-extern long memory_container_lock(struct memory_container_cmd __user *user_cmd);
-extern long memory_container_unlock(struct memory_container_cmd __user *user_cmd);
 extern long memory_container_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
 extern int memory_container_mmap(struct file *filp, struct vm_area_struct *vma);
+extern int memory_container_open(struct inode *inode, struct file *filp);
+extern int memory_container_release(struct inode *inode, struct file *filp);
+extern unsigned int memory_container_poll(struct file *filp, poll_table *wait);
+extern ssize_t memory_container_read(struct file *filp, char __user *buf, size_t len, loff_t *ppos);
 extern int memory_container_init(void);
 extern void memory_container_exit(void);
 
@@ -54,6 +56,10 @@ static const struct file_operations memory_container_fops = {
     .owner                = THIS_MODULE,
     .unlocked_ioctl       = memory_container_ioctl,
     .mmap                 = memory_container_mmap,
+    .open                 = memory_container_open,
+    .release              = memory_container_release,
+    .poll                 = memory_container_poll,
+    .read                 = memory_container_read,
 };
 
 struct miscdevice memory_container_dev = {
@@ -29,7 +29,7 @@
 //
 ////////////////////////////////////////////////////////////////////////
 
-#include "memory_container.h"
+#include "memory_container_internal.h"
 
 #include <asm/uaccess.h>
 #include <linux/slab.h>
@@ -57,6 +57,40 @@ int memory_container_init(void)
         return ret;
     }
 
+    if ((ret = memory_container_reclaim_init()))
+    {
+        printk(KERN_ERR "Unable to register \"memory_container\" shrinker\n");
+        misc_deregister(&memory_container_dev);
+        return ret;
+    }
+
+    if ((ret = memory_container_pool_init()))
+    {
+        printk(KERN_ERR "Unable to start \"memory_container\" page pool\n");
+        memory_container_reclaim_exit();
+        misc_deregister(&memory_container_dev);
+        return ret;
+    }
+
+    if ((ret = memory_container_destroy_init()))
+    {
+        printk(KERN_ERR "Unable to start \"memory_container\" destroy workqueue\n");
+        memory_container_pool_exit();
+        memory_container_reclaim_exit();
+        misc_deregister(&memory_container_dev);
+        return ret;
+    }
+
+    if ((ret = memory_container_dedup_init()))
+    {
+        printk(KERN_ERR "Unable to start \"memory_container\" dedup thread\n");
+        memory_container_destroy_exit();
+        memory_container_pool_exit();
+        memory_container_reclaim_exit();
+        misc_deregister(&memory_container_dev);
+        return ret;
+    }
+
     printk(KERN_ERR "\"memory_container\" misc device installed\n");
     printk(KERN_ERR "\"memory_container\" version 0.1\n");
     return ret;
@@ -66,4 +100,8 @@ int memory_container_init(void)
 void memory_container_exit(void)
 {
     misc_deregister(&memory_container_dev);
+    memory_container_dedup_exit();
+    memory_container_destroy_exit();
+    memory_container_pool_exit();
+    memory_container_reclaim_exit();
 }
@@ -0,0 +1,429 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Merging Identical Pages Across the Objects of a Container
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "memory_container_internal.h"
+
+#include <asm/uaccess.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include <linux/jhash.h>
+#include <linux/hash.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+
+//The scanner hashes dedup_pages_to_scan pages, then sleeps dedup_sleep_ms
+static unsigned int dedup_pages_to_scan = 1024;
+module_param(dedup_pages_to_scan, uint, 0644);
+MODULE_PARM_DESC(dedup_pages_to_scan, "Pages the dedup scanner looks at before it sleeps");
+
+static unsigned int dedup_sleep_ms = 20;
+module_param(dedup_sleep_ms, uint, 0644);
+MODULE_PARM_DESC(dedup_sleep_ms, "Milliseconds the dedup scanner sleeps between batches");
+
+//Bounds the memory a pass takes: 24 bytes and a bucket per page remembered
+static unsigned long dedup_max_pages = 1UL << 20;
+module_param(dedup_max_pages, ulong, 0644);
+MODULE_PARM_DESC(dedup_max_pages, "Most pages of one container the dedup scanner remembers in a pass");
+
+//Objects pinned at a time while walking a container
+#define DEDUP_BATCH_OBJECTS 16
+
+//A page seen earlier in the pass. Entries name the page by object and
+//index instead of pinning it, so they may be stale by the time they match.
+struct dedup_entry{
+    unsigned long long int oid;
+    unsigned long index;
+    u32 hash;
+    //Entry number of the next one in the bucket, 0 ends the chain
+    u32 next;
+};
+
+struct dedup_table{
+    u32 *buckets;
+    struct dedup_entry *entries;
+    unsigned long nr;
+    unsigned long max;
+    unsigned int bits;
+};
+
+static struct task_struct *dedup_thread;
+static DECLARE_WAIT_QUEUE_HEAD(dedup_wait);
+static bool dedup_kick;
+static unsigned int dedup_budget;
+
+
+static u32 dedup_hash(struct page *page)
+{
+    return jhash2(page_address(page), PAGE_SIZE / sizeof(u32), 0);
+}
+
+
+//Make page index of obj safe to share: mark it copy-on-write and drop the
+//mappings that could still write to it. Returns the page with a reference
+//held, or NULL if there is none. *marked says whether we set the bit.
+static struct page * dedup_protect(struct object *obj, unsigned long index, int *marked)
+{
+    struct page *page = NULL;
+
+    *marked = 0;
+    mutex_lock(&obj->page_lock);
+    if (obj->dead || index >= obj->nr_pages || !obj->pages[index])
+        goto out;
+    if (!obj->cow)
+        obj->cow = object_array_alloc(BITS_TO_LONGS(object_capacity(obj)), sizeof(unsigned long));
+    if (!obj->cow)
+        goto out;
+    page = obj->pages[index];
+    if (!test_and_set_bit(index, obj->cow))
+    {
+        object_zap_range(obj, index, 1);
+        *marked = 1;
+    }
+    get_page(page);
+out:
+    mutex_unlock(&obj->page_lock);
+    return page;
+}
+
+
+//Back out of dedup_protect when nothing got merged. The bit stays if
+//anyone else started sharing the page meanwhile.
+static void dedup_unprotect(struct object *obj, unsigned long index, struct page *page, int marked)
+{
+    if (marked)
+    {
+        mutex_lock(&obj->page_lock);
+        if (index < obj->nr_pages && obj->pages[index] == page && page_count(page) == 2)
+            clear_bit(index, obj->cow);
+        mutex_unlock(&obj->page_lock);
+    }
+    put_page(page);
+}
+
+
+//Point page index of obj at shared, a protected page holding the same
+//data, and let its own page go. Returns 1 if the two are one page now.
+static int dedup_replace(struct object *obj, unsigned long index, struct page *page, struct page *shared)
+{
+    int ret = 0;
+
+    mutex_lock(&obj->page_lock);
+    if (obj->dead || index >= obj->nr_pages)
+        goto out;
+    //Merged already, or changed since we hashed it
+    if (obj->pages[index] != page)
+    {
+        ret = obj->pages[index] == shared;
+        goto out;
+    }
+    if (memcmp(page_address(shared), page_address(page), PAGE_SIZE))
+        goto out;
+    if (!obj->cow)
+        obj->cow = object_array_alloc(BITS_TO_LONGS(object_capacity(obj)), sizeof(unsigned long));
+    if (!obj->cow)
+        goto out;
+    //Nobody may write to the page while we look at it for the last time
+    object_zap_range(obj, index, 1);
+    if (memcmp(page_address(shared), page_address(page), PAGE_SIZE))
+        goto out;
+    obj->pages[index] = shared;
+    set_bit(index, obj->cow);
+    put_page(page);
+    mcontainer_stat_inc(MCONTAINER_STAT_PAGE_FREE);
+    atomic64_inc(&obj->container->dedup_merges);
+    ret = 2;
+out:
+    mutex_unlock(&obj->page_lock);
+    return ret;
+}
+
+
+//Merge page index of obj into the page entry remembers, if they still
+//hold the same data. Returns nonzero if obj uses that page now.
+static int dedup_merge(struct container *owner, struct dedup_entry *entry, struct object *obj,
+                       unsigned long index, struct page *page)
+{
+    struct object *other;
+    struct page *shared;
+    int marked, ret;
+
+    mutex_lock(&my_mutex);
+    other = findobject(owner, entry->oid);
+    if (other)
+        object_get(other);
+    mutex_unlock(&my_mutex);
+    if (!other)
+        return 0;
+
+    shared = dedup_protect(other, entry->index, &marked);
+    ret = 0;
+    if (shared && shared != page)
+        ret = dedup_replace(obj, index, page, shared);
+    //A successful replace handed our reference on to obj
+    if (shared && ret != 2)
+        dedup_unprotect(other, entry->index, shared, marked);
+    object_put(other);
+    return ret || shared == page;
+}
+
+
+//Sleep between batches; returns nonzero if the scanner should stop
+static int dedup_throttle(void)
+{
+    if (++dedup_budget >= READ_ONCE(dedup_pages_to_scan))
+    {
+        dedup_budget = 0;
+        schedule_timeout_interruptible(msecs_to_jiffies(READ_ONCE(dedup_sleep_ms)));
+    }
+    cond_resched();
+    return kthread_should_stop();
+}
+
+
+static int dedup_scan_object(struct container *owner, struct dedup_table *table, struct object *obj)
+{
+    struct dedup_entry *entry;
+    struct page *page;
+    unsigned long index;
+    u32 hash = 0, *bucket, i;
+
+    for (index = 0; ; index++)
+    {
+        mutex_lock(&obj->page_lock);
+        if (obj->dead || index >= obj->nr_pages)
+        {
+            mutex_unlock(&obj->page_lock);
+            return 0;
+        }
+        page = obj->pages[index];
+        if (page)
+            hash = dedup_hash(page);
+        mutex_unlock(&obj->page_lock);
+        if (!page)
+            continue;
+        atomic64_inc(&owner->dedup_scanned);
+
+        bucket = &table->buckets[hash_32(hash, table->bits)];
+        for (i = *bucket; i; i = entry->next)
+        {
+            entry = &table->entries[i - 1];
+            if (entry->hash == hash && dedup_merge(owner, entry, obj, index, page))
+                break;
+        }
+        //Nothing to merge with, so the page is worth remembering
+        if (!i && table->nr < table->max)
+        {
+            entry = &table->entries[table->nr++];
+            entry->oid = obj->oid;
+            entry->index = index;
+            entry->hash = hash;
+            entry->next = *bucket;
+            *bucket = table->nr;
+        }
+        if (dedup_throttle())
+            return -EINTR;
+    }
+}
+
+
+//One pass over every object of a container, in oid order
+static void dedup_scan_container(struct container *owner)
+{
+    struct object *batch[DEDUP_BATCH_OBJECTS];
+    struct dedup_table table;
+    unsigned long long int cursor = 0;
+    unsigned int i, n;
+    int ret = 0;
+
+    table.max = min3((unsigned long)atomic64_read(&owner->resident_pages), READ_ONCE(dedup_max_pages),
+                     (unsigned long)U32_MAX);
+    if (table.max < 2)
+        return;
+    table.bits = ilog2(roundup_pow_of_two(table.max));
+    table.nr = 0;
+    table.buckets = vzalloc(sizeof(u32) << table.bits);
+    table.entries = vmalloc(table.max * sizeof(struct dedup_entry));
+    if (!table.buckets || !table.entries)
+        goto out;
+
+    while (!ret)
+    {
+        mutex_lock(&my_mutex);
+        n = 0;
+        if ((owner->flags & (CONTAINER_DEDUP | CONTAINER_DEAD)) == CONTAINER_DEDUP)
+            n = radix_tree_gang_lookup(&owner->object_tree, (void **)batch, cursor, DEDUP_BATCH_OBJECTS);
+        for (i = 0; i < n; i++)
+            object_get(batch[i]);
+        mutex_unlock(&my_mutex);
+        if (!n)
+            break;
+        cursor = batch[n - 1]->oid + 1;
+        for (i = 0; i < n; i++)
+        {
+            if (!ret)
+                ret = dedup_scan_object(owner, &table, batch[i]);
+            object_put(batch[i]);
+        }
+    }
+    if (!ret)
+        atomic64_inc(&owner->dedup_passes);
+out:
+    vfree(table.buckets);
+    vfree(table.entries);
+}
+
+
+//The opted-in container after cid, wrapping around, with a reference held
+static struct container * dedup_next_container(unsigned long long int *cid)
+{
+    struct container *temp_container, *next = NULL, *first = NULL;
+
+    mutex_lock(&my_mutex);
+    for (temp_container = container_head; temp_container; temp_container = temp_container->next)
+    {
+        if ((temp_container->flags & (CONTAINER_DEDUP | CONTAINER_DEAD)) != CONTAINER_DEDUP)
+            continue;
+        if (!first || temp_container->cid < first->cid)
+            first = temp_container;
+        if (temp_container->cid > *cid && (!next || temp_container->cid < next->cid))
+            next = temp_container;
+    }
+    if (!next)
+        next = first;
+    if (next)
+    {
+        container_get(next);
+        *cid = next->cid;
+    }
+    mutex_unlock(&my_mutex);
+    return next;
+}
+
+
+static int dedup_run(void *unused)
+{
+    struct container *temp_container;
+    unsigned long long int cid = 0;
+
+    while (!kthread_should_stop())
+    {
+        temp_container = dedup_next_container(&cid);
+        if (!temp_container)
+        {
+            wait_event_interruptible(dedup_wait, READ_ONCE(dedup_kick) || kthread_should_stop());
+            WRITE_ONCE(dedup_kick, false);
+            continue;
+        }
+        dedup_scan_container(temp_container);
+        container_put(temp_container);
+        schedule_timeout_interruptible(msecs_to_jiffies(READ_ONCE(dedup_sleep_ms)));
+    }
+    return 0;
+}
+
+
+/**
+ * Opt the caller's container in (op != 0) or out (op == 0) of page
+ * deduplication. Pages merged already stay shared until they are written.
+ */
+int memory_container_dedup(const struct memory_container_cmd *cmd)
+{
+    struct container *temp_container;
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (temp_container)
+    {
+        if (cmd->op)
+            temp_container->flags |= CONTAINER_DEDUP;
+        else
+            temp_container->flags &= ~CONTAINER_DEDUP;
+    }
+    mutex_unlock(&my_mutex);
+
+    if (!temp_container)
+        return -EINVAL;
+    if (cmd->op)
+    {
+        WRITE_ONCE(dedup_kick, true);
+        wake_up_interruptible(&dedup_wait);
+    }
+    return 0;
+}
+
+
+/**
+ * Report the dedup statistics of the caller's container.
+ */
+int memory_container_dedup_stats(struct memory_container_dedup_stats __user *user_stats)
+{
+    struct memory_container_dedup_stats stats;
+    struct container *temp_container;
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (temp_container)
+    {
+        stats.scanned_pages = atomic64_read(&temp_container->dedup_scanned);
+        stats.merges = atomic64_read(&temp_container->dedup_merges);
+        stats.unmerges = atomic64_read(&temp_container->dedup_unmerges);
+        stats.saved_pages = stats.merges > stats.unmerges ? stats.merges - stats.unmerges : 0;
+        stats.passes = atomic64_read(&temp_container->dedup_passes);
+    }
+    mutex_unlock(&my_mutex);
+
+    if (!temp_container)
+        return -EINVAL;
+    if (copy_to_user(user_stats, &stats, sizeof(stats)))
+        return -EFAULT;
+    return 0;
+}
+
+
+int memory_container_dedup_init(void)
+{
+    dedup_thread = kthread_run(dedup_run, NULL, "mcontainer_dedup");
+    if (IS_ERR(dedup_thread))
+        return PTR_ERR(dedup_thread);
+    return 0;
+}
+
+
+void memory_container_dedup_exit(void)
+{
+    kthread_stop(dedup_thread);
+}
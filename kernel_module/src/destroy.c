@@ -0,0 +1,230 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Destroying Containers and Freeing Ranges of Objects
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "memory_container_internal.h"
+
+#include <asm/uaccess.h>
+#include <linux/slab.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+#include <linux/radix-tree.h>
+
+//Objects taken off a destroyed container between two looks at my_mutex
+#define DESTROY_BATCH 256
+//Objects looked up at once by a ranged free
+#define FREE_RANGE_GANG 64
+
+//Tears down what DESTROY and FREE_RANGE take away, so they return early
+static struct workqueue_struct *destroy_wq;
+
+//Objects a ranged free took off their container, chained through next
+struct object_reap{
+    struct work_struct work;
+    struct object *victims;
+};
+
+
+//Zap and let go of a chain of objects that are off their container
+static void kill_chain(struct object *victims)
+{
+    struct object *victim;
+
+    while (victims)
+    {
+        victim = victims;
+        victims = victim->next;
+        killobject(victim);
+        cond_resched();
+    }
+}
+
+
+static void reap_objects(struct work_struct *work)
+{
+    struct object_reap *reap = container_of(work, struct object_reap, work);
+
+    kill_chain(reap->victims);
+    kfree(reap);
+}
+
+
+//Free the objects of a destroyed container a batch at a time, then drop
+//the reference DESTROY handed us
+static void container_teardown(struct work_struct *work)
+{
+    struct container *owner = container_of(work, struct container, destroy_work);
+    struct object *victims, *victim;
+    int n;
+
+    do
+    {
+        victims = NULL;
+        mutex_lock(&my_mutex);
+        for (n = 0; n < DESTROY_BATCH && owner->object_list; n++)
+        {
+            victim = owner->object_list;
+            unlinkobject(owner, victim);
+            notify_object_changed(owner, victim->oid, NULL);
+            victim->next = victims;
+            victims = victim;
+        }
+        mutex_unlock(&my_mutex);
+        kill_chain(victims);
+    } while (victims);
+    container_put(owner);
+}
+
+
+/**
+ * Destroy the caller's container: every task leaves it, its locks are
+ * dropped and all of its objects are freed, so mappings of them fault
+ * with SIGBUS from now on. The objects are torn down in the background,
+ * which lets this return before their memory is back.
+ */
+int memory_container_destroy(const struct memory_container_cmd *cmd)
+{
+    struct container *temp_container;
+    struct task *temp_task;
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (!temp_container)
+    {
+        mutex_unlock(&my_mutex);
+        return -EINVAL;
+    }
+    //The list's reference goes, the worker holds its own
+    container_get(temp_container);
+    container_head = deletecontainer(&container_head, temp_container->cid);
+    while ((temp_task = temp_container->task_list))
+    {
+        temp_container->task_list = temp_task->next;
+        kfree(temp_task);
+    }
+    temp_container->flags |= CONTAINER_DEAD;
+    lock_release_all(temp_container);
+    sync_release_all(temp_container);
+    INIT_WORK(&temp_container->destroy_work, container_teardown);
+    queue_work(destroy_wq, &temp_container->destroy_work);
+    mutex_unlock(&my_mutex);
+    return 0;
+}
+
+
+/**
+ * Free the objects from oid to oid + op - 1 of the caller's container that
+ * exist, found through the index rather than one ioctl each. my_mutex is
+ * dropped between gangs of lookups, so other tasks' calls are not held up
+ * for the whole range. The objects found are gone from the container when
+ * this returns; their mappings are torn down and their memory freed in the
+ * background. Returns how many were freed.
+ */
+int memory_container_free_range(const struct memory_container_cmd *cmd)
+{
+    struct container *temp_container;
+    struct object *gang[FREE_RANGE_GANG], *victims = NULL;
+    struct object_reap *reap;
+    unsigned long long int first, end;
+    int i, n, freed = 0;
+
+    first = cmd->oid;
+    end = first + cmd->op;
+    if (end < first || end > MCONTAINER_RESERVED_OID)
+        end = MCONTAINER_RESERVED_OID;
+    //Without it the objects are freed before returning
+    reap = kmalloc(sizeof(struct object_reap), GFP_KERNEL);
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (!temp_container)
+    {
+        mutex_unlock(&my_mutex);
+        kfree(reap);
+        return -EINVAL;
+    }
+    //my_mutex is let go between gangs, the reference keeps the container
+    container_get(temp_container);
+    while (first < end)
+    {
+        n = radix_tree_gang_lookup(&temp_container->object_tree, (void **)gang, first, FREE_RANGE_GANG);
+        for (i = 0; i < n && gang[i]->oid < end; i++)
+        {
+            unlinkobject(temp_container, gang[i]);
+            notify_object_changed(temp_container, gang[i]->oid, NULL);
+            gang[i]->next = victims;
+            victims = gang[i];
+            freed++;
+        }
+        if (i < FREE_RANGE_GANG)
+            break;
+        first = gang[i - 1]->oid + 1;
+        //Let everybody else's calls in, as teardown does between batches
+        mutex_unlock(&my_mutex);
+        cond_resched();
+        mutex_lock(&my_mutex);
+        //Destroyed meanwhile, and its teardown frees the rest
+        if (temp_container->flags & CONTAINER_DEAD)
+            break;
+    }
+    mutex_unlock(&my_mutex);
+    container_put(temp_container);
+
+    if (reap && victims)
+    {
+        reap->victims = victims;
+        INIT_WORK(&reap->work, reap_objects);
+        queue_work(destroy_wq, &reap->work);
+    }
+    else
+    {
+        kfree(reap);
+        kill_chain(victims);
+    }
+    return freed;
+}
+
+
+int memory_container_destroy_init(void)
+{
+    destroy_wq = alloc_workqueue("mcontainer_destroy", WQ_UNBOUND, 0);
+    return destroy_wq ? 0 : -ENOMEM;
+}
+
+
+//Waits for everything queued to be freed
+void memory_container_destroy_exit(void)
+{
+    destroy_workqueue(destroy_wq);
+}
@@ -0,0 +1,125 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Listing the Objects of a Container
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "memory_container_internal.h"
+
+#include <asm/uaccess.h>
+#include <linux/slab.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/radix-tree.h>
+
+//Objects looked up in the index at once
+#define ENUMERATE_GANG 64
+
+
+//Describe obj in info. Called with my_mutex and lock_table_lock held.
+static void enumerate_object(struct container *owner, struct object *obj, struct memory_container_object_info *info)
+{
+    unsigned long i;
+
+    info->oid = obj->oid;
+    info->lock_holder = object_lock_holder(owner, obj->oid);
+    info->resident_pages = 0;
+    mutex_lock(&obj->page_lock);
+    info->size = obj->size;
+    for (i = 0; i < obj->nr_pages; i++)
+    {
+        if (obj->pages[i])
+            info->resident_pages++;
+    }
+    info->flags = obj->readonly ? MCONTAINER_META_SEALED : 0;
+    mutex_unlock(&obj->page_lock);
+}
+
+
+/**
+ * Report up to nr objects of the caller's container from oid cursor on,
+ * in oid order, and move cursor past the last of them. Returns how many
+ * were reported, 0 once there are no more.
+ */
+int memory_container_enumerate(struct memory_container_enumerate __user *user_enum)
+{
+    struct memory_container_enumerate temp_enum;
+    struct memory_container_object_info *infos;
+    struct object *gang[ENUMERATE_GANG];
+    struct container *temp_container;
+    unsigned long long int cursor;
+    int i, n, max, filled = 0, ret;
+
+    if (copy_from_user(&temp_enum, user_enum, sizeof(struct memory_container_enumerate)))
+        return -EFAULT;
+    if (temp_enum.nr == 0 || temp_enum.nr > MCONTAINER_ENUMERATE_MAX)
+        return -EINVAL;
+    cursor = temp_enum.cursor;
+    if (cursor >= MCONTAINER_RESERVED_OID)
+        return 0;
+    infos = object_array_alloc(temp_enum.nr, sizeof(struct memory_container_object_info));
+    if (!infos)
+        return -ENOMEM;
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (!temp_container)
+    {
+        mutex_unlock(&my_mutex);
+        kvfree(infos);
+        return -EINVAL;
+    }
+    mutex_lock(&temp_container->lock_table_lock);
+    while (filled < temp_enum.nr)
+    {
+        max = min_t(int, ENUMERATE_GANG, temp_enum.nr - filled);
+        n = radix_tree_gang_lookup(&temp_container->object_tree, (void **)gang, cursor, max);
+        for (i = 0; i < n; i++)
+            enumerate_object(temp_container, gang[i], &infos[filled++]);
+        if (n)
+            cursor = gang[n - 1]->oid + 1;
+        if (n < max)
+            break;
+    }
+    mutex_unlock(&temp_container->lock_table_lock);
+    mutex_unlock(&my_mutex);
+
+    //The records may go to a mapping of an object, whose faults need my_mutex
+    if (filled && copy_to_user((void __user *)(unsigned long)temp_enum.objects, infos,
+                               filled * sizeof(struct memory_container_object_info)))
+        ret = -EFAULT;
+    else if (put_user(cursor, &user_enum->cursor))
+        ret = -EFAULT;
+    else
+        ret = filled;
+    kvfree(infos);
+    return ret;
+}
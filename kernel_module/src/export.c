@@ -0,0 +1,256 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Exporting Objects as File Descriptors
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "memory_container_internal.h"
+
+#include <asm/uaccess.h>
+#include <linux/slab.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/anon_inodes.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
+#include <linux/mutex.h>
+
+//Look up page index of an exported object and take a reference on it,
+//so it can be used after page_lock is dropped.
+static struct page * object_export_get_page(struct object *obj, unsigned long index, int *err)
+{
+    struct page *page = NULL;
+
+    mutex_lock(&obj->page_lock);
+    if (obj->dead)
+    {
+        *err = -EIO;
+    }
+    else if (index >= obj->nr_pages)
+    {
+        //Shrunk under us, which reads like the end of the file
+        *err = 0;
+    }
+    else
+    {
+        *err = object_populate_page(obj, index);
+        if (!*err)
+        {
+            page = obj->pages[index];
+            get_page(page);
+            obj->last_access = jiffies;
+        }
+    }
+    mutex_unlock(&obj->page_lock);
+    return page;
+}
+
+
+static loff_t object_export_size(struct object *obj)
+{
+    return (loff_t)obj->nr_pages << PAGE_SHIFT;
+}
+
+
+static ssize_t object_export_read(struct file *filp, char __user *buf, size_t len, loff_t *ppos)
+{
+    struct object *obj = filp->private_data;
+    loff_t size = object_export_size(obj);
+    ssize_t copied = 0;
+    int err = 0;
+
+    if (*ppos >= size)
+        return 0;
+    if (len > size - *ppos)
+        len = size - *ppos;
+
+    while (len)
+    {
+        unsigned long index = *ppos >> PAGE_SHIFT;
+        unsigned int offset = *ppos & ~PAGE_MASK;
+        size_t chunk = min_t(size_t, len, PAGE_SIZE - offset);
+        struct page *page;
+        unsigned long left;
+
+        page = object_export_get_page(obj, index, &err);
+        if (!page)
+            break;
+        //The user buffer may well be a mapping of this very object, so
+        //page_lock must not be held while we fault on it
+        left = copy_to_user(buf + copied, page_address(page) + offset, chunk);
+        put_page(page);
+        chunk -= left;
+        copied += chunk;
+        *ppos += chunk;
+        len -= chunk;
+        if (left)
+        {
+            err = -EFAULT;
+            break;
+        }
+    }
+    return copied ? copied : err;
+}
+
+
+static loff_t object_export_llseek(struct file *filp, loff_t offset, int whence)
+{
+    struct object *obj = filp->private_data;
+    return fixed_size_llseek(filp, offset, whence, object_export_size(obj));
+}
+
+
+static const struct pipe_buf_operations object_export_pipe_buf_ops = {
+    .can_merge  = 0,
+    .confirm    = generic_pipe_buf_confirm,
+    .release    = generic_pipe_buf_release,
+    .steal      = generic_pipe_buf_steal,
+    .get        = generic_pipe_buf_get,
+};
+
+
+static void object_export_spd_release(struct splice_pipe_desc *spd, unsigned int i)
+{
+    put_page(spd->pages[i]);
+}
+
+
+//Hand the object's pages themselves to the pipe, so sendfile()/splice()
+//to a socket never copies them
+static ssize_t object_export_splice_read(struct file *filp, loff_t *ppos, struct pipe_inode_info *pipe,
+                                         size_t len, unsigned int flags)
+{
+    struct object *obj = filp->private_data;
+    struct page *pages[PIPE_DEF_BUFFERS];
+    struct partial_page partial[PIPE_DEF_BUFFERS];
+    struct splice_pipe_desc spd = {
+        .pages          = pages,
+        .partial        = partial,
+        .nr_pages       = 0,
+        .nr_pages_max   = PIPE_DEF_BUFFERS,
+        .flags          = flags,
+        .ops            = &object_export_pipe_buf_ops,
+        .spd_release    = object_export_spd_release,
+    };
+    loff_t size = object_export_size(obj);
+    loff_t pos = *ppos;
+    ssize_t ret;
+    int err = 0;
+
+    if (pos >= size)
+        return 0;
+    if (len > size - pos)
+        len = size - pos;
+
+    while (len && spd.nr_pages < PIPE_DEF_BUFFERS)
+    {
+        unsigned int offset = pos & ~PAGE_MASK;
+        size_t chunk = min_t(size_t, len, PAGE_SIZE - offset);
+        struct page *page = object_export_get_page(obj, pos >> PAGE_SHIFT, &err);
+
+        if (!page)
+            break;
+        pages[spd.nr_pages] = page;
+        partial[spd.nr_pages].offset = offset;
+        partial[spd.nr_pages].len = chunk;
+        spd.nr_pages++;
+        pos += chunk;
+        len -= chunk;
+    }
+    if (!spd.nr_pages)
+        return err;
+
+    ret = splice_to_pipe(pipe, &spd);
+    if (ret > 0)
+        *ppos += ret;
+    return ret;
+}
+
+
+static int object_export_release(struct inode *inode, struct file *filp)
+{
+    object_put(filp->private_data);
+    return 0;
+}
+
+
+static const struct file_operations object_export_fops = {
+    .owner          = THIS_MODULE,
+    .read           = object_export_read,
+    .llseek         = object_export_llseek,
+    .splice_read    = object_export_splice_read,
+    .release        = object_export_release,
+};
+
+
+/**
+ * Export object oid of the caller's container as a read-only file
+ * descriptor, returned as the result of the ioctl. The descriptor keeps
+ * the object's memory alive; reads fail once the object has been freed.
+ */
+int memory_container_export(const struct memory_container_cmd *cmd)
+{
+    struct container *temp_container;
+    struct object *temp_object = NULL;
+    struct file *filp;
+    int fd;
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (temp_container)
+        temp_object = findobject(temp_container, cmd->oid);
+    if (temp_object)
+        object_get(temp_object);
+    mutex_unlock(&my_mutex);
+
+    if (!temp_container)
+        return -EINVAL;
+    if (!temp_object)
+        return -ENOENT;
+
+    fd = get_unused_fd_flags(O_CLOEXEC);
+    if (fd < 0)
+    {
+        object_put(temp_object);
+        return fd;
+    }
+    filp = anon_inode_getfile("[mcontainer-object]", &object_export_fops, temp_object, O_RDONLY);
+    if (IS_ERR(filp))
+    {
+        put_unused_fd(fd);
+        object_put(temp_object);
+        return PTR_ERR(filp);
+    }
+    //sendfile() with an explicit offset and pread() want a seekable file
+    filp->f_mode |= FMODE_LSEEK | FMODE_PREAD;
+    fd_install(fd, filp);
+    return fd;
+}
@@ -29,14 +29,16 @@
 //
 ////////////////////////////////////////////////////////////////////////
 
-#include "memory_container.h"
+#include "memory_container_internal.h"
 
 #include <asm/uaccess.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/kernel.h>
 #include <linux/errno.h>
 #include <linux/mm.h>
 #include <linux/fs.h>
+#include <linux/file.h>
 #include <linux/miscdevice.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
@@ -45,31 +47,15 @@
 #include <linux/sched.h>
 #include <linux/kthread.h>
 
-//Declaring a list to store task ids
-struct task{
-    struct task_struct* currTask;
-    struct task *next;
-};
-
-struct object{
-    unsigned long long int oid;
-    unsigned long pfn;
-    char* address;
-    struct object *next;
-};
-
-//Declaring a list to store container ids and a pointer to associated task ids
-struct container {
-    unsigned long long int cid;
-    struct task *task_list;
-    struct object *object_list;
-    struct mutex object_lock;
-    struct container *next;
-}*container_head = NULL;
+struct container *container_head = NULL;
 
 //Declaring a mutex variable
 DEFINE_MUTEX(my_mutex);
 
+//Every open of the device shares one inode, so the mappings of all objects
+//hang off this address space and can be zapped through it
+static struct address_space *mcontainer_mapping = NULL;
+
 //Adding a new container to the list of containers
 //returns pointer to newly added container
 struct container * addcontainer(struct container **head, unsigned long long int cid)
@@ -83,7 +69,27 @@ struct container * addcontainer(struct container **head, unsigned long long int
     temp->cid = cid;
     temp->task_list = NULL;
     temp->object_list = NULL;
-    mutex_init(&(temp->object_lock));
+    INIT_RADIX_TREE(&temp->object_tree, GFP_KERNEL);
+    mutex_init(&temp->lock_table_lock);
+    memset(temp->lock_table, 0, sizeof(temp->lock_table));
+    memset(temp->sync_table, 0, sizeof(temp->sync_table));
+    temp->flags = 0;
+    atomic64_set(&temp->resident_pages, 0);
+    atomic64_set(&temp->compressed_pages, 0);
+    atomic64_set(&temp->compressed_bytes, 0);
+    atomic64_set(&temp->compressions, 0);
+    atomic64_set(&temp->decompressions, 0);
+    atomic64_set(&temp->decompress_ns, 0);
+    atomic64_set(&temp->decompress_max_ns, 0);
+    atomic64_set(&temp->dedup_scanned, 0);
+    atomic64_set(&temp->dedup_merges, 0);
+    atomic64_set(&temp->dedup_unmerges, 0);
+    atomic64_set(&temp->dedup_passes, 0);
+    temp->meta_pages = NULL;
+    init_waitqueue_head(&temp->generation_wait);
+    atomic64_set(&temp->generation_changes, 0);
+    atomic64_set(&temp->generation_counter, 0);
+    kref_init(&temp->refcount);
     if(*head == NULL)
     {
         temp->next = *head;
@@ -101,16 +107,10 @@ struct container * addcontainer(struct container **head, unsigned long long int
     return *head;
 }
 
-struct object * findobject(struct object *head, unsigned long long int oid)
+//Objects are found through the container's index rather than its list
+struct object * findobject(struct container *owner, unsigned long long int oid)
 {
-    while(head)
-    {
-        if (head->oid == oid)
-            return head;
-        else
-            head = head->next;
-    }
-    return NULL;
+    return radix_tree_lookup(&owner->object_tree, oid);
 }
 
 struct container * findcontainer(int pid)
@@ -167,35 +167,142 @@ struct task * addtask(struct task **head, struct task_struct* currTask)
 }
 
 
-struct object * addobject(struct object **head, unsigned long long int oid)
+//Per-page arrays of large objects are more than kmalloc likes to hand out.
+//array_size() is newer than the kernels we build for, so check by hand.
+void * object_array_alloc(unsigned long n, size_t size)
 {
-    struct object *temp = kmalloc( sizeof(struct object), GFP_KERNEL );
+    if (size && n > SIZE_MAX / size)
+        return NULL;
+    if (n * size > PAGE_SIZE)
+        return __vmalloc(n * size, GFP_MCONTAINER | __GFP_HIGHMEM | __GFP_ZERO, PAGE_KERNEL);
+    return kzalloc(n * size, GFP_MCONTAINER);
+}
+
+
+//Adding a new object to the front of a container's object list and to its
+//index, returns pointer to the newly added object
+struct object * addobject(struct object **head, struct container *owner, unsigned long long int oid, unsigned long nr_pages)
+{
+    struct object *temp = kmalloc( sizeof(struct object), GFP_MCONTAINER );
     if (temp == NULL)
     {
         // printk("Not enough memory to add object : %d", oid);
-        return *head;
+        return NULL;
     }    
-        
+    temp->size_class = object_size_class(nr_pages);
+    temp->pages = object_array_alloc(object_capacity(temp), sizeof(struct page *));
+    temp->zpages = NULL;
+    //Only objects of opted-in containers can be compressed
+    if (owner->flags & CONTAINER_RECLAIM)
+        temp->zpages = object_array_alloc(object_capacity(temp), sizeof(struct object_zpage));
+    if (temp->pages == NULL || ((owner->flags & CONTAINER_RECLAIM) && temp->zpages == NULL))
+    {
+        kvfree(temp->pages);
+        kvfree(temp->zpages);
+        kfree(temp);
+        return NULL;
+    }
+
     temp->oid = oid;
-    temp->address = NULL;
-    if(*head == NULL)
+    temp->size = (__u64)nr_pages << PAGE_SHIFT;
+    temp->nr_pages = nr_pages;
+    temp->cow = NULL;
+    temp->backing = NULL;
+    temp->backing_offset = 0;
+    temp->backing_pages = 0;
+    temp->last_access = jiffies;
+    temp->generation = 0;
+    temp->readonly = 0;
+    temp->dead = 0;
+    mutex_init(&temp->page_lock);
+    kref_init(&temp->refcount);
+    temp->container = owner;
+    if (radix_tree_insert(&owner->object_tree, oid, temp))
     {
-        temp->next = *head;
-        *head=temp;
+        kvfree(temp->pages);
+        kvfree(temp->zpages);
+        kfree(temp);
+        return NULL;
     }
-    else
+    container_get(owner);
+    mcontainer_stat_inc(MCONTAINER_STAT_OBJECT_ALLOC);
+    temp->prev = NULL;
+    temp->next = *head;
+    if (*head)
+        (*head)->prev = temp;
+    *head = temp;
+    return temp;
+}
+
+
+static void object_release(struct kref *kref)
+{
+    struct object *obj = container_of(kref, struct object, refcount);
+    struct container *owner = obj->container;
+    unsigned long i;
+
+    for (i = 0; i < obj->nr_pages; i++)
     {
-        struct object* temp2;
-        temp2= *head;
-        while(temp2->next)
-                temp2=temp2->next;
-        temp->next=temp2->next;
-        temp2->next=temp;
+        if (obj->pages[i])
+        {
+            put_page(obj->pages[i]);
+            atomic64_dec(&obj->container->resident_pages);
+            mcontainer_stat_inc(MCONTAINER_STAT_PAGE_FREE);
+        }
     }
-    return *head;
+    reclaim_free_zpages(obj);
+    kvfree(obj->zpages);
+    kvfree(obj->cow);
+    kvfree(obj->pages);
+    if (obj->backing)
+        fput(obj->backing);
+    kfree(obj);
+    mcontainer_stat_inc(MCONTAINER_STAT_OBJECT_FREE);
+    container_put(owner);
+}
+
+void object_get(struct object *obj)
+{
+    kref_get(&obj->refcount);
+}
+
+//Objects stay around until the list and every mapping have let go of them
+void object_put(struct object *obj)
+{
+    kref_put(&obj->refcount, object_release);
 }
 
+//Tear down the user mappings of nr pages of an object from page first,
+//its own and those through windows, so the next access faults. Other
+//containers' objects with an overlapping offset get zapped as well,
+//which only costs them a refault.
+void object_zap_range(struct object *obj, unsigned long first, unsigned long nr)
+{
+    if (!mcontainer_mapping)
+        return;
+    unmap_mapping_range(mcontainer_mapping, (loff_t)(obj->oid + first) << PAGE_SHIFT, (loff_t)nr << PAGE_SHIFT, 1);
+    window_zap(mcontainer_mapping, obj, first, nr);
+}
+
+
+void object_zap(struct object *obj)
+{
+    object_zap_range(obj, 0, obj->nr_pages);
+}
 
+//Unhook an object that is already off its container's list
+void killobject(struct object *obj)
+{
+    mutex_lock(&obj->page_lock);
+    obj->dead = 1;
+    mutex_unlock(&obj->page_lock);
+    object_zap(obj);
+    object_put(obj);
+}
+
+
+//Take a container off the list of containers. It is freed once the last
+//of its objects and mappings lets go of it.
 struct container * deletecontainer(struct container **head, unsigned long long int cid)
 {
     struct container* temp_head, *prev;
@@ -203,7 +310,7 @@ struct container * deletecontainer(struct container **head, unsigned long long i
     if (temp_head != NULL && temp_head->cid == cid) 
         { 
             *head = temp_head->next;   
-            kfree(temp_head);         
+            container_put(temp_head);
             return *head; 
         }
 
@@ -220,10 +327,41 @@ struct container * deletecontainer(struct container **head, unsigned long long i
     } 
 
     prev->next = temp_head->next; 
-    kfree(temp_head);
+    container_put(temp_head);
     return *head;
 }
 
+
+static void container_release(struct kref *kref)
+{
+    struct container *owner = container_of(kref, struct container, refcount);
+    struct object_lock *temp_lock;
+    int i;
+
+    //Waiters that gave up after the container was destroyed leave entries
+    for (i = 0; i < OBJECT_LOCK_BUCKETS; i++)
+    {
+        while ((temp_lock = owner->lock_table[i]))
+        {
+            owner->lock_table[i] = temp_lock->next;
+            kfree(temp_lock);
+        }
+    }
+    sync_free_all(owner);
+    notify_free_meta(owner);
+    kfree(owner);
+}
+
+void container_get(struct container *owner)
+{
+    kref_get(&owner->refcount);
+}
+
+void container_put(struct container *owner)
+{
+    kref_put(&owner->refcount, container_release);
+}
+
 struct task * deletetask(struct task **head, int pid)
 {
     struct task* temp_head, *prev;
@@ -261,45 +399,32 @@ void display_obj_list(struct object *head){
     }
 }
 
-struct object * deleteobject(struct object **head, unsigned long long int oid)
+//Take an object off its container's list and index.
+//Called with my_mutex held.
+void unlinkobject(struct container *owner, struct object *obj)
 {
-    // printk("\nInside delete object");
-    display_obj_list(*head);
-    struct object* temp_head, *prev;
-    temp_head = *head;
-    if (temp_head != NULL && temp_head->oid == oid) 
-        { 
-            *head = temp_head->next; 
-            // printk("\nObject to be freed found OID: %llu", oid);
-            kfree(temp_head->address);
-            temp_head->address = NULL;
-            // printk("\nSet address pointer to NULL");  
-            kfree(temp_head);
-            // printk("\nReturning object list");         
-            display_obj_list(*head);
-            return *head; 
-        }
-    while (temp_head != NULL && temp_head->oid != oid) 
-    { 
-        prev = temp_head; 
-        temp_head = temp_head->next; 
-    } 
-   
-    if (temp_head == NULL) 
+    radix_tree_delete(&owner->object_tree, obj->oid);
+    if (obj->prev)
+        obj->prev->next = obj->next;
+    else
+        owner->object_list = obj->next;
+    if (obj->next)
+        obj->next->prev = obj->prev;
+}
+
+//Take object oid off its container's list and index, and let it go
+void deleteobject(struct container *owner, unsigned long long int oid)
+{
+    struct object *victim = findobject(owner, oid);
+
+    if (victim == NULL)
     {
         // printk("\nobject not found : %d", oid);
-        return *head;
-    } 
-    
-    prev->next = temp_head->next;
+        return;
+    }
+    unlinkobject(owner, victim);
     // printk("\nObject to be freed found OID: %llu", oid);
-    kfree(temp_head->address);
-    temp_head->address = NULL; 
-    // printk("\nSet address pointer to NULL");  
-    kfree(temp_head);
-    // printk("\nReturning object list");
-    display_obj_list(*head);
-    return *head;
+    killobject(victim);
 }
 
 void display_list(void)
@@ -324,169 +449,305 @@ void display_list(void)
 }
 
 
-int memory_container_mmap(struct file *filp, struct vm_area_struct *vma)
+//Make sure page index of obj is resident, bringing it back from the
+//shrinker or a restored image, or allocating it zero-filled on first touch.
+//Called with obj->page_lock held.
+int object_populate_page(struct object *obj, unsigned long index)
 {
-    mutex_lock(&my_mutex);
-    struct vm_area_struct temp_vma;
-    copy_from_user(&temp_vma, vma, sizeof(struct vm_area_struct));
-    struct container *temp_container;
-    //Setting calling thread's associated pid
-    int pid = current->pid;
-    //Finding the corresponding container from pid
-    temp_container = findcontainer(pid);
-    //Getting object size
-    int object_size = vma->vm_end - vma->vm_start;
-    //Getting oid
-    unsigned long long int oid = vma->vm_pgoff;
-    // printk("\nInside mmap : PID -> %d --- OID -> %lu", pid, oid);
-    // printk("\n mmap start -> %lu --- end -> %lu", vma->vm_start, vma->vm_end);
-    // printk("\n mmap diff : %lu", vma->vm_end - vma->vm_start);
-    int flag = 0;
-    struct object *temp_object_list;
-    if (temp_container)
+    struct page *page;
+
+    if (obj->pages[index])
+        return 0;
+    if (obj->zpages && obj->zpages[index].data)
+        return reclaim_decompress_page(obj, index);
+    if (obj->backing && index < obj->backing_pages)
+        return persist_load_page(obj, index);
+
+    page = pool_get_page();
+    if (page == NULL)
+        return -ENOMEM;
+    obj->pages[index] = page;
+    atomic64_inc(&obj->container->resident_pages);
+    mcontainer_stat_inc(MCONTAINER_STAT_PAGE_ALLOC);
+    return 0;
+}
+
+
+static void memory_container_vm_open(struct vm_area_struct *vma)
+{
+    object_get(vma->vm_private_data);
+}
+
+
+static void memory_container_vm_close(struct vm_area_struct *vma)
+{
+    object_put(vma->vm_private_data);
+}
+
+
+//Give obj its own copy of a page it shares with another object. Mappings
+//of the shared page, through the object or a window, must go. If nobody
+//but obj holds the page any more, beyond the held references of the
+//caller, it is simply kept.
+//Called with obj->page_lock held.
+static int object_break_cow(struct object *obj, unsigned long index, int held)
+{
+    struct page *page = obj->pages[index];
+    struct page *copy;
+
+    object_zap_range(obj, index, 1);
+    if (page_count(page) == 1 + held)
     {
-        temp_object_list = temp_container->object_list;
-        if (temp_object_list)
-        {
-            //Remap if object already exists
-            struct object *existing_object = findobject(temp_object_list, oid);
-            if (existing_object) 
-            {        
-                flag = 1;
-                remap_pfn_range(vma, vma->vm_start, existing_object->pfn, object_size, vma->vm_page_prot);
-                // printk("\nObject exists: CID -> %llu --- PID -> %d --- OID: %llu", temp_container->cid, pid, oid);
-            }
-        }
-        //Create object if it doesn't exist
-        if (!flag)
-        {
-            struct object *curr_object;
-            temp_object_list = addobject(&temp_object_list, oid);
-            // printk("\nCreating object : CID -> %llu --- PID -> %d --- OID: %llu", temp_container->cid, pid, oid);
-            temp_container->object_list = temp_object_list;
-            curr_object = findobject(temp_object_list, oid);
-            if (curr_object)
-            {
-                // printk("\nObject created successfully : CID -> %llu --- PID -> %d --- OID: %llu", temp_container->cid, pid, oid);
-                char *memory_space = (char*) (kmalloc((object_size)*sizeof(char), GFP_KERNEL ));
-                curr_object->address = memory_space;
-                unsigned long pfn = virt_to_phys((void*)memory_space)>>PAGE_SHIFT;
-                curr_object->pfn = pfn;
-                int remaped = remap_pfn_range(vma, vma->vm_start, pfn, object_size,vma->vm_page_prot);
-                // printk("\nmmap done successfully");
-                display_obj_list(temp_container->object_list);
-                if (remaped < 0)
-                {
-                    // printk("\n Can't remap CID -> %llu --- PID -> %d --- OID: %llu", temp_container->cid, pid, oid);
-                }
-            }
-        }
+        clear_bit(index, obj->cow);
+        return 0;
     }
-    else{
-        // printk("\nContainer with PID -> %d not found", pid);
-    }
-    mutex_unlock(&my_mutex);
+    copy = alloc_page(GFP_MCONTAINER);
+    if (copy == NULL)
+        return -ENOMEM;
+    copy_highpage(copy, page);
+    obj->pages[index] = copy;
+    clear_bit(index, obj->cow);
+    put_page(page);
+    if (READ_ONCE(obj->container->flags) & CONTAINER_DEDUP)
+        atomic64_inc(&obj->container->dedup_unmerges);
+    mcontainer_stat_inc(MCONTAINER_STAT_PAGE_ALLOC);
+    mcontainer_stat_inc(MCONTAINER_STAT_PAGE_FREE);
     return 0;
 }
 
 
-int memory_container_lock(struct memory_container_cmd __user *user_cmd)
+//Fault in page index of obj, for a mapping of the object or a window.
+//Called without any lock held.
+int object_fault(struct object *obj, unsigned long index, struct vm_fault *vmf)
 {
-    mutex_lock(&my_mutex);
-    struct memory_container_cmd temp_cmd;
-    copy_from_user(&temp_cmd, user_cmd, sizeof(struct memory_container_cmd));
-    //Setting calling thread's associated pid
-    int pid = current->pid;
-    //Getting oid
-    unsigned long long int oid = temp_cmd.oid;
-    //Finding corresponding container from pid
-    struct container *temp_container;
-    temp_container = findcontainer(pid);
-    // if (temp_container)
-        // printk("\nInside lock : CID -> %llu --- PID -> %d --- OID -> %llu", temp_container->cid, pid, oid);
+    struct page *page;
+    int ret;
 
-    int flag =0;
-    //Applying lock on current container
-    if (temp_container)
+    mcontainer_stat_inc(MCONTAINER_STAT_FAULT);
+    mutex_lock(&obj->page_lock);
+    //The object or its container was freed, or the mapping is larger than
+    //the object
+    if (obj->dead || (READ_ONCE(obj->container->flags) & CONTAINER_DEAD) || index >= obj->nr_pages)
     {
-        mutex_unlock(&my_mutex);
-        mutex_lock(&(temp_container->object_lock));
+        mutex_unlock(&obj->page_lock);
+        return VM_FAULT_SIGBUS;
     }
-    else{
-        // printk("\nContainer with PID -> %d not found", pid);
-        mutex_unlock(&my_mutex);
+    if ((vmf->flags & FAULT_FLAG_WRITE) && obj->readonly)
+    {
+        mutex_unlock(&obj->page_lock);
+        return VM_FAULT_SIGBUS;
+    }
+    ret = object_populate_page(obj, index);
+    if (!ret && (vmf->flags & FAULT_FLAG_WRITE) && obj->cow && test_bit(index, obj->cow))
+        ret = object_break_cow(obj, index, 0);
+    if (ret)
+    {
+        mutex_unlock(&obj->page_lock);
+        return ret == -ENOMEM ? VM_FAULT_OOM : VM_FAULT_SIGBUS;
     }
+    page = obj->pages[index];
+    get_page(page);
+    obj->last_access = jiffies;
+    mutex_unlock(&obj->page_lock);
+
+    vmf->page = page;
     return 0;
 }
 
 
-int memory_container_unlock(struct memory_container_cmd __user *user_cmd)
+//First write to page index of obj that was faulted in for reading. Shared
+//pages get copied here; the stale mappings are zapped and the write
+//faults again.
+int object_page_mkwrite(struct object *obj, unsigned long index, struct vm_fault *vmf)
 {
-    mutex_lock(&my_mutex);
-    struct memory_container_cmd temp_cmd;
-    copy_from_user(&temp_cmd, user_cmd, sizeof(struct memory_container_cmd));
+    int ret = 0;
+
+    mutex_lock(&obj->page_lock);
+    if (obj->dead || obj->readonly || index >= obj->nr_pages)
+    {
+        mutex_unlock(&obj->page_lock);
+        return VM_FAULT_SIGBUS;
+    }
+    if (obj->pages[index] != vmf->page)
+    {
+        //The page was swapped out from under this mapping, refault
+        object_zap_range(obj, index, 1);
+        ret = -EAGAIN;
+    }
+    else if (obj->cow && test_bit(index, obj->cow))
+    {
+        //The core holds vmf->page while we run
+        ret = object_break_cow(obj, index, 1);
+        if (!ret)
+            ret = -EAGAIN;
+    }
+    mutex_unlock(&obj->page_lock);
+
+    if (ret == -EAGAIN)
+        return VM_FAULT_NOPAGE;
+    if (ret)
+        return VM_FAULT_OOM;
+    //Our pages have no mapping, so the core would retry forever unless
+    //we hand the page back locked
+    lock_page(vmf->page);
+    return VM_FAULT_LOCKED;
+}
+
+
+static int memory_container_vm_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+    return object_fault(vma->vm_private_data, vmf->pgoff - vma->vm_pgoff, vmf);
+}
+
+
+static int memory_container_vm_page_mkwrite(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+    //vmf->pgoff comes from page->index here, which our pages do not keep
+    unsigned long index = ((unsigned long)vmf->virtual_address - vma->vm_start) >> PAGE_SHIFT;
+
+    return object_page_mkwrite(vma->vm_private_data, index, vmf);
+}
+
+
+static const struct vm_operations_struct memory_container_vm_ops = {
+    .open           = memory_container_vm_open,
+    .close          = memory_container_vm_close,
+    .fault          = memory_container_vm_fault,
+    .page_mkwrite   = memory_container_vm_page_mkwrite,
+};
+
+
+int memory_container_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct container *temp_container;
+    struct object *curr_object;
     //Setting calling thread's associated pid
     int pid = current->pid;
+    //Getting object size in pages
+    unsigned long nr_pages = vma_pages(vma);
     //Getting oid
-    unsigned long long int oid = temp_cmd.oid;
-    //Finding corresponding container from pid
-    struct container *temp_container;
-    temp_container = findcontainer(pid);
-    // if (temp_container)
-        // printk("\nInside unlock : CID -> %llu --- PID -> %d --- OID -> %llu", temp_container->cid, pid, oid);
+    unsigned long long int oid = vma->vm_pgoff;
+    int existing = 0, ret = 0;
 
-    int flag =0;
-    //Removing lock from current container
-    if (temp_container)
+    //The flag is no part of the offset the object is mapped at, which is
+    //where zapping looks for it. The vma is not in the file's tree yet.
+    if (oid & MCONTAINER_MAP_EXISTING)
     {
-        mutex_unlock(&my_mutex);
-        mutex_unlock(&(temp_container->object_lock));
+        oid &= ~MCONTAINER_MAP_EXISTING;
+        if (oid >= MCONTAINER_RESERVED_OID)
+            return -EINVAL;
+        vma->vm_pgoff = oid;
+        existing = 1;
     }
-    else{
+
+    mutex_lock(&my_mutex);
+    //Finding the corresponding container from pid
+    temp_container = findcontainer(pid);
+    if (!temp_container)
+    {
         // printk("\nContainer with PID -> %d not found", pid);
-        mutex_unlock(&my_mutex);
+        ret = -EINVAL;
+        goto out;
     }
-    return 0;
+    if (!mcontainer_mapping)
+        mcontainer_mapping = filp->f_mapping;
+    if (oid >= MCONTAINER_WINDOW_OID(0))
+    {
+        ret = window_mmap(temp_container, vma);
+        goto out;
+    }
+    if (oid >= MCONTAINER_RESERVED_OID)
+    {
+        ret = notify_mmap_meta(temp_container, vma);
+        goto out;
+    }
+
+    //Reuse the object if it already exists, create it otherwise unless the
+    //caller only wants existing ones. Pages are only allocated when they
+    //are first touched.
+    curr_object = findobject(temp_container, oid);
+    if (!curr_object && existing)
+    {
+        ret = -ENOENT;
+        goto out;
+    }
+    if (!curr_object)
+    {
+        curr_object = addobject(&temp_container->object_list, temp_container, oid, nr_pages);
+        if (!curr_object)
+        {
+            ret = -ENOMEM;
+            goto out;
+        }
+    }
+    //Growing an object takes MCONTAINER_IOCTL_RESIZE, not a bigger mapping
+    else if (nr_pages > curr_object->nr_pages)
+    {
+        ret = -EINVAL;
+        goto out;
+    }
+    object_get(curr_object);
+    curr_object->last_access = jiffies;
+    mcontainer_stat_inc(MCONTAINER_STAT_MMAP);
+
+    //Aliases and sealed objects can only ever be mapped for reading
+    if (curr_object->readonly)
+        vma->vm_flags &= ~(VM_WRITE | VM_MAYWRITE);
+    vma->vm_private_data = curr_object;
+    vma->vm_ops = &memory_container_vm_ops;
+    vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+out:
+    mutex_unlock(&my_mutex);
+    return ret;
 }
 
 
-int memory_container_delete(struct memory_container_cmd __user *user_cmd)
+int memory_container_delete(const struct memory_container_cmd *cmd)
 {
+    int ret = -EINVAL;
     mutex_lock(&my_mutex);
-    struct memory_container_cmd temp_cmd;
-    copy_from_user(&temp_cmd, user_cmd, sizeof(struct memory_container_cmd));
     //Setting calling thread's associated pid
     int pid = current->pid;
     //Finding corresponding container from pid
     struct container *temp_container;
     temp_container = findcontainer(pid);
-    unsigned long long int cid = temp_container->cid;
-    // printk("\nInside Delete : CID -> %llu --- PID -> %d", cid, pid);
     //Deleting task from container
     if(temp_container)
     {
-    
         struct task *temp_task_head = temp_container->task_list;
         temp_task_head = deletetask(&temp_task_head, pid);
         // printk("\n Task deleted : %d within Container : %llu", pid, cid); 
         temp_container->task_list = temp_task_head;
+        ret = 0;
     }
     // printk("\nDeleting task : CID -> %llu --- PID -> %d", cid, pid);
     display_list();
     mutex_unlock(&my_mutex);
+    return ret;
+}
+
+
+//Whether task is one of the tasks of owner
+static int container_has_task(struct container *owner, struct task_struct *task)
+{
+    struct task *temp_task;
+
+    for (temp_task = owner->task_list; temp_task; temp_task = temp_task->next)
+    {
+        if (temp_task->currTask == task)
+            return 1;
+    }
     return 0;
 }
 
 
-int memory_container_create(struct memory_container_cmd __user *user_cmd)
+int memory_container_create(const struct memory_container_cmd *cmd)
 {
- 
+    int ret = 0;
     //Mutex Lock
     mutex_lock(&my_mutex);
-    struct memory_container_cmd temp_cmd;
-    copy_from_user(&temp_cmd, user_cmd, sizeof(struct memory_container_cmd));
     //Setting calling thread's associated cid
-    unsigned long long int cid = temp_cmd.cid;
+    unsigned long long int cid = cmd->cid;
     //Setting calling thread's associated pid
     int pid = current->pid;
     // printk("\nInside Create : CID -> %llu --- PID -> %d", cid, pid);
@@ -530,46 +791,365 @@ int memory_container_create(struct memory_container_cmd __user *user_cmd)
         }
        // printk("\n New container -> Creating task : CID -> %llu --- PID -> %d", cid, pid);
     }
+    //addcontainer() and addtask() leave the lists alone when out of memory
+    if (!temp_container || !container_has_task(temp_container, current))
+        ret = -ENOMEM;
     display_list();
     mutex_unlock(&my_mutex);
-    return 0;
+    return ret;
 }
 
 
-int memory_container_free(struct memory_container_cmd __user *user_cmd)
+int memory_container_free(const struct memory_container_cmd *cmd)
 {
+    int ret = -EINVAL;
     mutex_lock(&my_mutex);
-    struct memory_container_cmd temp_cmd;
-    copy_from_user(&temp_cmd, user_cmd, sizeof(struct memory_container_cmd));
     //Setting calling thread's associated pid
     int pid = current->pid;
     //Getting oid
-    unsigned long long int oid = temp_cmd.oid;
+    unsigned long long int oid = cmd->oid;
     //Finding corresponding container from pid
     struct container *temp_container;
     temp_container = findcontainer(pid);
-    struct object *temp_object_list;
 
-    if (temp_container)
-        // printk("\nInside Free : CID -> %llu --- PID -> %d --- OID -> %llu", temp_container->cid, pid, oid);
     //Freeing memory allocated for current oid in current container
     if (temp_container)
     {
-        temp_object_list = temp_container->object_list;
-        if (temp_object_list)
+        ret = -ENOENT;
+        if (findobject(temp_container, oid))
         {
-            temp_object_list = deleteobject(&temp_object_list, oid);
-            temp_container->object_list = temp_object_list;
+            deleteobject(temp_container, oid);
+            notify_object_changed(temp_container, oid, NULL);
+            ret = 0;
             // printk("\nObject Deleted: CID -> %llu --- PID -> %d --- OID: %llu", temp_container->cid, pid, oid);
         }
-        else{
-            // printk("\nObject list empty: CID -> %llu --- PID -> %d --- OID: %llu", temp_container->cid, pid, oid);
-        }
     }
     else{
         // printk("\nContainer with PID -> %d not found", pid);
     }
     mutex_unlock(&my_mutex);
+    return ret;
+}
+
+
+//Make dest, which must be empty and of the same size, share every page
+//obj has, marking them copy-on-write on both sides. Compressed pages are
+//duplicated rather than decompressed.
+//Called with obj->page_lock held; dest is not visible to anyone yet.
+static int object_share_pages(struct object *obj, struct object *dest)
+{
+    unsigned long i;
+
+    if (!obj->cow)
+        obj->cow = object_array_alloc(BITS_TO_LONGS(object_capacity(obj)), sizeof(unsigned long));
+    dest->cow = object_array_alloc(BITS_TO_LONGS(object_capacity(dest)), sizeof(unsigned long));
+    if (!obj->cow || !dest->cow)
+        return -ENOMEM;
+    if (obj->zpages && !dest->zpages)
+    {
+        dest->zpages = object_array_alloc(object_capacity(dest), sizeof(struct object_zpage));
+        if (!dest->zpages)
+            return -ENOMEM;
+    }
+    //Pages neither side has loaded yet are the same in the image
+    if (obj->backing)
+    {
+        dest->backing = get_file(obj->backing);
+        dest->backing_offset = obj->backing_offset;
+        dest->backing_pages = obj->backing_pages;
+    }
+    dest->size = obj->size;
+
+    for (i = 0; i < obj->nr_pages; i++)
+    {
+        if (obj->pages[i])
+        {
+            get_page(obj->pages[i]);
+            dest->pages[i] = obj->pages[i];
+            set_bit(i, obj->cow);
+            set_bit(i, dest->cow);
+            atomic64_inc(&dest->container->resident_pages);
+        }
+        else if (obj->zpages && obj->zpages[i].data)
+        {
+            dest->zpages[i].data = kmemdup(obj->zpages[i].data, obj->zpages[i].len, GFP_MCONTAINER);
+            if (!dest->zpages[i].data)
+                return -ENOMEM;
+            dest->zpages[i].len = obj->zpages[i].len;
+            atomic64_inc(&dest->container->compressed_pages);
+            atomic64_add(dest->zpages[i].len, &dest->container->compressed_bytes);
+        }
+    }
+    return 0;
+}
+
+
+//Move the backing store of obj into dest, which must be empty and of the
+//same number of pages. Called with obj->page_lock held.
+static void object_move_pages(struct object *obj, struct object *dest)
+{
+    struct container *from = obj->container, *to = dest->container;
+    unsigned long i;
+
+    swap(obj->pages, dest->pages);
+    swap(obj->zpages, dest->zpages);
+    swap(obj->cow, dest->cow);
+    swap(obj->backing, dest->backing);
+    swap(obj->backing_offset, dest->backing_offset);
+    swap(obj->backing_pages, dest->backing_pages);
+    swap(obj->size, dest->size);
+    for (i = 0; i < dest->nr_pages; i++)
+    {
+        if (dest->pages[i])
+        {
+            atomic64_dec(&from->resident_pages);
+            atomic64_inc(&to->resident_pages);
+        }
+        else if (dest->zpages && dest->zpages[i].data)
+        {
+            atomic64_dec(&from->compressed_pages);
+            atomic64_sub(dest->zpages[i].len, &from->compressed_bytes);
+            atomic64_inc(&to->compressed_pages);
+            atomic64_add(dest->zpages[i].len, &to->compressed_bytes);
+        }
+    }
+}
+
+
+/**
+ * Hand an object of the caller's container over to container cid without
+ * copying it. The caller's mappings of the object go away; with
+ * MCONTAINER_TRANSFER_ALIAS the caller's container keeps a read-only
+ * snapshot that shares pages with the new owner until either side writes.
+ */
+int memory_container_transfer(const struct memory_container_cmd *cmd)
+{
+    struct container *temp_container, *target_container;
+    struct object *temp_object, *new_object;
+    int pid = current->pid;
+    int ret = 0;
+
+    mutex_lock(&my_mutex);
+    //Only members of the owning container may give an object away
+    temp_container = findcontainer(pid);
+    if (!temp_container)
+    {
+        ret = -EINVAL;
+        goto out;
+    }
+    for (target_container = container_head; target_container; target_container = target_container->next)
+    {
+        if (target_container->cid == cmd->cid)
+            break;
+    }
+    if (!target_container)
+    {
+        ret = -ENOENT;
+        goto out;
+    }
+    if (target_container == temp_container)
+    {
+        ret = -EINVAL;
+        goto out;
+    }
+    temp_object = findobject(temp_container, cmd->oid);
+    if (!temp_object)
+    {
+        ret = -ENOENT;
+        goto out;
+    }
+    //An alias is a snapshot of someone else's object, it is not ours to give
+    if (temp_object->readonly)
+    {
+        ret = -EPERM;
+        goto out;
+    }
+    if (findobject(target_container, cmd->oid))
+    {
+        ret = -EEXIST;
+        goto out;
+    }
+
+    new_object = addobject(&target_container->object_list, target_container, cmd->oid, temp_object->nr_pages);
+    if (!new_object)
+    {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    mutex_lock(&temp_object->page_lock);
+    //Nobody in our container may keep writing to pages that are now theirs
+    object_zap(temp_object);
+    if (cmd->op & MCONTAINER_TRANSFER_ALIAS)
+    {
+        ret = object_share_pages(temp_object, new_object);
+        if (!ret)
+            temp_object->readonly = 1;
+    }
+    else
+    {
+        object_move_pages(temp_object, new_object);
+    }
+    mutex_unlock(&temp_object->page_lock);
+
+    if (ret)
+    {
+        deleteobject(target_container, cmd->oid);
+        goto out;
+    }
+    notify_object_changed(target_container, cmd->oid, new_object);
+    if (!(cmd->op & MCONTAINER_TRANSFER_ALIAS))
+    {
+        deleteobject(temp_container, cmd->oid);
+        notify_object_changed(temp_container, cmd->oid, NULL);
+    }
+    else
+    {
+        //The alias is read-only now, which its metadata slot shows
+        notify_object_changed(temp_container, cmd->oid, temp_object);
+    }
+out:
+    mutex_unlock(&my_mutex);
+    return ret;
+}
+
+
+/**
+ * Seal object oid of the caller's container: it becomes read-only for
+ * every task for good. Mappings made before are torn down, so writes
+ * through them fault and fail; later mappings are read-only, and locking
+ * the object fails with -EROFS, so readers need no locks. Objects whose
+ * lock is held cannot be sealed.
+ */
+int memory_container_seal(const struct memory_container_cmd *cmd)
+{
+    struct container *temp_container;
+    struct object *temp_object = NULL;
+    int ret = 0;
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (temp_container)
+        temp_object = findobject(temp_container, cmd->oid);
+    if (!temp_container)
+    {
+        ret = -EINVAL;
+        goto out;
+    }
+    if (!temp_object)
+    {
+        ret = -ENOENT;
+        goto out;
+    }
+
+    mutex_lock(&temp_container->lock_table_lock);
+    if (object_lock_held(temp_container, cmd->oid))
+    {
+        ret = -EBUSY;
+    }
+    else
+    {
+        mutex_lock(&temp_object->page_lock);
+        temp_object->readonly = 1;
+        object_zap(temp_object);
+        mutex_unlock(&temp_object->page_lock);
+    }
+    mutex_unlock(&temp_container->lock_table_lock);
+    if (!ret)
+        notify_object_changed(temp_container, cmd->oid, temp_object);
+out:
+    mutex_unlock(&my_mutex);
+    return ret;
+}
+
+
+//Fields of struct memory_container_cmd a handler reads
+#define CMD_OP 0x1
+#define CMD_CID 0x2
+#define CMD_OID 0x4
+
+//One ioctl. Handlers of struct memory_container_cmd get the fields they
+//read already in the kernel; the others get the user pointer. stat is the
+//counter the call bumps, -1 for the ones that count themselves.
+struct mcontainer_ioctl{
+    unsigned int cmd;
+    int stat;
+    unsigned int fields;
+    int (*cmd_fn)(const struct memory_container_cmd *cmd);
+    int (*file_fn)(struct file *filp, const struct memory_container_cmd *cmd);
+    int (*user_fn)(void __user *arg);
+};
+
+#define IOCTL_SLOT(cmd) (_IOC_NR(cmd) - _IOC_NR(MCONTAINER_IOCTL_DELETE))
+
+#define IOCTL_CMD(ioctl, item, f, fn) \
+    [IOCTL_SLOT(ioctl)] = { .cmd = ioctl, .stat = item, .fields = f, .cmd_fn = fn }
+#define IOCTL_FILE(ioctl, item, f, fn) \
+    [IOCTL_SLOT(ioctl)] = { .cmd = ioctl, .stat = item, .fields = f, .file_fn = fn }
+#define IOCTL_USER(ioctl, item, fn) \
+    [IOCTL_SLOT(ioctl)] = { .cmd = ioctl, .stat = item, .user_fn = fn##_user }
+
+//Handlers of other argument structures take a pointer of their own type
+#define IOCTL_USER_FN(fn, type) \
+    static int fn##_user(void __user *arg) { return fn((type __user *)arg); }
+
+IOCTL_USER_FN(memory_container_reclaim_stats, struct memory_container_reclaim_stats)
+IOCTL_USER_FN(memory_container_lock_many, struct memory_container_lock_many)
+IOCTL_USER_FN(memory_container_unlock_many, struct memory_container_lock_many)
+IOCTL_USER_FN(memory_container_size, struct memory_container_size)
+IOCTL_USER_FN(memory_container_resize, struct memory_container_size)
+IOCTL_USER_FN(memory_container_stats, struct memory_container_stats)
+IOCTL_USER_FN(memory_container_enumerate, struct memory_container_enumerate)
+IOCTL_USER_FN(memory_container_dedup_stats, struct memory_container_dedup_stats)
+IOCTL_USER_FN(memory_container_barrier, struct memory_container_sync)
+IOCTL_USER_FN(memory_container_cond_wait, struct memory_container_sync)
+IOCTL_USER_FN(memory_container_cond_signal, struct memory_container_sync)
+
+static const struct mcontainer_ioctl mcontainer_ioctls[] = {
+    IOCTL_CMD(MCONTAINER_IOCTL_DELETE, MCONTAINER_STAT_DELETE, 0, memory_container_delete),
+    IOCTL_CMD(MCONTAINER_IOCTL_CREATE, MCONTAINER_STAT_CREATE, CMD_CID, memory_container_create),
+    IOCTL_CMD(MCONTAINER_IOCTL_LOCK, -1, CMD_OID, memory_container_lock),
+    IOCTL_CMD(MCONTAINER_IOCTL_UNLOCK, -1, CMD_OID, memory_container_unlock),
+    IOCTL_CMD(MCONTAINER_IOCTL_FREE, MCONTAINER_STAT_FREE, CMD_OID, memory_container_free),
+    IOCTL_CMD(MCONTAINER_IOCTL_RECLAIM, MCONTAINER_STAT_OTHER, CMD_OP, memory_container_reclaim),
+    IOCTL_USER(MCONTAINER_IOCTL_RECLAIM_STATS, MCONTAINER_STAT_OTHER, memory_container_reclaim_stats),
+    IOCTL_CMD(MCONTAINER_IOCTL_TRANSFER, MCONTAINER_STAT_TRANSFER, CMD_OP | CMD_CID | CMD_OID,
+              memory_container_transfer),
+    IOCTL_CMD(MCONTAINER_IOCTL_EXPORT, MCONTAINER_STAT_OTHER, CMD_OID, memory_container_export),
+    IOCTL_CMD(MCONTAINER_IOCTL_SAVE, MCONTAINER_STAT_OTHER, CMD_OP, memory_container_save),
+    IOCTL_CMD(MCONTAINER_IOCTL_RESTORE, MCONTAINER_STAT_OTHER, CMD_OP, memory_container_restore),
+    IOCTL_FILE(MCONTAINER_IOCTL_WATCH, MCONTAINER_STAT_OTHER, CMD_OP | CMD_OID, memory_container_watch),
+    IOCTL_USER(MCONTAINER_IOCTL_LOCK_MANY, -1, memory_container_lock_many),
+    IOCTL_USER(MCONTAINER_IOCTL_UNLOCK_MANY, -1, memory_container_unlock_many),
+    IOCTL_USER(MCONTAINER_IOCTL_SIZE, MCONTAINER_STAT_OTHER, memory_container_size),
+    IOCTL_USER(MCONTAINER_IOCTL_RESIZE, MCONTAINER_STAT_RESIZE, memory_container_resize),
+    IOCTL_USER(MCONTAINER_IOCTL_STATS, MCONTAINER_STAT_OTHER, memory_container_stats),
+    IOCTL_CMD(MCONTAINER_IOCTL_SEAL, MCONTAINER_STAT_OTHER, CMD_OID, memory_container_seal),
+    IOCTL_CMD(MCONTAINER_IOCTL_DESTROY, MCONTAINER_STAT_DELETE, 0, memory_container_destroy),
+    IOCTL_CMD(MCONTAINER_IOCTL_FREE_RANGE, MCONTAINER_STAT_FREE, CMD_OP | CMD_OID, memory_container_free_range),
+    IOCTL_USER(MCONTAINER_IOCTL_ENUMERATE, MCONTAINER_STAT_OTHER, memory_container_enumerate),
+    IOCTL_CMD(MCONTAINER_IOCTL_DEDUP, MCONTAINER_STAT_OTHER, CMD_OP, memory_container_dedup),
+    IOCTL_USER(MCONTAINER_IOCTL_DEDUP_STATS, MCONTAINER_STAT_OTHER, memory_container_dedup_stats),
+    IOCTL_USER(MCONTAINER_IOCTL_BARRIER, MCONTAINER_STAT_OTHER, memory_container_barrier),
+    IOCTL_USER(MCONTAINER_IOCTL_COND_WAIT, MCONTAINER_STAT_OTHER, memory_container_cond_wait),
+    IOCTL_USER(MCONTAINER_IOCTL_COND_SIGNAL, MCONTAINER_STAT_OTHER, memory_container_cond_signal),
+};
+
+
+//Read just the fields a handler uses. Nothing is locked yet, so a fault
+//on the argument never holds anybody else up.
+static int ioctl_read_cmd(struct memory_container_cmd __user *user_cmd, unsigned int fields,
+                          struct memory_container_cmd *cmd)
+{
+    cmd->op = 0;
+    cmd->cid = 0;
+    cmd->oid = 0;
+    if ((fields & CMD_OP) && get_user(cmd->op, &user_cmd->op))
+        return -EFAULT;
+    if ((fields & CMD_CID) && get_user(cmd->cid, &user_cmd->cid))
+        return -EFAULT;
+    if ((fields & CMD_OID) && get_user(cmd->oid, &user_cmd->oid))
+        return -EFAULT;
     return 0;
 }
 
@@ -578,22 +1158,29 @@ int memory_container_free(struct memory_container_cmd __user *user_cmd)
  * control function that receive the command in user space and pass arguments to
  * corresponding functions.
  */
-int memory_container_ioctl(struct file *filp, unsigned int cmd,
-                              unsigned long arg)
-{
-    switch (cmd)
-    {
-    case MCONTAINER_IOCTL_CREATE:
-        return memory_container_create((void __user *)arg);
-    case MCONTAINER_IOCTL_DELETE:
-        return memory_container_delete((void __user *)arg);
-    case MCONTAINER_IOCTL_LOCK:
-        return memory_container_lock((void __user *)arg);
-    case MCONTAINER_IOCTL_UNLOCK:
-        return memory_container_unlock((void __user *)arg);
-    case MCONTAINER_IOCTL_FREE:
-        return memory_container_free((void __user *)arg);
-    default:
+long memory_container_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    const struct mcontainer_ioctl *entry;
+    struct memory_container_cmd temp_cmd;
+    unsigned int slot = IOCTL_SLOT(cmd);
+    int ret;
+
+    //The whole number has to match, size and direction included
+    if (_IOC_TYPE(cmd) != _IOC_TYPE(MCONTAINER_IOCTL_DELETE) || slot >= ARRAY_SIZE(mcontainer_ioctls) ||
+        mcontainer_ioctls[slot].cmd != cmd)
+    {
+        mcontainer_stat_inc(MCONTAINER_STAT_OTHER);
         return -ENOTTY;
     }
+    entry = &mcontainer_ioctls[slot];
+    if (entry->stat >= 0)
+        mcontainer_stat_inc(entry->stat);
+    if (entry->user_fn)
+        return entry->user_fn((void __user *)arg);
+    ret = ioctl_read_cmd((struct memory_container_cmd __user *)arg, entry->fields, &temp_cmd);
+    if (ret)
+        return ret;
+    if (entry->file_fn)
+        return entry->file_fn(filp, &temp_cmd);
+    return entry->cmd_fn(&temp_cmd);
 }
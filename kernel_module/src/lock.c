@@ -0,0 +1,565 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Per-Object Locks and Taking Several of Them at Once
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "memory_container_internal.h"
+
+#include <asm/uaccess.h>
+#include <linux/slab.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/sort.h>
+#include <linux/wait.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+
+//Hand free locks to the most urgent waiter, by nice or real-time priority,
+//rather than to whichever waiter or newcomer gets there first
+static bool lock_priority;
+module_param(lock_priority, bool, 0644);
+MODULE_PARM_DESC(lock_priority, "Object locks go to their most urgent waiter first");
+
+static struct object_lock ** lock_bucket(struct container *owner, unsigned long long int oid)
+{
+    return &owner->lock_table[oid % OBJECT_LOCK_BUCKETS];
+}
+
+
+//Called with lock_table_lock held
+static struct object_lock * lock_find(struct container *owner, unsigned long long int oid)
+{
+    struct object_lock *temp_lock;
+
+    for (temp_lock = *lock_bucket(owner, oid); temp_lock; temp_lock = temp_lock->next)
+    {
+        if (temp_lock->oid == oid)
+            return temp_lock;
+    }
+    return NULL;
+}
+
+
+//Called with lock_table_lock held
+static struct object_lock * lock_find_or_add(struct container *owner, unsigned long long int oid)
+{
+    struct object_lock *temp_lock = lock_find(owner, oid);
+
+    if (temp_lock)
+        return temp_lock;
+    temp_lock = kmalloc(sizeof(struct object_lock), GFP_KERNEL);
+    if (temp_lock == NULL)
+        return NULL;
+    temp_lock->oid = oid;
+    temp_lock->holder = 0;
+    temp_lock->waiters = 0;
+    temp_lock->wakeups = 0;
+    temp_lock->waiter_list = NULL;
+    init_waitqueue_head(&temp_lock->wait);
+    temp_lock->next = *lock_bucket(owner, oid);
+    *lock_bucket(owner, oid) = temp_lock;
+    return temp_lock;
+}
+
+
+//Drop the entry once nobody holds or waits for it.
+//Called with lock_table_lock held.
+static void lock_release_entry(struct container *owner, struct object_lock *victim)
+{
+    struct object_lock **link;
+
+    if (victim->holder || victim->waiters)
+        return;
+    for (link = lock_bucket(owner, victim->oid); *link; link = &(*link)->next)
+    {
+        if (*link == victim)
+        {
+            *link = victim->next;
+            kfree(victim);
+            return;
+        }
+    }
+}
+
+
+//Wake everyone waiting for a lock to look at it again.
+//Called with lock_table_lock held.
+static void lock_wake(struct object_lock *temp_lock)
+{
+    temp_lock->wakeups++;
+    wake_up_interruptible(&temp_lock->wait);
+}
+
+
+//Called with lock_table_lock held
+static void lock_waiter_add(struct object_lock *temp_lock, struct lock_waiter *waiter)
+{
+    struct lock_waiter **link;
+
+    for (link = &temp_lock->waiter_list; *link && (*link)->prio <= waiter->prio; link = &(*link)->next)
+        ;
+    waiter->next = *link;
+    *link = waiter;
+}
+
+
+//Called with lock_table_lock held
+static void lock_waiter_remove(struct object_lock *temp_lock, struct lock_waiter *waiter)
+{
+    struct lock_waiter **link;
+
+    for (link = &temp_lock->waiter_list; *link; link = &(*link)->next)
+    {
+        if (*link == waiter)
+        {
+            *link = waiter->next;
+            return;
+        }
+    }
+}
+
+
+//Whether a lock keeps a task of priority prio waiting: it is held or, in
+//priority mode, a more urgent task waits for it.
+//Called with lock_table_lock held.
+static int lock_busy(struct object_lock *temp_lock, int prio)
+{
+    if (temp_lock->holder)
+        return 1;
+    return READ_ONCE(lock_priority) && temp_lock->waiter_list && temp_lock->waiter_list->prio < prio;
+}
+
+
+//Stop waiting for a lock, which less urgent waiters may be standing back
+//from for our sake. Called with lock_table_lock held.
+static void lock_give_way(struct container *owner, struct object_lock *temp_lock)
+{
+    if (READ_ONCE(lock_priority) && !temp_lock->holder && temp_lock->waiters)
+        lock_wake(temp_lock);
+    lock_release_entry(owner, temp_lock);
+}
+
+
+//Whether some task holds the lock of oid. Called with lock_table_lock held.
+int object_lock_held(struct container *owner, unsigned long long int oid)
+{
+    struct object_lock *temp_lock = lock_find(owner, oid);
+    return temp_lock && temp_lock->holder;
+}
+
+
+//The task holding the lock of oid, 0 if none.
+//Called with lock_table_lock held.
+pid_t object_lock_holder(struct container *owner, unsigned long long int oid)
+{
+    struct object_lock *temp_lock = lock_find(owner, oid);
+    return temp_lock ? temp_lock->holder : 0;
+}
+
+
+//Take the locks of all of oids, which are sorted and distinct, or none of
+//them. A task never holds some while waiting for others, so no set of
+//callers can deadlock, whatever order they ask in.
+static int lock_acquire(struct container *owner, unsigned long long int *oids, int nr, unsigned int flags)
+{
+    struct object_lock *busy, *waited = NULL;
+    struct lock_waiter waiter;
+    unsigned int wakeups;
+    int i, ret = 0;
+
+    //Lower is more urgent, real-time tasks before all others
+    waiter.prio = current->prio;
+
+    mutex_lock(&owner->lock_table_lock);
+    for (;;)
+    {
+        //The container was destroyed, maybe while we waited
+        if (READ_ONCE(owner->flags) & CONTAINER_DEAD)
+            ret = -EINVAL;
+        busy = NULL;
+        for (i = 0; i < nr && !busy && !ret; i++)
+        {
+            struct object_lock *temp_lock = lock_find(owner, oids[i]);
+            if (temp_lock && lock_busy(temp_lock, waiter.prio))
+                busy = temp_lock;
+        }
+        //lock_table_lock was held since we woke, so nobody who stood back
+        //for us got in before this look
+        if (waited && waited != busy)
+            lock_give_way(owner, waited);
+        waited = NULL;
+        if (ret)
+        {
+            mutex_unlock(&owner->lock_table_lock);
+            return ret;
+        }
+        if (!busy)
+            break;
+        mcontainer_stat_inc(MCONTAINER_STAT_LOCK_CONTENDED);
+        if (busy->holder == current->pid)
+        {
+            mutex_unlock(&owner->lock_table_lock);
+            return -EDEADLK;
+        }
+        if (flags & MCONTAINER_LOCK_TRY)
+        {
+            mutex_unlock(&owner->lock_table_lock);
+            return -EBUSY;
+        }
+        //Wait for the first lock in the way, then look at all of them again
+        busy->waiters++;
+        lock_waiter_add(busy, &waiter);
+        wakeups = busy->wakeups;
+        mutex_unlock(&owner->lock_table_lock);
+        ret = wait_event_interruptible(busy->wait, READ_ONCE(busy->wakeups) != wakeups);
+        mutex_lock(&owner->lock_table_lock);
+        lock_waiter_remove(busy, &waiter);
+        busy->waiters--;
+        waited = busy;
+    }
+
+    for (i = 0; i < nr; i++)
+    {
+        struct object_lock *temp_lock = lock_find_or_add(owner, oids[i]);
+        if (temp_lock == NULL)
+        {
+            while (i--)
+            {
+                temp_lock = lock_find(owner, oids[i]);
+                temp_lock->holder = 0;
+                lock_release_entry(owner, temp_lock);
+            }
+            mutex_unlock(&owner->lock_table_lock);
+            return -ENOMEM;
+        }
+        temp_lock->holder = current->pid;
+    }
+    for (i = 0; i < nr; i++)
+        notify_object_seq(owner, oids[i]);
+    mutex_unlock(&owner->lock_table_lock);
+    mcontainer_stat_add(MCONTAINER_STAT_LOCK, nr);
+    return 0;
+}
+
+
+//Take the lock of oid for the caller, waiting for it if need be
+int object_lock(struct container *owner, unsigned long long int oid)
+{
+    return lock_acquire(owner, &oid, 1, 0);
+}
+
+
+//Release the lock of oid if the caller holds it, or return -EPERM.
+//Called with lock_table_lock held.
+int object_unlock_held(struct container *owner, unsigned long long int oid)
+{
+    struct object_lock *temp_lock = lock_find(owner, oid);
+
+    if (!temp_lock || temp_lock->holder != current->pid)
+        return -EPERM;
+    temp_lock->holder = 0;
+    notify_object_seq(owner, oid);
+    if (temp_lock->waiters)
+        lock_wake(temp_lock);
+    else
+        lock_release_entry(owner, temp_lock);
+    return 0;
+}
+
+
+//Release the locks of oids the caller holds, waking whoever waits for
+//them. Returns -EPERM if it held none of them.
+static int lock_release(struct container *owner, unsigned long long int *oids, int nr)
+{
+    int i, released = 0;
+
+    mutex_lock(&owner->lock_table_lock);
+    for (i = 0; i < nr; i++)
+    {
+        if (!object_unlock_held(owner, oids[i]))
+            released++;
+    }
+    mutex_unlock(&owner->lock_table_lock);
+    mcontainer_stat_add(MCONTAINER_STAT_UNLOCK, released);
+    return released ? 0 : -EPERM;
+}
+
+
+//Drop every lock of a destroyed container and wake whoever waits, to find
+//it dead. Called with my_mutex held.
+void lock_release_all(struct container *owner)
+{
+    struct object_lock *temp_lock, *next;
+    int i;
+
+    mutex_lock(&owner->lock_table_lock);
+    for (i = 0; i < OBJECT_LOCK_BUCKETS; i++)
+    {
+        for (temp_lock = owner->lock_table[i]; temp_lock; temp_lock = next)
+        {
+            next = temp_lock->next;
+            if (temp_lock->holder)
+                notify_object_seq(owner, temp_lock->oid);
+            temp_lock->holder = 0;
+            if (temp_lock->waiters)
+                lock_wake(temp_lock);
+            else
+                lock_release_entry(owner, temp_lock);
+        }
+    }
+    mutex_unlock(&owner->lock_table_lock);
+}
+
+
+//Tell watchers the objects whose locks were just released may have changed
+void lock_notify(struct container *owner, unsigned long long int *oids, int nr)
+{
+    struct object *temp_object;
+    int i;
+
+    mutex_lock(&my_mutex);
+    for (i = 0; i < nr; i++)
+    {
+        temp_object = findobject(owner, oids[i]);
+        if (temp_object)
+            notify_object_changed(owner, oids[i], temp_object);
+    }
+    mutex_unlock(&my_mutex);
+}
+
+
+//Leave read-only objects out of a batch: they are never written, so
+//locking and unlocking them does nothing. Returns how many oids are left.
+//Called with my_mutex held.
+static int lock_skip_readonly(struct container *owner, unsigned long long int *oids, int nr)
+{
+    struct object *temp_object;
+    int i, left = 0;
+
+    for (i = 0; i < nr; i++)
+    {
+        temp_object = findobject(owner, oids[i]);
+        if (!temp_object || !READ_ONCE(temp_object->readonly))
+            oids[left++] = oids[i];
+    }
+    return left;
+}
+
+
+//Find the caller's container for locking oids, marking them as used for
+//the shrinker's sake, and take a reference to it. A read-only object is
+//never written, so locking it alone fails with -EROFS, while batches
+//just leave it out and *nr says how many oids are left.
+static int lock_container(unsigned long long int *oids, int *nr, int batch, struct container **owner)
+{
+    struct container *temp_container;
+    struct object *temp_object;
+    int i, ret = 0;
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (!temp_container)
+        ret = -EINVAL;
+    if (temp_container && batch)
+        *nr = lock_skip_readonly(temp_container, oids, *nr);
+    for (i = 0; temp_container && i < *nr; i++)
+    {
+        temp_object = findobject(temp_container, oids[i]);
+        if (!temp_object)
+            continue;
+        temp_object->last_access = jiffies;
+        if (READ_ONCE(temp_object->readonly))
+            ret = -EROFS;
+    }
+    if (!ret)
+        container_get(temp_container);
+    mutex_unlock(&my_mutex);
+    *owner = temp_container;
+    return ret;
+}
+
+
+//Unlocking what could not have been locked because it is read-only
+static int unlock_readonly(struct container *owner, unsigned long long int *oids, int nr)
+{
+    struct object *temp_object;
+    int i, ret = -EPERM;
+
+    mutex_lock(&my_mutex);
+    for (i = 0; i < nr && ret == -EPERM; i++)
+    {
+        temp_object = findobject(owner, oids[i]);
+        if (temp_object && READ_ONCE(temp_object->readonly))
+            ret = -EROFS;
+    }
+    mutex_unlock(&my_mutex);
+    return ret;
+}
+
+
+int memory_container_lock(const struct memory_container_cmd *cmd)
+{
+    struct container *temp_container;
+    unsigned long long int oid;
+    int nr = 1, ret;
+
+    oid = cmd->oid;
+    ret = lock_container(&oid, &nr, 0, &temp_container);
+    if (ret)
+        return ret;
+    ret = lock_acquire(temp_container, &oid, 1, 0);
+    container_put(temp_container);
+    return ret;
+}
+
+
+int memory_container_unlock(const struct memory_container_cmd *cmd)
+{
+    struct container *temp_container;
+    unsigned long long int oid;
+    int ret;
+
+    oid = cmd->oid;
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (temp_container)
+        container_get(temp_container);
+    mutex_unlock(&my_mutex);
+    if (!temp_container)
+        return -EINVAL;
+    ret = lock_release(temp_container, &oid, 1);
+    //Whoever held the lock may have changed the object
+    if (!ret)
+        lock_notify(temp_container, &oid, 1);
+    else
+        ret = unlock_readonly(temp_container, &oid, 1);
+    container_put(temp_container);
+    return ret;
+}
+
+
+static int compare_oid(const void *a, const void *b)
+{
+    unsigned long long int x = *(const unsigned long long int *)a, y = *(const unsigned long long int *)b;
+    return x < y ? -1 : x > y;
+}
+
+
+//Copy in the oids of a request, sorted and without duplicates
+static int lock_many_copy(struct memory_container_lock_many __user *user_req, unsigned long long int **oids,
+                          unsigned int *flags)
+{
+    struct memory_container_lock_many temp_req;
+    unsigned long long int *temp_oids;
+    int i, nr = 0;
+
+    if (copy_from_user(&temp_req, user_req, sizeof(struct memory_container_lock_many)))
+        return -EFAULT;
+    if (temp_req.nr == 0 || temp_req.nr > MCONTAINER_LOCK_MANY_MAX)
+        return -EINVAL;
+    temp_oids = kmalloc_array(temp_req.nr, sizeof(unsigned long long int), GFP_KERNEL);
+    if (temp_oids == NULL)
+        return -ENOMEM;
+    if (copy_from_user(temp_oids, (void __user *)(unsigned long)temp_req.oids,
+                       temp_req.nr * sizeof(unsigned long long int)))
+    {
+        kfree(temp_oids);
+        return -EFAULT;
+    }
+    sort(temp_oids, temp_req.nr, sizeof(unsigned long long int), compare_oid, NULL);
+    for (i = 0; i < temp_req.nr; i++)
+    {
+        if (nr == 0 || temp_oids[nr - 1] != temp_oids[i])
+            temp_oids[nr++] = temp_oids[i];
+    }
+    *oids = temp_oids;
+    *flags = temp_req.flags;
+    return nr;
+}
+
+
+/**
+ * Lock up to MCONTAINER_LOCK_MANY_MAX objects of the caller's container
+ * at once: either all of them are taken or, on error, none is. Read-only
+ * objects are left out, as they need no lock.
+ */
+int memory_container_lock_many(struct memory_container_lock_many __user *user_req)
+{
+    struct container *temp_container;
+    unsigned long long int *oids;
+    unsigned int flags;
+    int nr, ret;
+
+    nr = lock_many_copy(user_req, &oids, &flags);
+    if (nr < 0)
+        return nr;
+    ret = lock_container(oids, &nr, 1, &temp_container);
+    if (!ret)
+    {
+        if (nr)
+            ret = lock_acquire(temp_container, oids, nr, flags);
+        container_put(temp_container);
+    }
+    kfree(oids);
+    return ret;
+}
+
+
+int memory_container_unlock_many(struct memory_container_lock_many __user *user_req)
+{
+    struct container *temp_container;
+    unsigned long long int *oids;
+    unsigned int flags;
+    int nr, ret = -EINVAL;
+
+    nr = lock_many_copy(user_req, &oids, &flags);
+    if (nr < 0)
+        return nr;
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (temp_container)
+    {
+        container_get(temp_container);
+        nr = lock_skip_readonly(temp_container, oids, nr);
+    }
+    mutex_unlock(&my_mutex);
+    if (temp_container)
+    {
+        ret = 0;
+        if (nr)
+            ret = lock_release(temp_container, oids, nr);
+        if (!ret && nr)
+            lock_notify(temp_container, oids, nr);
+        container_put(temp_container);
+    }
+    kfree(oids);
+    return ret;
+}
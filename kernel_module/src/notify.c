@@ -0,0 +1,431 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Object Generations, the Metadata Pages and Change Notification
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "memory_container_internal.h"
+
+#include <asm/uaccess.h>
+#include <linux/slab.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+
+#define META_SLOTS_PER_PAGE (PAGE_SIZE / sizeof(struct memory_container_meta))
+
+//An oid somebody is waiting on through this file, and the generation they
+//have last been told about
+struct watch{
+    unsigned long long int oid;
+    __u64 seen;
+    struct watch *next;
+};
+
+//Per open file state. All watches of a file are in the same container.
+struct watcher{
+    struct mutex lock;
+    struct container *container;
+    struct watch *watch_list;
+};
+
+
+static struct memory_container_meta * meta_slot(struct container *owner, unsigned long long int oid)
+{
+    struct memory_container_meta *slots;
+
+    if (!owner->meta_pages || oid >= MCONTAINER_META_SLOTS)
+        return NULL;
+    slots = page_address(owner->meta_pages[oid / META_SLOTS_PER_PAGE]);
+    return &slots[oid % META_SLOTS_PER_PAGE];
+}
+
+
+//Publish a new generation of oid and wake everyone polling the container.
+//obj is NULL once the object has been freed. Called with my_mutex held.
+void notify_object_changed(struct container *owner, unsigned long long int oid, struct object *obj)
+{
+    struct memory_container_meta *slot = meta_slot(owner, oid);
+    __u64 generation = 0;
+
+    if (obj)
+    {
+        generation = atomic64_inc_return(&owner->generation_counter);
+        obj->generation = generation;
+    }
+    if (slot)
+    {
+        WRITE_ONCE(slot->flags, obj && obj->readonly ? MCONTAINER_META_SEALED : 0);
+        WRITE_ONCE(slot->generation, generation);
+    }
+    atomic64_inc(&owner->generation_changes);
+    wake_up_interruptible(&owner->generation_wait);
+}
+
+
+//Move the sequence count of oid on by one, around the writes the lock
+//holder makes to the object. Called with lock_table_lock held.
+void notify_object_seq(struct container *owner, unsigned long long int oid)
+{
+    struct memory_container_meta *slot = meta_slot(owner, oid);
+
+    if (!slot)
+        return;
+    smp_wmb();
+    WRITE_ONCE(slot->seq, slot->seq + 1);
+    smp_wmb();
+}
+
+
+//The metadata pages are only allocated once somebody maps them.
+//Called with my_mutex held.
+static int meta_alloc(struct container *owner)
+{
+    struct page **pages;
+    struct object *temp_object;
+    struct object_lock *temp_lock;
+    struct memory_container_meta *slot;
+    int i;
+
+    if (owner->meta_pages)
+        return 0;
+    pages = kcalloc(MCONTAINER_META_PAGES, sizeof(struct page *), GFP_KERNEL);
+    if (!pages)
+        return -ENOMEM;
+    for (i = 0; i < MCONTAINER_META_PAGES; i++)
+    {
+        pages[i] = alloc_page(GFP_MCONTAINER | __GFP_ZERO);
+        if (!pages[i])
+        {
+            while (i--)
+                __free_page(pages[i]);
+            kfree(pages);
+            return -ENOMEM;
+        }
+    }
+    //Publish the pages with the locks held now marked as such, so lock and
+    //unlock keep seq odd exactly while the lock is held
+    mutex_lock(&owner->lock_table_lock);
+    owner->meta_pages = pages;
+    for (temp_object = owner->object_list; temp_object; temp_object = temp_object->next)
+    {
+        slot = meta_slot(owner, temp_object->oid);
+        if (slot)
+        {
+            slot->generation = temp_object->generation;
+            slot->flags = temp_object->readonly ? MCONTAINER_META_SEALED : 0;
+        }
+    }
+    for (i = 0; i < OBJECT_LOCK_BUCKETS; i++)
+    {
+        for (temp_lock = owner->lock_table[i]; temp_lock; temp_lock = temp_lock->next)
+        {
+            slot = meta_slot(owner, temp_lock->oid);
+            if (slot && temp_lock->holder)
+                slot->seq = 1;
+        }
+    }
+    mutex_unlock(&owner->lock_table_lock);
+    return 0;
+}
+
+
+static int meta_vm_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+    struct container *owner = vma->vm_private_data;
+    unsigned long index = vmf->pgoff - MCONTAINER_META_OID;
+    struct page *page;
+
+    if (index >= MCONTAINER_META_PAGES)
+        return VM_FAULT_SIGBUS;
+    page = owner->meta_pages[index];
+    get_page(page);
+    vmf->page = page;
+    return 0;
+}
+
+
+static void meta_vm_open(struct vm_area_struct *vma)
+{
+    container_get(vma->vm_private_data);
+}
+
+
+static void meta_vm_close(struct vm_area_struct *vma)
+{
+    container_put(vma->vm_private_data);
+}
+
+
+static const struct vm_operations_struct meta_vm_ops = {
+    .open   = meta_vm_open,
+    .close  = meta_vm_close,
+    .fault  = meta_vm_fault,
+};
+
+
+//Map the metadata pages of a container, read-only.
+//Called with my_mutex held.
+int notify_mmap_meta(struct container *owner, struct vm_area_struct *vma)
+{
+    int ret;
+
+    if (vma->vm_pgoff != MCONTAINER_META_OID || vma_pages(vma) > MCONTAINER_META_PAGES)
+        return -EINVAL;
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    ret = meta_alloc(owner);
+    if (ret)
+        return ret;
+    vma->vm_flags &= ~VM_MAYWRITE;
+    vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+    container_get(owner);
+    vma->vm_private_data = owner;
+    vma->vm_ops = &meta_vm_ops;
+    return 0;
+}
+
+
+//Called once the last reference to the container is gone
+void notify_free_meta(struct container *owner)
+{
+    int i;
+
+    if (!owner->meta_pages)
+        return;
+    for (i = 0; i < MCONTAINER_META_PAGES; i++)
+        __free_page(owner->meta_pages[i]);
+    kfree(owner->meta_pages);
+}
+
+
+static __u64 current_generation(struct container *owner, unsigned long long int oid)
+{
+    struct object *temp_object = findobject(owner, oid);
+    return temp_object ? temp_object->generation : 0;
+}
+
+
+//Move up to max changed watches of w into events, marking them seen
+static int watcher_collect(struct watcher *w, struct memory_container_event *events, int max)
+{
+    struct watch *temp_watch;
+    __u64 generation;
+    int n = 0;
+
+    mutex_lock(&my_mutex);
+    for (temp_watch = w->watch_list; temp_watch && n < max; temp_watch = temp_watch->next)
+    {
+        generation = current_generation(w->container, temp_watch->oid);
+        if (generation == temp_watch->seen)
+            continue;
+        temp_watch->seen = generation;
+        if (events)
+        {
+            events[n].oid = temp_watch->oid;
+            events[n].generation = generation;
+        }
+        n++;
+    }
+    mutex_unlock(&my_mutex);
+    return n;
+}
+
+
+static int watcher_pending(struct watcher *w)
+{
+    struct watch *temp_watch;
+    int pending = 0;
+
+    mutex_lock(&my_mutex);
+    for (temp_watch = w->watch_list; temp_watch && !pending; temp_watch = temp_watch->next)
+        pending = current_generation(w->container, temp_watch->oid) != temp_watch->seen;
+    mutex_unlock(&my_mutex);
+    return pending;
+}
+
+
+int memory_container_open(struct inode *inode, struct file *filp)
+{
+    struct watcher *w = kmalloc(sizeof(struct watcher), GFP_KERNEL);
+
+    if (!w)
+        return -ENOMEM;
+    mutex_init(&w->lock);
+    w->container = NULL;
+    w->watch_list = NULL;
+    filp->private_data = w;
+    return 0;
+}
+
+
+int memory_container_release(struct inode *inode, struct file *filp)
+{
+    struct watcher *w = filp->private_data;
+    struct watch *temp_watch;
+
+    while (w->watch_list)
+    {
+        temp_watch = w->watch_list;
+        w->watch_list = temp_watch->next;
+        kfree(temp_watch);
+    }
+    if (w->container)
+        container_put(w->container);
+    kfree(w);
+    return 0;
+}
+
+
+unsigned int memory_container_poll(struct file *filp, poll_table *wait)
+{
+    struct watcher *w = filp->private_data;
+    unsigned int mask = 0;
+
+    mutex_lock(&w->lock);
+    if (w->container)
+    {
+        poll_wait(filp, &w->container->generation_wait, wait);
+        if (watcher_pending(w))
+            mask = POLLIN | POLLRDNORM;
+    }
+    mutex_unlock(&w->lock);
+    return mask;
+}
+
+
+/**
+ * Reading the device returns a struct memory_container_event for every
+ * watched object that changed since it was last reported, blocking until
+ * there is at least one unless the file is non-blocking.
+ */
+ssize_t memory_container_read(struct file *filp, char __user *buf, size_t len, loff_t *ppos)
+{
+    struct watcher *w = filp->private_data;
+    struct memory_container_event *events;
+    int max = len / sizeof(struct memory_container_event);
+    int n = 0, ret;
+
+    if (max == 0)
+        return -EINVAL;
+    if (max > PAGE_SIZE / sizeof(struct memory_container_event))
+        max = PAGE_SIZE / sizeof(struct memory_container_event);
+    events = kmalloc(max * sizeof(struct memory_container_event), GFP_KERNEL);
+    if (!events)
+        return -ENOMEM;
+
+    mutex_lock(&w->lock);
+    while (w->container)
+    {
+        struct container *owner = w->container;
+        long long changes = atomic64_read(&owner->generation_changes);
+
+        n = watcher_collect(w, events, max);
+        //Nothing is going to change in a destroyed container
+        if (n || (filp->f_flags & O_NONBLOCK) || (READ_ONCE(owner->flags) & CONTAINER_DEAD))
+            break;
+        mutex_unlock(&w->lock);
+        ret = wait_event_interruptible(owner->generation_wait,
+                                       atomic64_read(&owner->generation_changes) != changes);
+        mutex_lock(&w->lock);
+        if (ret)
+        {
+            mutex_unlock(&w->lock);
+            kfree(events);
+            return ret;
+        }
+    }
+    mutex_unlock(&w->lock);
+
+    if (n == 0)
+        ret = w->container && !(READ_ONCE(w->container->flags) & CONTAINER_DEAD) ? -EAGAIN : -EINVAL;
+    else if (copy_to_user(buf, events, n * sizeof(struct memory_container_event)))
+        ret = -EFAULT;
+    else
+        ret = n * sizeof(struct memory_container_event);
+    kfree(events);
+    return ret;
+}
+
+
+/**
+ * Start (op != 0) or stop (op == 0) watching object oid of the caller's
+ * container through this file.
+ */
+int memory_container_watch(struct file *filp, const struct memory_container_cmd *cmd)
+{
+    struct watcher *w = filp->private_data;
+    struct container *temp_container;
+    struct watch *temp_watch, **link;
+    int ret = 0;
+
+    temp_watch = kmalloc(sizeof(struct watch), GFP_KERNEL);
+    if (!temp_watch)
+        return -ENOMEM;
+
+    mutex_lock(&w->lock);
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (!temp_container || (w->container && w->container != temp_container))
+    {
+        ret = -EINVAL;
+        goto out;
+    }
+    for (link = &w->watch_list; *link; link = &(*link)->next)
+    {
+        if ((*link)->oid == cmd->oid)
+            break;
+    }
+    if (cmd->op && !*link)
+    {
+        temp_watch->oid = cmd->oid;
+        temp_watch->seen = current_generation(temp_container, cmd->oid);
+        temp_watch->next = NULL;
+        *link = temp_watch;
+        temp_watch = NULL;
+        if (!w->container)
+            container_get(temp_container);
+        w->container = temp_container;
+    }
+    else if (!cmd->op && *link)
+    {
+        struct watch *victim = *link;
+        *link = victim->next;
+        kfree(victim);
+    }
+out:
+    mutex_unlock(&my_mutex);
+    mutex_unlock(&w->lock);
+    kfree(temp_watch);
+    return ret;
+}
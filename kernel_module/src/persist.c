@@ -0,0 +1,368 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Saving Containers to Files and Restoring Them Lazily
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "memory_container_internal.h"
+
+#include <asm/uaccess.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/mutex.h>
+
+//Pages gathered before each write of the payload
+#define SAVE_BATCH_PAGES 64
+
+
+//Read page index of a restored object from its image.
+//Called with obj->page_lock held.
+int persist_load_page(struct object *obj, unsigned long index)
+{
+    struct page *page;
+    int ret;
+
+    page = alloc_page(GFP_MCONTAINER);
+    if (page == NULL)
+        return -ENOMEM;
+    ret = kernel_read(obj->backing, obj->backing_offset + ((loff_t)index << PAGE_SHIFT),
+                      page_address(page), PAGE_SIZE);
+    if (ret < 0)
+    {
+        __free_page(page);
+        return ret;
+    }
+    //Holes at the end of the image are short reads
+    if (ret < PAGE_SIZE)
+        memset(page_address(page) + ret, 0, PAGE_SIZE - ret);
+
+    obj->pages[index] = page;
+    atomic64_inc(&obj->container->resident_pages);
+    mcontainer_stat_inc(MCONTAINER_STAT_PAGE_ALLOC);
+    return 0;
+}
+
+
+//Copy the contents of page index into buf without changing where the
+//page lives. Returns 1 if there is data, 0 for a page never written.
+//Called with obj->page_lock held.
+static int persist_read_page(struct object *obj, unsigned long index, void *buf)
+{
+    int ret;
+
+    //The object shrank since its size went into the index
+    if (index >= obj->nr_pages)
+        return 0;
+    if (obj->pages[index])
+    {
+        copy_page(buf, page_address(obj->pages[index]));
+        return 1;
+    }
+    if (obj->zpages && obj->zpages[index].data)
+    {
+        ret = reclaim_copy_zpage(&obj->zpages[index], buf);
+        return ret ? ret : 1;
+    }
+    if (obj->backing && index < obj->backing_pages)
+    {
+        ret = kernel_read(obj->backing, obj->backing_offset + ((loff_t)index << PAGE_SHIFT), buf, PAGE_SIZE);
+        if (ret < 0)
+            return ret;
+        if (ret < PAGE_SIZE)
+            memset(buf + ret, 0, PAGE_SIZE - ret);
+        return 1;
+    }
+    return 0;
+}
+
+
+static int persist_write(struct file *filp, const void *buf, size_t count, loff_t pos)
+{
+    ssize_t ret = kernel_write(filp, buf, count, pos);
+    if (ret < 0)
+        return ret;
+    return ret == count ? 0 : -EIO;
+}
+
+
+//Write the first nr_pages pages of one object to offset, batching runs of
+//present pages
+static int persist_save_object(struct file *filp, struct object *obj, unsigned long nr_pages, loff_t offset,
+                               char *buffer)
+{
+    unsigned long index, first = 0, batched = 0;
+    int ret = 0;
+
+    for (index = 0; index < nr_pages && !ret; index++)
+    {
+        mutex_lock(&obj->page_lock);
+        ret = persist_read_page(obj, index, buffer + (batched << PAGE_SHIFT));
+        mutex_unlock(&obj->page_lock);
+        if (ret < 0)
+            break;
+        if (ret)
+        {
+            if (!batched)
+                first = index;
+            batched++;
+            ret = 0;
+        }
+        //Flush on a hole, when the buffer is full or at the end
+        if (batched && (index + 1 != first + batched || batched == SAVE_BATCH_PAGES ||
+                        index + 1 == nr_pages))
+        {
+            ret = persist_write(filp, buffer, batched << PAGE_SHIFT, offset + ((loff_t)first << PAGE_SHIFT));
+            batched = 0;
+        }
+    }
+    if (!ret && batched)
+        ret = persist_write(filp, buffer, batched << PAGE_SHIFT, offset + ((loff_t)first << PAGE_SHIFT));
+    return ret;
+}
+
+
+/**
+ * Stream every object of the caller's container into the file descriptor
+ * in op. The image is only consistent if nobody writes to the container
+ * while it is being saved.
+ */
+int memory_container_save(const struct memory_container_cmd *cmd)
+{
+    struct memory_container_image_header header;
+    struct memory_container_image_entry *table = NULL;
+    struct container *temp_container;
+    struct object *temp_object, **objects = NULL;
+    unsigned long i, nr_objects = 0;
+    loff_t offset;
+    char *buffer = NULL;
+    struct fd f;
+    int ret = 0;
+
+    f = fdget(cmd->op);
+    if (!f.file)
+        return -EBADF;
+    if (!(f.file->f_mode & FMODE_WRITE))
+    {
+        fdput(f);
+        return -EBADF;
+    }
+
+    //Pin the objects, then write them out without holding my_mutex
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (!temp_container)
+    {
+        mutex_unlock(&my_mutex);
+        fdput(f);
+        return -EINVAL;
+    }
+    for (temp_object = temp_container->object_list; temp_object; temp_object = temp_object->next)
+        nr_objects++;
+    objects = object_array_alloc(nr_objects, sizeof(struct object *));
+    table = object_array_alloc(nr_objects, sizeof(struct memory_container_image_entry));
+    if ((!objects || !table) && nr_objects)
+    {
+        mutex_unlock(&my_mutex);
+        ret = -ENOMEM;
+        goto out;
+    }
+    for (i = 0, temp_object = temp_container->object_list; temp_object; temp_object = temp_object->next, i++)
+    {
+        object_get(temp_object);
+        objects[i] = temp_object;
+    }
+    header.cid = temp_container->cid;
+    mutex_unlock(&my_mutex);
+
+    header.magic = MCONTAINER_IMAGE_MAGIC;
+    header.version = MCONTAINER_IMAGE_VERSION;
+    header.page_size = PAGE_SIZE;
+    header.nr_objects = nr_objects;
+    offset = PAGE_ALIGN(sizeof(header) + nr_objects * sizeof(struct memory_container_image_entry));
+    for (i = 0; i < nr_objects; i++)
+    {
+        table[i].oid = objects[i]->oid;
+        table[i].nr_pages = objects[i]->nr_pages;
+        table[i].offset = offset;
+        offset += (loff_t)table[i].nr_pages << PAGE_SHIFT;
+    }
+
+    buffer = vmalloc(SAVE_BATCH_PAGES << PAGE_SHIFT);
+    if (!buffer)
+    {
+        ret = -ENOMEM;
+        goto put;
+    }
+    ret = persist_write(f.file, &header, sizeof(header), 0);
+    if (!ret && nr_objects)
+        ret = persist_write(f.file, table, nr_objects * sizeof(struct memory_container_image_entry), sizeof(header));
+    for (i = 0; i < nr_objects && !ret; i++)
+        ret = persist_save_object(f.file, objects[i], table[i].nr_pages, table[i].offset, buffer);
+    //Restore wants every object inside the file, trailing holes included
+    if (!ret && i_size_read(file_inode(f.file)) < offset)
+        ret = persist_write(f.file, "", 1, offset - 1);
+    vfree(buffer);
+put:
+    for (i = 0; i < nr_objects; i++)
+        object_put(objects[i]);
+out:
+    kvfree(objects);
+    kvfree(table);
+    fdput(f);
+    return ret;
+}
+
+
+/**
+ * Recreate the objects of an image in the caller's container. Nothing but
+ * the index is read up front; each page is read from the file the first
+ * time it is needed, so the file must stay unchanged while any restored
+ * object is alive.
+ */
+int memory_container_restore(const struct memory_container_cmd *cmd)
+{
+    struct memory_container_image_header header;
+    struct memory_container_image_entry *table = NULL;
+    struct container *temp_container;
+    struct object *temp_object;
+    unsigned long i;
+    loff_t image_size;
+    struct fd f;
+    int ret;
+
+    f = fdget(cmd->op);
+    if (!f.file)
+        return -EBADF;
+    if (!(f.file->f_mode & FMODE_READ))
+    {
+        ret = -EBADF;
+        goto out;
+    }
+
+    ret = kernel_read(f.file, 0, (char *)&header, sizeof(header));
+    if (ret >= 0 && ret != sizeof(header))
+        ret = -EINVAL;
+    if (ret < 0)
+        goto out;
+    if (header.magic != MCONTAINER_IMAGE_MAGIC || header.version != MCONTAINER_IMAGE_VERSION ||
+        header.page_size != PAGE_SIZE)
+    {
+        ret = -EINVAL;
+        goto out;
+    }
+    image_size = i_size_read(file_inode(f.file));
+    if (header.nr_objects)
+    {
+        size_t size;
+
+        //The index has to fit in the file before it is worth allocating
+        if (header.nr_objects > (image_size - sizeof(header)) / sizeof(struct memory_container_image_entry))
+        {
+            ret = -EINVAL;
+            goto out;
+        }
+        size = header.nr_objects * sizeof(struct memory_container_image_entry);
+        table = object_array_alloc(header.nr_objects, sizeof(struct memory_container_image_entry));
+        if (!table)
+        {
+            ret = -ENOMEM;
+            goto out;
+        }
+        ret = kernel_read(f.file, sizeof(header), (char *)table, size);
+        if (ret >= 0 && ret != size)
+            ret = -EINVAL;
+        if (ret < 0)
+            goto out;
+    }
+
+    //Nothing in the image is trusted: every object must lie inside the file
+    //and below the reserved offsets
+    for (i = 0; i < header.nr_objects; i++)
+    {
+        if (!table[i].nr_pages || table[i].nr_pages >= MCONTAINER_RESERVED_OID ||
+            table[i].oid >= MCONTAINER_RESERVED_OID || (table[i].offset & ~PAGE_MASK) ||
+            table[i].offset > image_size || (image_size - table[i].offset) >> PAGE_SHIFT < table[i].nr_pages)
+        {
+            ret = -EINVAL;
+            goto out;
+        }
+    }
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (!temp_container)
+    {
+        ret = -EINVAL;
+        goto unlock;
+    }
+    //All or nothing: refuse to shadow objects the container already has
+    for (i = 0; i < header.nr_objects; i++)
+    {
+        if (findobject(temp_container, table[i].oid))
+        {
+            ret = -EEXIST;
+            goto unlock;
+        }
+    }
+    ret = 0;
+    for (i = 0; i < header.nr_objects; i++)
+    {
+        //Nothing was there before, so a hit is an oid the image lists twice
+        if (findobject(temp_container, table[i].oid))
+        {
+            ret = -EINVAL;
+            break;
+        }
+        temp_object = addobject(&temp_container->object_list, temp_container, table[i].oid, table[i].nr_pages);
+        if (!temp_object)
+        {
+            ret = -ENOMEM;
+            break;
+        }
+        temp_object->backing = get_file(f.file);
+        temp_object->backing_offset = table[i].offset;
+        temp_object->backing_pages = table[i].nr_pages;
+    }
+    //Take back whatever this call added before it failed
+    if (ret)
+    {
+        while (i--)
+            deleteobject(temp_container, table[i].oid);
+    }
+unlock:
+    mutex_unlock(&my_mutex);
+out:
+    kvfree(table);
+    fdput(f);
+    return ret;
+}
@@ -0,0 +1,230 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     A Pool of Pre-Zeroed Pages Kept Filled by a Kernel Thread
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "memory_container_internal.h"
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+#include <linux/shrinker.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/cgroup.h>
+#include <linux/rcupdate.h>
+
+//The thread tops the pool up to pool_high once it drops below pool_low.
+//pool_high = 0 turns the pool off.
+static unsigned int pool_low = 256;
+module_param(pool_low, uint, 0644);
+MODULE_PARM_DESC(pool_low, "Refill the pool of zeroed pages when it falls below this many");
+
+static unsigned int pool_high = 1024;
+module_param(pool_high, uint, 0644);
+MODULE_PARM_DESC(pool_high, "Pages of zeroed memory kept ready for new objects, 0 to disable");
+
+//Pool pages are allocated by our thread and charged to no memory cgroup,
+//and this kernel gives a module no way to charge them when they are
+//handed out. So tasks in a cgroup go around the pool and allocate their
+//own, charged pages. On hosts where nearly every task is in one (anything
+//under systemd) that leaves the pool serving little; turning the bypass
+//off lets it serve everyone, with its pages charged to nobody.
+static bool pool_memcg_bypass = true;
+module_param(pool_memcg_bypass, bool, 0644);
+MODULE_PARM_DESC(pool_memcg_bypass, "Tasks in a memory cgroup allocate their own pages instead of using the pool");
+
+//Pages are chained through page->lru, which is ours while we own them
+static LIST_HEAD(pool_pages);
+static DEFINE_SPINLOCK(pool_lock);
+static unsigned long pool_count;
+static DECLARE_WAIT_QUEUE_HEAD(pool_wait);
+static struct task_struct *pool_thread;
+
+
+static int pool_wants_pages(void)
+{
+    unsigned long count = READ_ONCE(pool_count);
+    return count < READ_ONCE(pool_low) && count < READ_ONCE(pool_high);
+}
+
+
+//Whether the caller has to allocate its own page to get it charged.
+//Bypassing tasks never wake the refill thread, so pages the shrinker
+//drains are only made again once a task that uses the pool needs them.
+static bool pool_bypass(void)
+{
+#if defined(CONFIG_MEMCG) && defined(__GFP_ACCOUNT)
+    bool child;
+
+    if (!READ_ONCE(pool_memcg_bypass))
+        return false;
+    rcu_read_lock();
+    child = task_css(current, memory_cgrp_id)->parent != NULL;
+    rcu_read_unlock();
+    return child;
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * A zeroed page for an object's first touch, off the pool if it has one.
+ * Falls back to allocating and clearing one inline.
+ */
+struct page * pool_get_page(void)
+{
+    struct page *page = NULL;
+
+    if (READ_ONCE(pool_high) && !pool_bypass())
+    {
+        spin_lock(&pool_lock);
+        if (!list_empty(&pool_pages))
+        {
+            page = list_first_entry(&pool_pages, struct page, lru);
+            list_del_init(&page->lru);
+            pool_count--;
+        }
+        spin_unlock(&pool_lock);
+        if (pool_wants_pages())
+            wake_up_interruptible(&pool_wait);
+    }
+    if (page)
+    {
+        mcontainer_stat_inc(MCONTAINER_STAT_POOL_HIT);
+        return page;
+    }
+    mcontainer_stat_inc(MCONTAINER_STAT_POOL_MISS);
+    return alloc_page(GFP_MCONTAINER | __GFP_ZERO);
+}
+
+
+static int pool_fill(void *unused)
+{
+    struct page *page;
+
+    while (!kthread_should_stop())
+    {
+        wait_event_interruptible(pool_wait, pool_wants_pages() || kthread_should_stop());
+        while (!kthread_should_stop() && READ_ONCE(pool_count) < READ_ONCE(pool_high))
+        {
+            //Never dig into reserves for memory nobody has asked for yet
+            page = alloc_page(GFP_KERNEL | __GFP_ZERO | __GFP_NORETRY | __GFP_NOWARN);
+            if (page == NULL)
+            {
+                msleep_interruptible(100);
+                break;
+            }
+            spin_lock(&pool_lock);
+            list_add(&page->lru, &pool_pages);
+            pool_count++;
+            spin_unlock(&pool_lock);
+            cond_resched();
+        }
+    }
+    return 0;
+}
+
+
+//Give up to nr pages of the pool back to the system
+static unsigned long pool_drain(unsigned long nr)
+{
+    struct page *page;
+    unsigned long freed = 0;
+
+    while (freed < nr)
+    {
+        spin_lock(&pool_lock);
+        if (list_empty(&pool_pages))
+        {
+            spin_unlock(&pool_lock);
+            break;
+        }
+        page = list_first_entry(&pool_pages, struct page, lru);
+        list_del_init(&page->lru);
+        pool_count--;
+        spin_unlock(&pool_lock);
+        __free_page(page);
+        freed++;
+    }
+    return freed;
+}
+
+
+static unsigned long pool_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
+{
+    return READ_ONCE(pool_count);
+}
+
+
+//Pages sitting in the pool are the cheapest memory to give back
+static unsigned long pool_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
+{
+    unsigned long freed = pool_drain(sc->nr_to_scan);
+    return freed ? freed : SHRINK_STOP;
+}
+
+
+static struct shrinker pool_shrinker = {
+    .count_objects  = pool_shrink_count,
+    .scan_objects   = pool_shrink_scan,
+    .seeks          = 1,
+};
+
+
+int memory_container_pool_init(void)
+{
+    int ret;
+
+    ret = register_shrinker(&pool_shrinker);
+    if (ret)
+        return ret;
+    pool_thread = kthread_run(pool_fill, NULL, "mcontainer_pool");
+    if (IS_ERR(pool_thread))
+    {
+        unregister_shrinker(&pool_shrinker);
+        return PTR_ERR(pool_thread);
+    }
+    wake_up_interruptible(&pool_wait);
+    return 0;
+}
+
+
+void memory_container_pool_exit(void)
+{
+    kthread_stop(pool_thread);
+    unregister_shrinker(&pool_shrinker);
+    pool_drain(ULONG_MAX);
+}
@@ -0,0 +1,377 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Compressing Idle Objects under Memory Pressure
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "memory_container_internal.h"
+
+#include <asm/uaccess.h>
+#include <linux/slab.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/crypto.h>
+#include <linux/shrinker.h>
+#include <linux/ktime.h>
+#include <linux/jiffies.h>
+
+//Objects nobody has mapped, faulted or locked for this long are cold
+static unsigned int reclaim_idle_secs = 60;
+module_param(reclaim_idle_secs, uint, 0644);
+MODULE_PARM_DESC(reclaim_idle_secs, "Seconds an object must sit idle before the shrinker compresses it");
+
+static char *reclaim_compressor = "lzo";
+module_param(reclaim_compressor, charp, 0444);
+MODULE_PARM_DESC(reclaim_compressor, "Crypto API compression algorithm used for idle objects");
+
+//A single transform and output buffer, serialized by reclaim_tfm_lock
+static struct crypto_comp *reclaim_tfm = NULL;
+static u8 *reclaim_buffer = NULL;
+static DEFINE_MUTEX(reclaim_tfm_lock);
+
+
+//Decompress a compressed page into buf, leaving the compressed copy alone
+int reclaim_copy_zpage(struct object_zpage *zpage, void *buf)
+{
+    unsigned int dlen = PAGE_SIZE;
+    int ret;
+
+    mutex_lock(&reclaim_tfm_lock);
+    ret = crypto_comp_decompress(reclaim_tfm, zpage->data, zpage->len, buf, &dlen);
+    mutex_unlock(&reclaim_tfm_lock);
+    if (ret || dlen != PAGE_SIZE)
+        return -EIO;
+    return 0;
+}
+
+
+//Bring page index of obj back from its compressed copy.
+//Called with obj->page_lock held.
+int reclaim_decompress_page(struct object *obj, unsigned long index)
+{
+    struct object_zpage *zpage = &obj->zpages[index];
+    struct container *owner = obj->container;
+    struct page *page;
+    ktime_t start;
+    s64 elapsed, max;
+    int ret;
+
+    page = alloc_page(GFP_MCONTAINER);
+    if (page == NULL)
+        return -ENOMEM;
+
+    start = ktime_get();
+    ret = reclaim_copy_zpage(zpage, page_address(page));
+    elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+    if (ret)
+    {
+        printk(KERN_ERR "memory_container: cannot decompress object %llu page %lu\n", obj->oid, index);
+        __free_page(page);
+        return -EIO;
+    }
+
+    atomic64_sub(zpage->len, &owner->compressed_bytes);
+    atomic64_dec(&owner->compressed_pages);
+    atomic64_inc(&owner->resident_pages);
+    atomic64_inc(&owner->decompressions);
+    atomic64_add(elapsed, &owner->decompress_ns);
+    max = atomic64_read(&owner->decompress_max_ns);
+    while (elapsed > max)
+    {
+        s64 old = atomic64_cmpxchg(&owner->decompress_max_ns, max, elapsed);
+        if (old == max)
+            break;
+        max = old;
+    }
+
+    kfree(zpage->data);
+    zpage->data = NULL;
+    zpage->len = 0;
+    obj->pages[index] = page;
+    mcontainer_stat_inc(MCONTAINER_STAT_PAGE_ALLOC);
+    return 0;
+}
+
+
+//Drop the compressed copies of an object that is going away.
+//The array itself is freed with the object.
+void reclaim_free_zpages(struct object *obj)
+{
+    unsigned long i;
+
+    if (!obj->zpages)
+        return;
+    for (i = 0; i < obj->nr_pages; i++)
+    {
+        if (obj->zpages[i].data)
+        {
+            atomic64_sub(obj->zpages[i].len, &obj->container->compressed_bytes);
+            atomic64_dec(&obj->container->compressed_pages);
+            kfree(obj->zpages[i].data);
+        }
+    }
+}
+
+
+//Compress up to budget resident pages of a cold object whose mappings
+//have already been zapped. Pages that do not shrink, or that someone else
+//still holds a reference to, stay resident.
+//Called with my_mutex and obj->page_lock held.
+static unsigned long reclaim_compress_object(struct object *obj, unsigned long budget)
+{
+    struct container *owner = obj->container;
+    unsigned long i, freed = 0;
+
+    if (!obj->zpages)
+        return 0;
+
+    for (i = 0; i < obj->nr_pages && freed < budget; i++)
+    {
+        struct page *page = obj->pages[i];
+        unsigned int dlen = 2 * PAGE_SIZE;
+        void *data;
+
+        if (!page || page_count(page) != 1)
+            continue;
+        if (!mutex_trylock(&reclaim_tfm_lock))
+            break;
+        if (crypto_comp_compress(reclaim_tfm, page_address(page), PAGE_SIZE, reclaim_buffer, &dlen) ||
+            dlen >= PAGE_SIZE)
+        {
+            mutex_unlock(&reclaim_tfm_lock);
+            continue;
+        }
+        data = kmalloc(dlen, GFP_NOWAIT | __GFP_NOWARN);
+        if (data)
+            memcpy(data, reclaim_buffer, dlen);
+        mutex_unlock(&reclaim_tfm_lock);
+        if (!data)
+            break;
+
+        obj->zpages[i].data = data;
+        obj->zpages[i].len = dlen;
+        obj->pages[i] = NULL;
+        put_page(page);
+        atomic64_dec(&owner->resident_pages);
+        mcontainer_stat_inc(MCONTAINER_STAT_PAGE_FREE);
+        atomic64_inc(&owner->compressed_pages);
+        atomic64_add(dlen, &owner->compressed_bytes);
+        atomic64_inc(&owner->compressions);
+        freed++;
+    }
+    return freed;
+}
+
+
+static unsigned long reclaim_count(struct shrinker *shrink, struct shrink_control *sc)
+{
+    struct container *temp_container;
+    unsigned long count = 0;
+
+    if (!mutex_trylock(&my_mutex))
+        return 0;
+    for (temp_container = container_head; temp_container; temp_container = temp_container->next)
+    {
+        if (temp_container->flags & CONTAINER_RECLAIM)
+            count += atomic64_read(&temp_container->resident_pages);
+    }
+    mutex_unlock(&my_mutex);
+    return count;
+}
+
+
+//Everything is trylocked: we may be called from an allocation made while
+//holding any of these locks.
+static unsigned long reclaim_scan(struct shrinker *shrink, struct shrink_control *sc)
+{
+    struct container *temp_container;
+    struct object *temp_object;
+    unsigned long freed = 0;
+    unsigned long idle = reclaim_idle_secs * HZ;
+
+    //Zapping mappings takes i_mmap_rwsem, stay out of filesystem reclaim
+    if (!(sc->gfp_mask & __GFP_FS))
+        return SHRINK_STOP;
+    if (!mutex_trylock(&my_mutex))
+        return SHRINK_STOP;
+
+    for (temp_container = container_head; temp_container && freed < sc->nr_to_scan;
+         temp_container = temp_container->next)
+    {
+        if (!(temp_container->flags & CONTAINER_RECLAIM))
+            continue;
+        if (!mutex_trylock(&temp_container->lock_table_lock))
+            continue;
+        for (temp_object = temp_container->object_list; temp_object && freed < sc->nr_to_scan;
+             temp_object = temp_object->next)
+        {
+            if (time_before(jiffies, temp_object->last_access + idle))
+                continue;
+            //Some task is inside a critical section on this object
+            if (object_lock_held(temp_container, temp_object->oid))
+                continue;
+            if (!mutex_trylock(&temp_object->page_lock))
+                continue;
+            if (!temp_object->dead)
+            {
+                object_zap(temp_object);
+                freed += reclaim_compress_object(temp_object, sc->nr_to_scan - freed);
+            }
+            mutex_unlock(&temp_object->page_lock);
+        }
+        mutex_unlock(&temp_container->lock_table_lock);
+    }
+
+    mutex_unlock(&my_mutex);
+    return freed ? freed : SHRINK_STOP;
+}
+
+
+static struct shrinker reclaim_shrinker = {
+    .count_objects  = reclaim_count,
+    .scan_objects   = reclaim_scan,
+    .seeks          = DEFAULT_SEEKS,
+};
+
+
+/**
+ * Opt the caller's container in (op != 0) or out (op == 0) of compression
+ * under memory pressure. Objects already compressed come back on their
+ * next fault either way.
+ */
+int memory_container_reclaim(const struct memory_container_cmd *cmd)
+{
+    struct container *temp_container;
+    struct object *temp_object;
+    int ret = 0;
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (!temp_container)
+    {
+        ret = -EINVAL;
+    }
+    else if (cmd->op)
+    {
+        //Objects need somewhere to keep their compressed pages
+        for (temp_object = temp_container->object_list; temp_object; temp_object = temp_object->next)
+        {
+            struct object_zpage *zpages;
+
+            if (temp_object->zpages)
+                continue;
+            zpages = object_array_alloc(object_capacity(temp_object), sizeof(struct object_zpage));
+            if (!zpages)
+            {
+                ret = -ENOMEM;
+                break;
+            }
+            mutex_lock(&temp_object->page_lock);
+            temp_object->zpages = zpages;
+            mutex_unlock(&temp_object->page_lock);
+        }
+        if (!ret)
+            temp_container->flags |= CONTAINER_RECLAIM;
+    }
+    else
+    {
+        temp_container->flags &= ~CONTAINER_RECLAIM;
+    }
+    mutex_unlock(&my_mutex);
+    return ret;
+}
+
+
+/**
+ * Report the reclaim statistics of the caller's container.
+ */
+int memory_container_reclaim_stats(struct memory_container_reclaim_stats __user *user_stats)
+{
+    struct memory_container_reclaim_stats stats;
+    struct container *temp_container;
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (temp_container)
+    {
+        stats.resident_pages = atomic64_read(&temp_container->resident_pages);
+        stats.compressed_pages = atomic64_read(&temp_container->compressed_pages);
+        stats.compressed_bytes = atomic64_read(&temp_container->compressed_bytes);
+        stats.compressions = atomic64_read(&temp_container->compressions);
+        stats.decompressions = atomic64_read(&temp_container->decompressions);
+        stats.decompress_ns = atomic64_read(&temp_container->decompress_ns);
+        stats.decompress_max_ns = atomic64_read(&temp_container->decompress_max_ns);
+    }
+    mutex_unlock(&my_mutex);
+
+    if (!temp_container)
+        return -EINVAL;
+    if (copy_to_user(user_stats, &stats, sizeof(stats)))
+        return -EFAULT;
+    return 0;
+}
+
+
+int memory_container_reclaim_init(void)
+{
+    int ret;
+
+    reclaim_tfm = crypto_alloc_comp(reclaim_compressor, 0, 0);
+    if (IS_ERR(reclaim_tfm))
+    {
+        printk(KERN_ERR "memory_container: compressor %s unavailable\n", reclaim_compressor);
+        ret = PTR_ERR(reclaim_tfm);
+        reclaim_tfm = NULL;
+        return ret;
+    }
+    reclaim_buffer = kmalloc(2 * PAGE_SIZE, GFP_KERNEL);
+    if (reclaim_buffer == NULL)
+    {
+        crypto_free_comp(reclaim_tfm);
+        return -ENOMEM;
+    }
+    ret = register_shrinker(&reclaim_shrinker);
+    if (ret)
+    {
+        kfree(reclaim_buffer);
+        crypto_free_comp(reclaim_tfm);
+    }
+    return ret;
+}
+
+
+void memory_container_reclaim_exit(void)
+{
+    unregister_shrinker(&reclaim_shrinker);
+    kfree(reclaim_buffer);
+    crypto_free_comp(reclaim_tfm);
+}
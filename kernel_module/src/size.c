@@ -0,0 +1,238 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Object Sizes, Size Classes and Resizing in Place
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "memory_container_internal.h"
+
+#include <asm/uaccess.h>
+#include <linux/slab.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/log2.h>
+#include <linux/bitmap.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+
+unsigned int object_size_class(unsigned long nr_pages)
+{
+    return order_base_2(nr_pages);
+}
+
+
+//Drop page index of obj wherever it lives. Called with obj->page_lock held.
+static void object_drop_page(struct object *obj, unsigned long index)
+{
+    struct container *owner = obj->container;
+
+    if (obj->pages[index])
+    {
+        put_page(obj->pages[index]);
+        obj->pages[index] = NULL;
+        atomic64_dec(&owner->resident_pages);
+        mcontainer_stat_inc(MCONTAINER_STAT_PAGE_FREE);
+    }
+    if (obj->zpages && obj->zpages[index].data)
+    {
+        atomic64_sub(obj->zpages[index].len, &owner->compressed_bytes);
+        atomic64_dec(&owner->compressed_pages);
+        kfree(obj->zpages[index].data);
+        obj->zpages[index].data = NULL;
+        obj->zpages[index].len = 0;
+    }
+    if (obj->cow)
+        clear_bit(index, obj->cow);
+}
+
+
+//Make obj nr_pages long. Pages past the new end are freed and come back
+//zeroed if the object grows again; the arrays are only reallocated when
+//the size class changes. Called with obj->page_lock held.
+static int object_set_pages(struct object *obj, unsigned long nr_pages)
+{
+    unsigned int size_class = object_size_class(nr_pages);
+    unsigned long capacity = 1UL << size_class;
+    unsigned long keep = min(nr_pages, obj->nr_pages);
+    struct page **pages = NULL;
+    struct object_zpage *zpages = NULL;
+    unsigned long *cow = NULL, i;
+
+    if (size_class != obj->size_class)
+    {
+        pages = object_array_alloc(capacity, sizeof(struct page *));
+        if (obj->zpages)
+            zpages = object_array_alloc(capacity, sizeof(struct object_zpage));
+        if (obj->cow)
+            cow = object_array_alloc(BITS_TO_LONGS(capacity), sizeof(unsigned long));
+        if (!pages || (obj->zpages && !zpages) || (obj->cow && !cow))
+        {
+            kvfree(pages);
+            kvfree(zpages);
+            kvfree(cow);
+            return -ENOMEM;
+        }
+    }
+
+    for (i = nr_pages; i < obj->nr_pages; i++)
+        object_drop_page(obj, i);
+    //Whatever the image had past the new end is gone for good
+    if (obj->backing_pages > nr_pages)
+        obj->backing_pages = nr_pages;
+
+    if (pages)
+    {
+        memcpy(pages, obj->pages, keep * sizeof(struct page *));
+        kvfree(obj->pages);
+        obj->pages = pages;
+        if (zpages)
+        {
+            memcpy(zpages, obj->zpages, keep * sizeof(struct object_zpage));
+            kvfree(obj->zpages);
+            obj->zpages = zpages;
+        }
+        if (cow)
+        {
+            bitmap_copy(cow, obj->cow, keep);
+            kvfree(obj->cow);
+            obj->cow = cow;
+        }
+        obj->size_class = size_class;
+    }
+    obj->nr_pages = nr_pages;
+    return 0;
+}
+
+
+static void size_fill(struct memory_container_size *temp_size, struct object *obj)
+{
+    temp_size->size = obj->size;
+    temp_size->nr_pages = obj->nr_pages;
+    temp_size->size_class = obj->size_class;
+}
+
+
+/**
+ * Report the size of object oid of the caller's container without
+ * mapping it.
+ */
+int memory_container_size(struct memory_container_size __user *user_size)
+{
+    struct memory_container_size temp_size;
+    struct container *temp_container;
+    struct object *temp_object = NULL;
+    int ret = 0;
+
+    if (copy_from_user(&temp_size, user_size, sizeof(struct memory_container_size)))
+        return -EFAULT;
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (temp_container)
+        temp_object = findobject(temp_container, temp_size.oid);
+    if (!temp_container)
+        ret = -EINVAL;
+    else if (!temp_object)
+        ret = -ENOENT;
+    else
+    {
+        mutex_lock(&temp_object->page_lock);
+        size_fill(&temp_size, temp_object);
+        mutex_unlock(&temp_object->page_lock);
+    }
+    mutex_unlock(&my_mutex);
+
+    if (!ret && copy_to_user(user_size, &temp_size, sizeof(struct memory_container_size)))
+        ret = -EFAULT;
+    return ret;
+}
+
+
+/**
+ * Change the size of object oid of the caller's container to size bytes,
+ * keeping the pages it already has up to the new size. Mappings past a
+ * shrunk end get SIGBUS; mapping a grown object needs a new mmap().
+ */
+int memory_container_resize(struct memory_container_size __user *user_size)
+{
+    struct memory_container_size temp_size;
+    struct container *temp_container;
+    struct object *temp_object = NULL;
+    unsigned long nr_pages;
+    int ret = 0;
+
+    if (copy_from_user(&temp_size, user_size, sizeof(struct memory_container_size)))
+        return -EFAULT;
+    //Offsets from MCONTAINER_RESERVED_OID up are not objects'
+    if (temp_size.size == 0 || temp_size.oid >= MCONTAINER_RESERVED_OID ||
+        temp_size.size > (MCONTAINER_RESERVED_OID - temp_size.oid) << PAGE_SHIFT)
+        return -EINVAL;
+    nr_pages = DIV_ROUND_UP(temp_size.size, PAGE_SIZE);
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (temp_container)
+        temp_object = findobject(temp_container, temp_size.oid);
+    if (!temp_container)
+    {
+        ret = -EINVAL;
+        goto out;
+    }
+    if (!temp_object)
+    {
+        ret = -ENOENT;
+        goto out;
+    }
+
+    mutex_lock(&temp_object->page_lock);
+    //Aliases and sealed objects never change
+    if (temp_object->readonly)
+    {
+        ret = -EROFS;
+    }
+    else
+    {
+        //Nobody may keep the pages past the new end mapped
+        if (nr_pages < temp_object->nr_pages)
+            object_zap_range(temp_object, nr_pages, temp_object->nr_pages - nr_pages);
+        ret = object_set_pages(temp_object, nr_pages);
+        if (!ret)
+            temp_object->size = temp_size.size;
+        size_fill(&temp_size, temp_object);
+    }
+    mutex_unlock(&temp_object->page_lock);
+    if (!ret)
+        notify_object_changed(temp_container, temp_size.oid, temp_object);
+out:
+    mutex_unlock(&my_mutex);
+
+    if (!ret && copy_to_user(user_size, &temp_size, sizeof(struct memory_container_size)))
+        ret = -EFAULT;
+    return ret;
+}
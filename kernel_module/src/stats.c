@@ -0,0 +1,70 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Per-CPU Event Counters
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "memory_container_internal.h"
+
+#include <asm/uaccess.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/percpu.h>
+#include <linux/cpumask.h>
+#include <linux/string.h>
+
+DEFINE_PER_CPU(struct mcontainer_stat_cpu, mcontainer_stat_cpu);
+
+//Counting can be switched off to measure what it costs
+bool mcontainer_stats_enabled = true;
+module_param_named(stats, mcontainer_stats_enabled, bool, 0644);
+MODULE_PARM_DESC(stats, "Keep the event counters reported by MCONTAINER_IOCTL_STATS");
+
+
+/**
+ * Report the module-wide counters, summed over every CPU. The sum is not
+ * a snapshot: counters keep moving while it is taken.
+ */
+int memory_container_stats(struct memory_container_stats __user *user_stats)
+{
+    struct memory_container_stats temp_stats;
+    int cpu, i;
+
+    memset(&temp_stats, 0, sizeof(struct memory_container_stats));
+    for_each_possible_cpu(cpu)
+    {
+        struct mcontainer_stat_cpu *counters = per_cpu_ptr(&mcontainer_stat_cpu, cpu);
+        for (i = 0; i < MCONTAINER_STAT_NR; i++)
+            temp_stats.count[i] += READ_ONCE(counters->count[i]);
+    }
+    if (copy_to_user(user_stats, &temp_stats, sizeof(struct memory_container_stats)))
+        return -EFAULT;
+    return 0;
+}
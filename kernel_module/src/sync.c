@@ -0,0 +1,332 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Barriers and Condition Variables Scoped to a Container
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "memory_container_internal.h"
+
+#include <asm/uaccess.h>
+#include <linux/slab.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/wait.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+
+static struct container_sync ** sync_bucket(struct container *owner, int type, unsigned long long int id)
+{
+    return &owner->sync_table[(id + type) % OBJECT_LOCK_BUCKETS];
+}
+
+
+//Called with lock_table_lock held
+static struct container_sync * sync_find(struct container *owner, int type, unsigned long long int id)
+{
+    struct container_sync *temp_sync;
+
+    for (temp_sync = *sync_bucket(owner, type, id); temp_sync; temp_sync = temp_sync->next)
+    {
+        if (temp_sync->id == id && temp_sync->type == type)
+            return temp_sync;
+    }
+    return NULL;
+}
+
+
+//Called with lock_table_lock held
+static struct container_sync * sync_find_or_add(struct container *owner, int type, unsigned long long int id)
+{
+    struct container_sync *temp_sync = sync_find(owner, type, id);
+
+    if (temp_sync)
+        return temp_sync;
+    temp_sync = kmalloc(sizeof(struct container_sync), GFP_KERNEL);
+    if (temp_sync == NULL)
+        return NULL;
+    temp_sync->id = id;
+    temp_sync->type = type;
+    temp_sync->waiters = 0;
+    temp_sync->arrived = 0;
+    temp_sync->count = 0;
+    temp_sync->tokens = 0;
+    temp_sync->seq = 0;
+    init_waitqueue_head(&temp_sync->wait);
+    temp_sync->next = *sync_bucket(owner, type, id);
+    *sync_bucket(owner, type, id) = temp_sync;
+    return temp_sync;
+}
+
+
+//Drop the entry once nobody waits on it.
+//Called with lock_table_lock held.
+static void sync_release_entry(struct container *owner, struct container_sync *victim)
+{
+    struct container_sync **link;
+
+    if (victim->waiters || victim->arrived)
+        return;
+    for (link = sync_bucket(owner, victim->type, victim->id); *link; link = &(*link)->next)
+    {
+        if (*link == victim)
+        {
+            *link = victim->next;
+            kfree(victim);
+            return;
+        }
+    }
+}
+
+
+//Wake every waiter of a destroyed container, to find it dead.
+//Called with my_mutex held.
+void sync_release_all(struct container *owner)
+{
+    struct container_sync *temp_sync;
+    int i;
+
+    mutex_lock(&owner->lock_table_lock);
+    for (i = 0; i < OBJECT_LOCK_BUCKETS; i++)
+    {
+        for (temp_sync = owner->sync_table[i]; temp_sync; temp_sync = temp_sync->next)
+        {
+            temp_sync->arrived = 0;
+            temp_sync->tokens = temp_sync->waiters;
+            temp_sync->seq++;
+            wake_up_interruptible_all(&temp_sync->wait);
+        }
+    }
+    mutex_unlock(&owner->lock_table_lock);
+}
+
+
+//Free what is left once the container itself goes
+void sync_free_all(struct container *owner)
+{
+    struct container_sync *temp_sync;
+    int i;
+
+    for (i = 0; i < OBJECT_LOCK_BUCKETS; i++)
+    {
+        while ((temp_sync = owner->sync_table[i]))
+        {
+            owner->sync_table[i] = temp_sync->next;
+            kfree(temp_sync);
+        }
+    }
+}
+
+
+//The caller's container with a reference held, or NULL
+static struct container * sync_container(void)
+{
+    struct container *temp_container;
+
+    mutex_lock(&my_mutex);
+    temp_container = findcontainer(current->pid);
+    if (temp_container)
+        container_get(temp_container);
+    mutex_unlock(&my_mutex);
+    return temp_container;
+}
+
+
+static int sync_signalled(struct container_sync *temp_sync, unsigned int seq)
+{
+    return READ_ONCE(temp_sync->tokens) && READ_ONCE(temp_sync->seq) != seq;
+}
+
+
+/**
+ * Wait until count tasks of the caller's container, this one included,
+ * have reached barrier id. The barrier can be used again right away.
+ * Returns 1 to the task that arrived last and 0 to the others.
+ */
+int memory_container_barrier(struct memory_container_sync __user *user_sync)
+{
+    struct memory_container_sync temp_req;
+    struct container *temp_container;
+    struct container_sync *temp_sync;
+    unsigned int seq;
+    int ret = 0;
+
+    if (copy_from_user(&temp_req, user_sync, sizeof(struct memory_container_sync)))
+        return -EFAULT;
+    if (!temp_req.count)
+        return -EINVAL;
+    temp_container = sync_container();
+    if (!temp_container)
+        return -EINVAL;
+
+    mutex_lock(&temp_container->lock_table_lock);
+    if (READ_ONCE(temp_container->flags) & CONTAINER_DEAD)
+    {
+        ret = -EINVAL;
+        goto out;
+    }
+    temp_sync = sync_find_or_add(temp_container, SYNC_BARRIER, temp_req.id);
+    if (!temp_sync)
+    {
+        ret = -ENOMEM;
+        goto out;
+    }
+    //Everybody in one round has to agree on how many make it up
+    if (temp_sync->arrived && temp_sync->count != temp_req.count)
+    {
+        ret = -EINVAL;
+        goto out;
+    }
+    temp_sync->count = temp_req.count;
+    if (++temp_sync->arrived == temp_sync->count)
+    {
+        temp_sync->arrived = 0;
+        temp_sync->seq++;
+        wake_up_interruptible_all(&temp_sync->wait);
+        sync_release_entry(temp_container, temp_sync);
+        ret = 1;
+        goto out;
+    }
+
+    seq = temp_sync->seq;
+    temp_sync->waiters++;
+    mutex_unlock(&temp_container->lock_table_lock);
+    ret = wait_event_interruptible(temp_sync->wait, READ_ONCE(temp_sync->seq) != seq);
+    mutex_lock(&temp_container->lock_table_lock);
+    temp_sync->waiters--;
+    //Interrupted before the round was complete, so we never arrived
+    if (temp_sync->seq == seq)
+        temp_sync->arrived--;
+    else
+        ret = 0;
+    if (READ_ONCE(temp_container->flags) & CONTAINER_DEAD)
+        ret = -EINVAL;
+    sync_release_entry(temp_container, temp_sync);
+out:
+    mutex_unlock(&temp_container->lock_table_lock);
+    container_put(temp_container);
+    return ret;
+}
+
+
+/**
+ * Release the lock of object oid, which the caller must hold, and wait for
+ * condition variable id to be signalled; both happen at once, so a signal
+ * sent once the lock is free is never missed. The lock is taken again
+ * before returning, except on error. Like any condition variable, callers
+ * check what they wait for again when this returns.
+ */
+int memory_container_cond_wait(struct memory_container_sync __user *user_sync)
+{
+    struct memory_container_sync temp_req;
+    struct container *temp_container;
+    struct container_sync *temp_sync;
+    unsigned int seq;
+    int ret;
+
+    if (copy_from_user(&temp_req, user_sync, sizeof(struct memory_container_sync)))
+        return -EFAULT;
+    temp_container = sync_container();
+    if (!temp_container)
+        return -EINVAL;
+
+    mutex_lock(&temp_container->lock_table_lock);
+    temp_sync = NULL;
+    if (READ_ONCE(temp_container->flags) & CONTAINER_DEAD)
+        ret = -EINVAL;
+    else if (!(temp_sync = sync_find_or_add(temp_container, SYNC_COND, temp_req.id)))
+        ret = -ENOMEM;
+    else
+        ret = object_unlock_held(temp_container, temp_req.oid);
+    if (ret)
+    {
+        if (temp_sync)
+            sync_release_entry(temp_container, temp_sync);
+        mutex_unlock(&temp_container->lock_table_lock);
+        container_put(temp_container);
+        return ret;
+    }
+    seq = temp_sync->seq;
+    temp_sync->waiters++;
+    mutex_unlock(&temp_container->lock_table_lock);
+    mcontainer_stat_inc(MCONTAINER_STAT_UNLOCK);
+    lock_notify(temp_container, &temp_req.oid, 1);
+
+    ret = wait_event_interruptible(temp_sync->wait, sync_signalled(temp_sync, seq));
+    mutex_lock(&temp_container->lock_table_lock);
+    temp_sync->waiters--;
+    if (temp_sync->tokens && temp_sync->seq != seq)
+    {
+        temp_sync->tokens--;
+        ret = 0;
+    }
+    //Tokens nobody who is still waiting could take would wake later waiters
+    temp_sync->tokens = min(temp_sync->tokens, temp_sync->waiters);
+    if (READ_ONCE(temp_container->flags) & CONTAINER_DEAD)
+        ret = -EINVAL;
+    sync_release_entry(temp_container, temp_sync);
+    mutex_unlock(&temp_container->lock_table_lock);
+
+    if (!ret)
+        ret = object_lock(temp_container, temp_req.oid);
+    container_put(temp_container);
+    return ret;
+}
+
+
+/**
+ * Wake one task waiting on condition variable id of the caller's
+ * container, or all of them with MCONTAINER_COND_BROADCAST. Nothing
+ * happens if nobody waits.
+ */
+int memory_container_cond_signal(struct memory_container_sync __user *user_sync)
+{
+    struct memory_container_sync temp_req;
+    struct container *temp_container;
+    struct container_sync *temp_sync;
+
+    if (copy_from_user(&temp_req, user_sync, sizeof(struct memory_container_sync)))
+        return -EFAULT;
+    temp_container = sync_container();
+    if (!temp_container)
+        return -EINVAL;
+
+    mutex_lock(&temp_container->lock_table_lock);
+    temp_sync = sync_find(temp_container, SYNC_COND, temp_req.id);
+    if (temp_sync && temp_sync->waiters > temp_sync->tokens)
+    {
+        if (temp_req.flags & MCONTAINER_COND_BROADCAST)
+            temp_sync->tokens = temp_sync->waiters;
+        else
+            temp_sync->tokens++;
+        temp_sync->seq++;
+        wake_up_interruptible_all(&temp_sync->wait);
+    }
+    mutex_unlock(&temp_container->lock_table_lock);
+    container_put(temp_container);
+    return 0;
+}
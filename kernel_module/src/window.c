@@ -0,0 +1,182 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2018
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Windows: One Mapping Showing Every Object of a Container
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "memory_container_internal.h"
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/bitops.h>
+#include <linux/mutex.h>
+
+//Size classes a window has ever been mapped with, so that zapping an
+//object only looks where its pages may be mapped
+static unsigned long window_classes;
+
+
+//Windows can be split by munmap(), so the class comes from the offset
+static unsigned int window_class(struct vm_area_struct *vma)
+{
+    return (vma->vm_pgoff - MCONTAINER_WINDOW_OID(0)) / MCONTAINER_WINDOW_SPAN;
+}
+
+
+//The object page pgoff of a window shows, and which of its pages it is.
+//Faults create the object at the window's stride if it does not exist.
+//Returns it with a reference held, or NULL, as it does once the container
+//has been destroyed.
+static struct object * window_object(struct vm_area_struct *vma, unsigned long pgoff, int create,
+                                     unsigned long *index)
+{
+    struct container *owner = vma->vm_private_data;
+    unsigned int size_class = window_class(vma);
+    unsigned long offset = pgoff - MCONTAINER_WINDOW_OID(size_class);
+    unsigned long long int oid = offset >> size_class;
+    struct object *temp_object;
+
+    *index = offset & ((1UL << size_class) - 1);
+    mutex_lock(&my_mutex);
+    if (owner->flags & CONTAINER_DEAD)
+    {
+        mutex_unlock(&my_mutex);
+        return NULL;
+    }
+    temp_object = findobject(owner, oid);
+    if (!temp_object && create)
+        temp_object = addobject(&owner->object_list, owner, oid, 1UL << size_class);
+    if (temp_object)
+    {
+        object_get(temp_object);
+        temp_object->last_access = jiffies;
+    }
+    mutex_unlock(&my_mutex);
+    return temp_object;
+}
+
+
+static int window_vm_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+    struct object *obj;
+    unsigned long index;
+    int ret;
+
+    obj = window_object(vma, vmf->pgoff, 1, &index);
+    if (!obj)
+    {
+        struct container *owner = vma->vm_private_data;
+        return (READ_ONCE(owner->flags) & CONTAINER_DEAD) ? VM_FAULT_SIGBUS : VM_FAULT_OOM;
+    }
+    ret = object_fault(obj, index, vmf);
+    object_put(obj);
+    return ret;
+}
+
+
+static int window_vm_page_mkwrite(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+    //vmf->pgoff comes from page->index here, which our pages do not keep
+    unsigned long pgoff = vma->vm_pgoff + (((unsigned long)vmf->virtual_address - vma->vm_start) >> PAGE_SHIFT);
+    struct object *obj;
+    unsigned long index;
+    int ret;
+
+    //A page whose object is gone is about to be zapped
+    obj = window_object(vma, pgoff, 0, &index);
+    if (!obj)
+        return VM_FAULT_SIGBUS;
+    ret = object_page_mkwrite(obj, index, vmf);
+    object_put(obj);
+    return ret;
+}
+
+
+static void window_vm_open(struct vm_area_struct *vma)
+{
+    container_get(vma->vm_private_data);
+}
+
+
+static void window_vm_close(struct vm_area_struct *vma)
+{
+    container_put(vma->vm_private_data);
+}
+
+
+static const struct vm_operations_struct window_vm_ops = {
+    .open           = window_vm_open,
+    .close          = window_vm_close,
+    .fault          = window_vm_fault,
+    .page_mkwrite   = window_vm_page_mkwrite,
+};
+
+
+/**
+ * Map a window onto the objects of a container: object oid shows up
+ * (oid << size_class) pages into the window of that size class, so
+ * getting at an object is pointer arithmetic rather than a mapping of
+ * its own. Called with my_mutex held.
+ */
+int window_mmap(struct container *owner, struct vm_area_struct *vma)
+{
+    unsigned int size_class;
+
+    if ((vma->vm_pgoff - MCONTAINER_WINDOW_OID(0)) % MCONTAINER_WINDOW_SPAN)
+        return -EINVAL;
+    size_class = window_class(vma);
+    if (size_class > MCONTAINER_WINDOW_MAX_CLASS || vma_pages(vma) > MCONTAINER_WINDOW_SPAN)
+        return -EINVAL;
+    set_bit(size_class, &window_classes);
+    container_get(owner);
+    vma->vm_private_data = owner;
+    vma->vm_ops = &window_vm_ops;
+    vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+    return 0;
+}
+
+
+//Zap nr pages of obj from page first in every window they can be seen
+//through. Called from object_zap_range().
+void window_zap(struct address_space *mapping, struct object *obj, unsigned long first, unsigned long nr)
+{
+    unsigned long stride;
+    unsigned int size_class;
+
+    for_each_set_bit(size_class, &window_classes, MCONTAINER_WINDOW_MAX_CLASS + 1)
+    {
+        stride = 1UL << size_class;
+        if (first >= stride || obj->oid >= (MCONTAINER_WINDOW_SPAN >> size_class))
+            continue;
+        unmap_mapping_range(mapping,
+                            (loff_t)(MCONTAINER_WINDOW_OID(size_class) + (obj->oid << size_class) + first) << PAGE_SHIFT,
+                            (loff_t)min(nr, stride - first) << PAGE_SHIFT, 1);
+    }
+}
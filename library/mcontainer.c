@@ -30,6 +30,104 @@
 ////////////////////////////////////////////////////////////////////////
 
 #include "mcontainer.h"
+#include "mock.h"
+
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+
+/**
+ * Whether calls go to the userspace mock instead of the kernel module:
+ * always in libmcontainer_mock, otherwise when MCONTAINER_BACKEND=mock.
+ */
+static int use_mock(void)
+{
+#ifdef MCONTAINER_FORCE_MOCK
+    return 1;
+#else
+    static int backend = -1;
+    if (backend < 0)
+    {
+        const char *name = getenv("MCONTAINER_BACKEND");
+        backend = name && strcmp(name, "mock") == 0;
+    }
+    return backend;
+#endif
+}
+
+// the metadata pages of the calling thread's container (NULL if they could
+// not be mapped), and the object mcontainer_read_consistent last read.
+// Each thread maps them on first use and drops them when it changes containers.
+static __thread int meta_devfd = -1;
+static __thread const struct memory_container_meta *meta_pages;
+static __thread __u64 consistent_oid;
+static __thread const char *consistent_data;
+static __thread __u64 consistent_size;
+
+static void consistent_forget(int devfd, __u64 offset)
+{
+    if (consistent_data && meta_devfd == devfd && consistent_oid == offset)
+    {
+        munmap((void *)consistent_data, consistent_size);
+        consistent_data = NULL;
+    }
+}
+
+static void thread_forget(void)
+{
+    consistent_forget(meta_devfd, consistent_oid);
+    if (meta_pages)
+        munmap((void *)meta_pages, MCONTAINER_META_PAGES * getpagesize());
+    meta_pages = NULL;
+    meta_devfd = -1;
+}
+
+static const struct memory_container_meta *thread_meta(int devfd)
+{
+    int saved_errno = errno;
+
+    if (meta_devfd != devfd)
+    {
+        thread_forget();
+        meta_devfd = devfd;
+        meta_pages = mcontainer_map_meta(devfd);
+        if (meta_pages == MAP_FAILED)
+            meta_pages = NULL;
+        errno = saved_errno;
+    }
+    return meta_pages;
+}
+
+// sealed objects need no locks, so lock and unlock do nothing for them.
+static int object_sealed(int devfd, __u64 offset)
+{
+    const struct memory_container_meta *meta;
+
+    if (offset >= MCONTAINER_META_SLOTS)
+        return 0;
+    meta = thread_meta(devfd);
+    return meta && (__atomic_load_n(&meta[offset].flags, __ATOMIC_ACQUIRE) & MCONTAINER_META_SEALED);
+}
+
+// objects without a metadata slot are only found to be sealed by the call itself.
+static int sealed_ok(int ret)
+{
+    if (ret < 0 && errno == EROFS)
+        return 0;
+    return ret;
+}
+
+/**
+ * Open the memory container device, or the mock standing in for it.
+ * Returns the devfd the other calls take, or -1 on failure.
+ */
+int mcontainer_open(void)
+{
+    if (use_mock())
+        return mock_open();
+    return open("/dev/mcontainer", O_RDWR);
+}
 
 /**
  * delete function in user space that sends command to kernel space
@@ -38,9 +136,25 @@
 int mcontainer_delete(int devfd)
 {
     struct memory_container_cmd cmd;
+    thread_forget();
+    if (use_mock())
+        return mock_delete(devfd);
     return ioctl(devfd, MCONTAINER_IOCTL_DELETE, &cmd);
 }
 
+/**
+ * Free the caller's container and every object in it in one call. No task
+ * is in the container afterwards, and mappings of its objects fault.
+ */
+int mcontainer_destroy(int devfd)
+{
+    struct memory_container_cmd cmd;
+    thread_forget();
+    if (use_mock())
+        return mock_destroy(devfd);
+    return ioctl(devfd, MCONTAINER_IOCTL_DESTROY, &cmd);
+}
+
 /**
  * create function in user space that sends command to kernel space
  * for creating the current task in specified container.
@@ -48,27 +162,61 @@ int mcontainer_delete(int devfd)
 int mcontainer_create(int devfd, int cid)
 {
     struct memory_container_cmd cmd;
+    thread_forget();
+    if (use_mock())
+        return mock_create(devfd, cid);
     cmd.cid = cid;
     return ioctl(devfd, MCONTAINER_IOCTL_CREATE, &cmd);
 }
 
 /**
  * Allocate memory in kernel space for sharing along with tasks in the same container.
+ * With offset | MCONTAINER_MAP_EXISTING an object that does not exist is
+ * not created, and the call fails with ENOENT.
  */
 void *mcontainer_alloc(int devfd, __u64 offset, __u64 size)
 {
     __u64 aligned_size = ((size + getpagesize() - 1) / getpagesize()) * getpagesize();
+    if (use_mock())
+        return mock_alloc(devfd, offset, size);
     return mmap(0, aligned_size, PROT_READ | PROT_WRITE, MAP_SHARED, devfd, offset * getpagesize());
 }
 
 /**
- * Lock a memory page
+ * Map the objects 0 to nr_objects - 1 of the current container as one
+ * window. Object oid is mcontainer_window_object(window, size_class, oid)
+ * and shows its first 1 << size_class pages; objects that do not exist
+ * are created with that many pages on first touch.
+ */
+void *mcontainer_map_window(int devfd, int size_class, __u64 nr_objects)
+{
+    if (use_mock())
+    {
+        mock_unsupported();
+        return MAP_FAILED;
+    }
+    if (size_class < 0 || size_class > MCONTAINER_WINDOW_MAX_CLASS)
+    {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    return mmap(0, (nr_objects << size_class) * getpagesize(), PROT_READ | PROT_WRITE, MAP_SHARED, devfd,
+                MCONTAINER_WINDOW_OID(size_class) * getpagesize());
+}
+
+/**
+ * Lock a memory page. Sealed objects are never locked, and this succeeds
+ * at once for them.
  */
 int mcontainer_lock(int devfd, __u64 offset)
 {
     struct memory_container_cmd cmd;
+    if (object_sealed(devfd, offset))
+        return 0;
+    if (use_mock())
+        return sealed_ok(mock_lock(devfd, offset));
     cmd.oid = offset;
-    return ioctl(devfd, MCONTAINER_IOCTL_LOCK, &cmd);
+    return sealed_ok(ioctl(devfd, MCONTAINER_IOCTL_LOCK, &cmd));
 }
 
 /**
@@ -77,8 +225,138 @@ int mcontainer_lock(int devfd, __u64 offset)
 int mcontainer_unlock(int devfd, __u64 offset)
 {
     struct memory_container_cmd cmd;
+    if (object_sealed(devfd, offset))
+        return 0;
+    if (use_mock())
+        return sealed_ok(mock_unlock(devfd, offset));
+    cmd.oid = offset;
+    return sealed_ok(ioctl(devfd, MCONTAINER_IOCTL_UNLOCK, &cmd));
+}
+
+// one *_MANY call, for the objects of oids that are not sealed.
+static int lock_many_call(int devfd, unsigned long cmd, const __u64 *oids, int n, int flags)
+{
+    struct memory_container_lock_many req;
+    __u64 kept[MCONTAINER_LOCK_MANY_MAX];
+    int i, nr = 0;
+
+    // counts out of range are left for the callee to reject
+    if (n > 0 && n <= MCONTAINER_LOCK_MANY_MAX)
+    {
+        for (i = 0; i < n; i++)
+        {
+            if (!object_sealed(devfd, oids[i]))
+                kept[nr++] = oids[i];
+        }
+        if (nr == 0)
+            return 0;
+        oids = kept;
+        n = nr;
+    }
+    if (use_mock())
+    {
+        if (cmd == MCONTAINER_IOCTL_LOCK_MANY)
+            return mock_lock_many(devfd, oids, n, flags);
+        return mock_unlock_many(devfd, oids, n);
+    }
+    req.oids = (__u64)(unsigned long)oids;
+    req.nr = n;
+    req.flags = flags;
+    return ioctl(devfd, cmd, &req);
+}
+
+/**
+ * Lock n objects at once. The kernel takes all of them or none, so tasks
+ * using this never deadlock however they order oids. Sealed objects are
+ * left out.
+ */
+int mcontainer_lock_many(int devfd, const __u64 *oids, int n)
+{
+    return lock_many_call(devfd, MCONTAINER_IOCTL_LOCK_MANY, oids, n, 0);
+}
+
+/**
+ * Like mcontainer_lock_many, but fail with EBUSY rather than wait
+ */
+int mcontainer_trylock_many(int devfd, const __u64 *oids, int n)
+{
+    return lock_many_call(devfd, MCONTAINER_IOCTL_LOCK_MANY, oids, n, MCONTAINER_LOCK_TRY);
+}
+
+/**
+ * Unlock n objects locked by this task
+ */
+int mcontainer_unlock_many(int devfd, const __u64 *oids, int n)
+{
+    return lock_many_call(devfd, MCONTAINER_IOCTL_UNLOCK_MANY, oids, n, 0);
+}
+
+// one barrier or condition variable call.
+static int sync_call(int devfd, unsigned long cmd, __u64 id, __u64 offset, int count, int flags)
+{
+    struct memory_container_sync req;
+    req.id = id;
+    req.oid = offset;
+    req.count = count;
+    req.flags = flags;
+    return ioctl(devfd, cmd, &req);
+}
+
+/**
+ * Wait until n tasks of the current container have reached barrier id.
+ * Returns 1 in the task that arrived last and 0 in the others.
+ */
+int mcontainer_barrier_wait(int devfd, __u64 id, int n)
+{
+    if (use_mock())
+        return mock_barrier_wait(devfd, id, n);
+    return sync_call(devfd, MCONTAINER_IOCTL_BARRIER, id, 0, n, 0);
+}
+
+/**
+ * Unlock object offset, which this task has locked, wait for condition
+ * variable id to be signalled and lock the object again. Check the
+ * condition again after it returns; on failure the object is not locked.
+ */
+int mcontainer_cond_wait(int devfd, __u64 id, __u64 offset)
+{
+    if (use_mock())
+        return mock_cond_wait(devfd, id, offset);
+    return sync_call(devfd, MCONTAINER_IOCTL_COND_WAIT, id, offset, 0, 0);
+}
+
+/**
+ * Wake one task waiting on condition variable id
+ */
+int mcontainer_cond_signal(int devfd, __u64 id)
+{
+    if (use_mock())
+        return mock_cond_signal(devfd, id, 0);
+    return sync_call(devfd, MCONTAINER_IOCTL_COND_SIGNAL, id, 0, 0, 0);
+}
+
+/**
+ * Wake every task waiting on condition variable id
+ */
+int mcontainer_cond_broadcast(int devfd, __u64 id)
+{
+    if (use_mock())
+        return mock_cond_signal(devfd, id, MCONTAINER_COND_BROADCAST);
+    return sync_call(devfd, MCONTAINER_IOCTL_COND_SIGNAL, id, 0, 0, MCONTAINER_COND_BROADCAST);
+}
+
+/**
+ * Make an object read-only for every task for good. Later mappings are
+ * read-only and writes through earlier ones fail; lock and unlock do
+ * nothing for it. Fails with EBUSY while its lock is held.
+ */
+int mcontainer_seal(int devfd, __u64 offset)
+{
+    struct memory_container_cmd cmd;
+    if (use_mock())
+        return mock_seal(devfd, offset);
     cmd.oid = offset;
-    return ioctl(devfd, MCONTAINER_IOCTL_UNLOCK, &cmd);
+    return ioctl(devfd, MCONTAINER_IOCTL_SEAL, &cmd);
 }
 
 /**
@@ -87,6 +365,275 @@ int mcontainer_unlock(int devfd, __u64 offset)
 int mcontainer_free(int devfd, __u64 offset)
 {
     struct memory_container_cmd cmd;
+    consistent_forget(devfd, offset);
+    if (use_mock())
+        return mock_free(devfd, offset);
     cmd.oid = offset;
     return ioctl(devfd, MCONTAINER_IOCTL_FREE, &cmd);
-}
\ No newline at end of file
+}
+
+/**
+ * Free the objects from offset to offset + count - 1 that exist in one
+ * call. Returns how many there were.
+ */
+int mcontainer_free_range(int devfd, __u64 offset, __u64 count)
+{
+    struct memory_container_cmd cmd;
+    if (consistent_data && meta_devfd == devfd && consistent_oid >= offset && consistent_oid - offset < count)
+        consistent_forget(devfd, consistent_oid);
+    if (use_mock())
+        return mock_free_range(devfd, offset, count);
+    cmd.oid = offset;
+    cmd.op = count;
+    return ioctl(devfd, MCONTAINER_IOCTL_FREE_RANGE, &cmd);
+}
+
+/**
+ * Read the size and size class of an object without mapping it
+ */
+int mcontainer_size(int devfd, __u64 offset, struct memory_container_size *size)
+{
+    if (use_mock())
+        return mock_size(devfd, offset, size);
+    size->oid = offset;
+    return ioctl(devfd, MCONTAINER_IOCTL_SIZE, size);
+}
+
+/**
+ * Describe up to nr objects of the current container from oid *cursor on,
+ * in oid order, moving *cursor past them. Returns how many, 0 once the
+ * whole container has been walked.
+ */
+int mcontainer_enumerate(int devfd, __u64 *cursor, struct memory_container_object_info *objects, int nr)
+{
+    struct memory_container_enumerate request;
+    int ret;
+
+    if (use_mock())
+        return mock_enumerate(devfd, cursor, objects, nr);
+    request.cursor = *cursor;
+    request.objects = (__u64)(unsigned long)objects;
+    request.nr = nr;
+    request.flags = 0;
+    ret = ioctl(devfd, MCONTAINER_IOCTL_ENUMERATE, &request);
+    if (ret >= 0)
+        *cursor = request.cursor;
+    return ret;
+}
+
+/**
+ * Grow or shrink an object to new_size bytes in place, keeping its contents,
+ * and move the caller's mapping of old_size bytes at mapped_data (NULL for
+ * none) over to the new size. Returns the new mapping like mcontainer_alloc;
+ * on failure the old mapping is left alone.
+ */
+void *mcontainer_resize(int devfd, __u64 offset, void *mapped_data, __u64 old_size, __u64 new_size)
+{
+    struct memory_container_size size;
+    void *new_data;
+    int ret;
+
+    if (use_mock())
+        return mock_resize(devfd, offset, mapped_data, old_size, new_size);
+    size.oid = offset;
+    size.size = new_size;
+    ret = ioctl(devfd, MCONTAINER_IOCTL_RESIZE, &size);
+    if (ret < 0)
+        return MAP_FAILED;
+    // mappings of the device cannot be mremap()ed bigger
+    new_data = mcontainer_alloc(devfd, offset, new_size);
+    if (new_data != MAP_FAILED && mapped_data)
+        munmap(mapped_data, ((old_size + getpagesize() - 1) / getpagesize()) * getpagesize());
+    return new_data;
+}
+
+/**
+ * Read the module-wide event counters
+ */
+int mcontainer_stats(int devfd, struct memory_container_stats *stats)
+{
+    if (use_mock())
+        return mock_stats(devfd, stats);
+    return ioctl(devfd, MCONTAINER_IOCTL_STATS, stats);
+}
+
+/**
+ * Let the kernel compress idle objects of the current container under
+ * memory pressure (enable != 0), or stop it from doing so.
+ */
+int mcontainer_reclaim(int devfd, int enable)
+{
+    struct memory_container_cmd cmd;
+    if (use_mock())
+        return mock_unsupported();
+    cmd.op = enable;
+    return ioctl(devfd, MCONTAINER_IOCTL_RECLAIM, &cmd);
+}
+
+/**
+ * Read the compression statistics of the current container
+ */
+int mcontainer_reclaim_stats(int devfd, struct memory_container_reclaim_stats *stats)
+{
+    if (use_mock())
+        return mock_unsupported();
+    return ioctl(devfd, MCONTAINER_IOCTL_RECLAIM_STATS, stats);
+}
+
+/**
+ * Let the kernel merge identical pages of the current container's objects
+ * in the background (enable != 0), or stop it from merging more.
+ */
+int mcontainer_dedup(int devfd, int enable)
+{
+    struct memory_container_cmd cmd;
+    if (use_mock())
+        return mock_unsupported();
+    cmd.op = enable;
+    return ioctl(devfd, MCONTAINER_IOCTL_DEDUP, &cmd);
+}
+
+/**
+ * Read the deduplication statistics of the current container
+ */
+int mcontainer_dedup_stats(int devfd, struct memory_container_dedup_stats *stats)
+{
+    if (use_mock())
+        return mock_unsupported();
+    return ioctl(devfd, MCONTAINER_IOCTL_DEDUP_STATS, stats);
+}
+
+/**
+ * Hand an object over to another container without copying it.
+ * flags takes MCONTAINER_TRANSFER_ALIAS to keep a read-only snapshot.
+ */
+int mcontainer_transfer(int devfd, __u64 offset, int cid, int flags)
+{
+    struct memory_container_cmd cmd;
+    if (use_mock())
+        return mock_unsupported();
+    cmd.op = flags;
+    cmd.cid = cid;
+    cmd.oid = offset;
+    return ioctl(devfd, MCONTAINER_IOCTL_TRANSFER, &cmd);
+}
+
+/**
+ * Get a read-only file descriptor onto an object, usable with read(),
+ * sendfile() and splice(). Returns the descriptor, or -1 on failure.
+ */
+int mcontainer_export(int devfd, __u64 offset)
+{
+    struct memory_container_cmd cmd;
+    if (use_mock())
+        return mock_unsupported();
+    cmd.oid = offset;
+    return ioctl(devfd, MCONTAINER_IOCTL_EXPORT, &cmd);
+}
+
+/**
+ * Write every object of the current container to the open file fd
+ */
+int mcontainer_save(int devfd, int fd)
+{
+    struct memory_container_cmd cmd;
+    if (use_mock())
+        return mock_unsupported();
+    cmd.op = fd;
+    return ioctl(devfd, MCONTAINER_IOCTL_SAVE, &cmd);
+}
+
+/**
+ * Recreate the objects saved in the open file fd in the current container.
+ * Pages are read from the file on first access, so keep it unchanged.
+ */
+int mcontainer_restore(int devfd, int fd)
+{
+    struct memory_container_cmd cmd;
+    if (use_mock())
+        return mock_unsupported();
+    cmd.op = fd;
+    return ioctl(devfd, MCONTAINER_IOCTL_RESTORE, &cmd);
+}
+
+/**
+ * Start (enable != 0) or stop being told about changes to an object
+ * through poll() and read() on devfd.
+ */
+int mcontainer_watch(int devfd, __u64 offset, int enable)
+{
+    struct memory_container_cmd cmd;
+    if (use_mock())
+        return mock_unsupported();
+    cmd.oid = offset;
+    cmd.op = enable;
+    return ioctl(devfd, MCONTAINER_IOCTL_WATCH, &cmd);
+}
+
+/**
+ * Map the current container's metadata pages read-only. Slot oid holds
+ * the generation and the sequence count of object oid.
+ */
+const struct memory_container_meta *mcontainer_map_meta(int devfd)
+{
+    if (use_mock())
+        return mock_map_meta(devfd);
+    return (const struct memory_container_meta *)mmap(0, MCONTAINER_META_PAGES * getpagesize(), PROT_READ,
+                                                      MAP_SHARED, devfd, MCONTAINER_META_OID * getpagesize());
+}
+
+/**
+ * Copy the first len bytes of an object into buf without locking it, for
+ * objects whose writers change them only while holding mcontainer_lock.
+ * The copy is retried until no writer held the lock during it. The
+ * metadata pages and the object stay mapped for the next call of the
+ * same thread. Returns the number of retries, or -1 on failure; objects
+ * from MCONTAINER_META_SLOTS up have no sequence count and fail with EINVAL,
+ * and objects that do not exist fail with ENOENT instead of being created.
+ */
+int mcontainer_read_consistent(int devfd, __u64 offset, void *buf, __u64 len)
+{
+    __u64 size = ((len + getpagesize() - 1) / getpagesize()) * getpagesize(), seq;
+    const __u64 *seqp;
+    int retries = 0;
+
+    if (offset >= MCONTAINER_META_SLOTS)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!thread_meta(devfd))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (consistent_data && (consistent_oid != offset || consistent_size < size))
+        consistent_forget(devfd, consistent_oid);
+    if (!consistent_data)
+    {
+        // reading must not bring the object into being.
+        void *mapped_data = mcontainer_alloc(devfd, offset | MCONTAINER_MAP_EXISTING, size);
+        if (mapped_data == MAP_FAILED)
+            return -1;
+        consistent_data = (const char *)mapped_data;
+        consistent_oid = offset;
+        consistent_size = size;
+    }
+
+    seqp = &meta_pages[offset].seq;
+    for (;; retries++)
+    {
+        seq = __atomic_load_n(seqp, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+        {
+            // a writer holds the lock; let it run if we share its CPU
+            if (retries % 64 == 63)
+                sched_yield();
+            continue;
+        }
+        memcpy(buf, consistent_data, len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(seqp, __ATOMIC_RELAXED) == seq)
+            return retries;
+    }
+}
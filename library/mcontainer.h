@@ -42,12 +42,45 @@ extern "C"
 #include <stdio.h>
 #include <stdlib.h>
 
+    int mcontainer_open(void);
     int mcontainer_delete(int devfd);
+    int mcontainer_destroy(int devfd);
     int mcontainer_create(int devfd, int cid);
     void *mcontainer_alloc(int devfd, __u64 offset, __u64 size);
+    void *mcontainer_map_window(int devfd, int size_class, __u64 nr_objects);
     int mcontainer_lock(int devfd, __u64 offset);
     int mcontainer_unlock(int devfd, __u64 offset);
+    int mcontainer_lock_many(int devfd, const __u64 *oids, int n);
+    int mcontainer_trylock_many(int devfd, const __u64 *oids, int n);
+    int mcontainer_unlock_many(int devfd, const __u64 *oids, int n);
+    int mcontainer_barrier_wait(int devfd, __u64 id, int n);
+    int mcontainer_cond_wait(int devfd, __u64 id, __u64 offset);
+    int mcontainer_cond_signal(int devfd, __u64 id);
+    int mcontainer_cond_broadcast(int devfd, __u64 id);
+    int mcontainer_seal(int devfd, __u64 offset);
     int mcontainer_free(int devfd, __u64 offset);
+    int mcontainer_free_range(int devfd, __u64 offset, __u64 count);
+    int mcontainer_size(int devfd, __u64 offset, struct memory_container_size *size);
+    int mcontainer_enumerate(int devfd, __u64 *cursor, struct memory_container_object_info *objects, int nr);
+    void *mcontainer_resize(int devfd, __u64 offset, void *mapped_data, __u64 old_size, __u64 new_size);
+    int mcontainer_stats(int devfd, struct memory_container_stats *stats);
+    int mcontainer_reclaim(int devfd, int enable);
+    int mcontainer_reclaim_stats(int devfd, struct memory_container_reclaim_stats *stats);
+    int mcontainer_dedup(int devfd, int enable);
+    int mcontainer_dedup_stats(int devfd, struct memory_container_dedup_stats *stats);
+    int mcontainer_transfer(int devfd, __u64 offset, int cid, int flags);
+    int mcontainer_export(int devfd, __u64 offset);
+    int mcontainer_save(int devfd, int fd);
+    int mcontainer_restore(int devfd, int fd);
+    int mcontainer_watch(int devfd, __u64 offset, int enable);
+    const struct memory_container_meta *mcontainer_map_meta(int devfd);
+    int mcontainer_read_consistent(int devfd, __u64 offset, void *buf, __u64 len);
+
+    // where object oid starts in a window of size_class
+    static inline void *mcontainer_window_object(void *window, int size_class, __u64 oid)
+    {
+        return (char *)window + (oid << size_class) * getpagesize();
+    }
 
 #ifdef __cplusplus
 }
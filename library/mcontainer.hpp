@@ -0,0 +1,225 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Header-Only C++ Interface of Memory Container in User Space
+//
+//     Thin RAII wrappers over the C calls in mcontainer.h: a Container
+//     owns the device descriptor and the task's membership, an Object<T>
+//     owns one mapping, and every object has a lockable usable with
+//     std::lock_guard. Everything is inline and adds no state beyond
+//     what the C calls need.
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef MCONTAINER_HPP
+#define MCONTAINER_HPP
+
+#include <mcontainer.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+namespace mcontainer
+{
+
+// a contiguous run of T, for range-for and algorithms.
+template <typename T>
+class Span
+{
+public:
+    Span(T *data, std::size_t size) : data_(data), size_(size) {}
+
+    T *data() const { return data_; }
+    std::size_t size() const { return size_; }
+    T *begin() const { return data_; }
+    T *end() const { return data_ + size_; }
+    T &operator[](std::size_t i) const { return data_[i]; }
+
+private:
+    T *data_;
+    std::size_t size_;
+};
+
+// the container lock as seen through one object; meets BasicLockable.
+class ObjectLock
+{
+public:
+    ObjectLock(int devfd, __u64 oid) : devfd_(devfd), oid_(oid) {}
+
+    // a critical section must not run unlocked, so failures throw. One in
+    // unlock() from a std::lock_guard's destructor ends the program.
+    void lock()
+    {
+        if (mcontainer_lock(devfd_, oid_) < 0)
+            throw std::system_error(errno, std::generic_category(), "mcontainer_lock");
+    }
+
+    void unlock()
+    {
+        if (mcontainer_unlock(devfd_, oid_) < 0)
+            throw std::system_error(errno, std::generic_category(), "mcontainer_unlock");
+    }
+
+private:
+    int devfd_;
+    __u64 oid_;
+};
+
+// a mapping of count T's of object oid, unmapped when it goes away.
+template <typename T>
+class Object
+{
+    static_assert(std::is_trivially_copyable<T>::value, "objects hold raw memory shared between tasks");
+
+public:
+    Object(int devfd, __u64 oid, std::size_t count = 1)
+        : lock_(devfd, oid), devfd_(devfd), oid_(oid), count_(count),
+          data_(static_cast<T *>(mcontainer_alloc(devfd, oid, count * sizeof(T))))
+    {
+        if (data_ == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "mcontainer_alloc");
+    }
+
+    ~Object()
+    {
+        if (data_)
+            munmap(data_, bytes());
+    }
+
+    Object(Object &&other)
+        : lock_(other.lock_), devfd_(other.devfd_), oid_(other.oid_), count_(other.count_), data_(other.data_)
+    {
+        other.data_ = nullptr;
+    }
+
+    Object &operator=(Object &&other)
+    {
+        if (this != &other)
+        {
+            if (data_)
+                munmap(data_, bytes());
+            lock_ = other.lock_;
+            devfd_ = other.devfd_;
+            oid_ = other.oid_;
+            count_ = other.count_;
+            data_ = other.data_;
+            other.data_ = nullptr;
+        }
+        return *this;
+    }
+
+    Object(const Object &) = delete;
+    Object &operator=(const Object &) = delete;
+
+    __u64 oid() const { return oid_; }
+    std::size_t size() const { return count_; }
+    T *data() const { return data_; }
+    T &operator*() const { return *data_; }
+    T *operator->() const { return data_; }
+    T &operator[](std::size_t i) const { return data_[i]; }
+    Span<T> span() const { return Span<T>(data_, count_); }
+
+    // grow or shrink the object to count T's in place, keeping its contents.
+    void resize(std::size_t count)
+    {
+        void *data = mcontainer_resize(devfd_, oid_, data_, count_ * sizeof(T), count * sizeof(T));
+        if (data == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "mcontainer_resize");
+        data_ = static_cast<T *>(data);
+        count_ = count;
+    }
+
+    // for std::lock_guard<ObjectLock> guard(object.mutex());
+    ObjectLock &mutex() { return lock_; }
+
+private:
+    std::size_t bytes() const
+    {
+        std::size_t page = getpagesize();
+        return (count_ * sizeof(T) + page - 1) / page * page;
+    }
+
+    ObjectLock lock_;
+    int devfd_;
+    __u64 oid_;
+    std::size_t count_;
+    T *data_;
+};
+
+// the device (or mock) descriptor and this task's membership of container cid.
+class Container
+{
+public:
+    explicit Container(int cid) : devfd_(mcontainer_open())
+    {
+        if (devfd_ < 0)
+            throw std::system_error(errno, std::generic_category(), "mcontainer_open");
+        if (mcontainer_create(devfd_, cid) < 0)
+        {
+            int error = errno;
+            close(devfd_);
+            throw std::system_error(error, std::generic_category(), "mcontainer_create");
+        }
+    }
+
+    ~Container()
+    {
+        if (devfd_ >= 0)
+        {
+            mcontainer_delete(devfd_);
+            close(devfd_);
+        }
+    }
+
+    Container(Container &&other) : devfd_(other.devfd_) { other.devfd_ = -1; }
+    Container(const Container &) = delete;
+    Container &operator=(const Container &) = delete;
+
+    int fd() const { return devfd_; }
+
+    template <typename T>
+    Object<T> map(__u64 oid, std::size_t count = 1) const
+    {
+        return Object<T>(devfd_, oid, count);
+    }
+
+    ObjectLock lockable(__u64 oid) const { return ObjectLock(devfd_, oid); }
+
+    void free(__u64 oid) const { mcontainer_free(devfd_, oid); }
+
+    int free_range(__u64 oid, __u64 count) const { return mcontainer_free_range(devfd_, oid, count); }
+
+private:
+    int devfd_;
+};
+
+}
+
+#endif
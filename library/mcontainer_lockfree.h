@@ -0,0 +1,442 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Lock-Free Structures Laid Out Inside Container Objects
+//
+//     Everything here lives entirely inside the memory of an object and
+//     refers to itself only by offsets, so tasks that map the object at
+//     different addresses, in different processes, can share it. None of
+//     the operations makes a system call. One task initializes the memory
+//     with the *_init call; the others wait for *_attach to succeed.
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef MCONTAINER_LOCKFREE_H
+#define MCONTAINER_LOCKFREE_H
+
+#include <linux/types.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define MCONTAINER_CACHE_LINE 64
+
+#define MCONTAINER_RING_MAGIC 0x474e495243504d4dULL
+#define MCONTAINER_SPSC_MAGIC 0x43535053434d4dULL
+#define MCONTAINER_HASHMAP_MAGIC 0x50414d48534d4dULL
+#define MCONTAINER_FREELIST_MAGIC 0x5453494c45524646ULL
+
+#define mcontainer_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define mcontainer_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define mcontainer_cas(p, expected, desired) \
+    __atomic_compare_exchange_n(p, expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+static inline int mcontainer_is_power_of_2(__u64 n)
+{
+    return n && !(n & (n - 1));
+}
+
+static inline void *mcontainer_publish(void *mem, __u64 *magic_field, __u64 magic)
+{
+    mcontainer_store(magic_field, magic);
+    return mem;
+}
+
+/*
+ * Bounded multi-producer multi-consumer queue of fixed-size elements.
+ * Each cell carries a sequence number telling producers and consumers
+ * whose turn it is, so the indices are the only contended words.
+ */
+struct mcontainer_ring
+{
+    __u64 magic;
+    __u32 capacity, elem_size, cell_size;
+    char pad0[MCONTAINER_CACHE_LINE - 20];
+    __u64 enqueue_pos;
+    char pad1[MCONTAINER_CACHE_LINE - 8];
+    __u64 dequeue_pos;
+    char pad2[MCONTAINER_CACHE_LINE - 8];
+};
+
+static inline size_t mcontainer_ring_cell_size(__u32 elem_size)
+{
+    return sizeof(__u64) + ((elem_size + 7) & ~7U);
+}
+
+static inline size_t mcontainer_ring_bytes(__u32 capacity, __u32 elem_size)
+{
+    return sizeof(struct mcontainer_ring) + (size_t)capacity * mcontainer_ring_cell_size(elem_size);
+}
+
+static inline __u64 *mcontainer_ring_cell(struct mcontainer_ring *ring, __u64 pos)
+{
+    return (__u64 *)((char *)(ring + 1) + (pos & (ring->capacity - 1)) * ring->cell_size);
+}
+
+static inline struct mcontainer_ring *mcontainer_ring_init(void *mem, size_t bytes, __u32 capacity, __u32 elem_size)
+{
+    struct mcontainer_ring *ring = (struct mcontainer_ring *)mem;
+    __u32 i;
+
+    if (!mcontainer_is_power_of_2(capacity) || bytes < mcontainer_ring_bytes(capacity, elem_size))
+        return NULL;
+    memset(ring, 0, sizeof(*ring));
+    ring->capacity = capacity;
+    ring->elem_size = elem_size;
+    ring->cell_size = (__u32)mcontainer_ring_cell_size(elem_size);
+    for (i = 0; i < capacity; i++)
+        *mcontainer_ring_cell(ring, i) = i;
+    return (struct mcontainer_ring *)mcontainer_publish(mem, &ring->magic, MCONTAINER_RING_MAGIC);
+}
+
+static inline struct mcontainer_ring *mcontainer_ring_attach(void *mem)
+{
+    struct mcontainer_ring *ring = (struct mcontainer_ring *)mem;
+    return mcontainer_load(&ring->magic) == MCONTAINER_RING_MAGIC ? ring : NULL;
+}
+
+// returns 0, or -1 if the ring is full.
+static inline int mcontainer_ring_enqueue(struct mcontainer_ring *ring, const void *elem)
+{
+    __u64 pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED), *cell;
+
+    for (;;)
+    {
+        __s64 diff;
+        cell = mcontainer_ring_cell(ring, pos);
+        diff = (__s64)(mcontainer_load(cell) - pos);
+        if (diff == 0)
+        {
+            if (mcontainer_cas(&ring->enqueue_pos, &pos, pos + 1))
+                break;
+        }
+        else if (diff < 0)
+            return -1;
+        else
+            pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    }
+    memcpy(cell + 1, elem, ring->elem_size);
+    mcontainer_store(cell, pos + 1);
+    return 0;
+}
+
+// returns 0, or -1 if the ring is empty.
+static inline int mcontainer_ring_dequeue(struct mcontainer_ring *ring, void *elem)
+{
+    __u64 pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED), *cell;
+
+    for (;;)
+    {
+        __s64 diff;
+        cell = mcontainer_ring_cell(ring, pos);
+        diff = (__s64)(mcontainer_load(cell) - (pos + 1));
+        if (diff == 0)
+        {
+            if (mcontainer_cas(&ring->dequeue_pos, &pos, pos + 1))
+                break;
+        }
+        else if (diff < 0)
+            return -1;
+        else
+            pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    }
+    memcpy(elem, cell + 1, ring->elem_size);
+    mcontainer_store(cell, pos + ring->capacity);
+    return 0;
+}
+
+/*
+ * Single-producer single-consumer queue. Each side keeps its own index
+ * and a cached copy of the other's on its own cache line, and only
+ * reads the other side's index when the cache says full or empty.
+ */
+struct mcontainer_spsc
+{
+    __u64 magic;
+    __u32 capacity, elem_size;
+    char pad0[MCONTAINER_CACHE_LINE - 16];
+    __u64 tail, head_cache;
+    char pad1[MCONTAINER_CACHE_LINE - 16];
+    __u64 head, tail_cache;
+    char pad2[MCONTAINER_CACHE_LINE - 16];
+};
+
+static inline size_t mcontainer_spsc_bytes(__u32 capacity, __u32 elem_size)
+{
+    return sizeof(struct mcontainer_spsc) + (size_t)capacity * elem_size;
+}
+
+static inline void *mcontainer_spsc_slot(struct mcontainer_spsc *q, __u64 pos)
+{
+    return (char *)(q + 1) + (pos & (q->capacity - 1)) * q->elem_size;
+}
+
+static inline struct mcontainer_spsc *mcontainer_spsc_init(void *mem, size_t bytes, __u32 capacity, __u32 elem_size)
+{
+    struct mcontainer_spsc *q = (struct mcontainer_spsc *)mem;
+
+    if (!mcontainer_is_power_of_2(capacity) || bytes < mcontainer_spsc_bytes(capacity, elem_size))
+        return NULL;
+    memset(q, 0, sizeof(*q));
+    q->capacity = capacity;
+    q->elem_size = elem_size;
+    return (struct mcontainer_spsc *)mcontainer_publish(mem, &q->magic, MCONTAINER_SPSC_MAGIC);
+}
+
+static inline struct mcontainer_spsc *mcontainer_spsc_attach(void *mem)
+{
+    struct mcontainer_spsc *q = (struct mcontainer_spsc *)mem;
+    return mcontainer_load(&q->magic) == MCONTAINER_SPSC_MAGIC ? q : NULL;
+}
+
+static inline int mcontainer_spsc_enqueue(struct mcontainer_spsc *q, const void *elem)
+{
+    __u64 tail = q->tail;
+
+    if (tail - q->head_cache == q->capacity)
+    {
+        q->head_cache = mcontainer_load(&q->head);
+        if (tail - q->head_cache == q->capacity)
+            return -1;
+    }
+    memcpy(mcontainer_spsc_slot(q, tail), elem, q->elem_size);
+    mcontainer_store(&q->tail, tail + 1);
+    return 0;
+}
+
+static inline int mcontainer_spsc_dequeue(struct mcontainer_spsc *q, void *elem)
+{
+    __u64 head = q->head;
+
+    if (head == q->tail_cache)
+    {
+        q->tail_cache = mcontainer_load(&q->tail);
+        if (head == q->tail_cache)
+            return -1;
+    }
+    memcpy(elem, mcontainer_spsc_slot(q, head), q->elem_size);
+    mcontainer_store(&q->head, head + 1);
+    return 0;
+}
+
+/*
+ * Fixed-capacity map from non-zero 64-bit keys to 64-bit values with
+ * linear probing. A key, once inserted, keeps its slot for good; removing
+ * it stores the value 0, which reads back as absent.
+ */
+struct mcontainer_hashmap
+{
+    __u64 magic;
+    __u64 capacity;
+    char pad0[MCONTAINER_CACHE_LINE - 16];
+};
+
+struct mcontainer_hashmap_entry
+{
+    __u64 key, value;
+};
+
+static inline size_t mcontainer_hashmap_bytes(__u64 capacity)
+{
+    return sizeof(struct mcontainer_hashmap) + capacity * sizeof(struct mcontainer_hashmap_entry);
+}
+
+static inline struct mcontainer_hashmap_entry *mcontainer_hashmap_entries(struct mcontainer_hashmap *map)
+{
+    return (struct mcontainer_hashmap_entry *)(map + 1);
+}
+
+static inline __u64 mcontainer_hashmap_hash(__u64 key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+static inline struct mcontainer_hashmap *mcontainer_hashmap_init(void *mem, size_t bytes, __u64 capacity)
+{
+    struct mcontainer_hashmap *map = (struct mcontainer_hashmap *)mem;
+
+    if (!mcontainer_is_power_of_2(capacity) || bytes < mcontainer_hashmap_bytes(capacity))
+        return NULL;
+    memset(mem, 0, mcontainer_hashmap_bytes(capacity));
+    map->capacity = capacity;
+    return (struct mcontainer_hashmap *)mcontainer_publish(mem, &map->magic, MCONTAINER_HASHMAP_MAGIC);
+}
+
+static inline struct mcontainer_hashmap *mcontainer_hashmap_attach(void *mem)
+{
+    struct mcontainer_hashmap *map = (struct mcontainer_hashmap *)mem;
+    return mcontainer_load(&map->magic) == MCONTAINER_HASHMAP_MAGIC ? map : NULL;
+}
+
+// the entry of key, claiming an empty one if create is set; NULL if absent or full.
+static inline struct mcontainer_hashmap_entry *mcontainer_hashmap_find(struct mcontainer_hashmap *map, __u64 key,
+                                                                       int create)
+{
+    struct mcontainer_hashmap_entry *entries = mcontainer_hashmap_entries(map);
+    __u64 i, index = mcontainer_hashmap_hash(key);
+
+    for (i = 0; i < map->capacity; i++, index++)
+    {
+        struct mcontainer_hashmap_entry *e = &entries[index & (map->capacity - 1)];
+        __u64 found = mcontainer_load(&e->key);
+
+        if (found == key)
+            return e;
+        if (found == 0)
+        {
+            if (!create)
+                return NULL;
+            if (mcontainer_cas(&e->key, &found, key) || found == key)
+                return e;
+        }
+    }
+    return NULL;
+}
+
+// returns 0, or -1 if key is 0 or the map is full.
+static inline int mcontainer_hashmap_put(struct mcontainer_hashmap *map, __u64 key, __u64 value)
+{
+    struct mcontainer_hashmap_entry *e = key ? mcontainer_hashmap_find(map, key, 1) : NULL;
+
+    if (!e)
+        return -1;
+    mcontainer_store(&e->value, value);
+    return 0;
+}
+
+// the value of key, or 0 if it has none.
+static inline __u64 mcontainer_hashmap_get(struct mcontainer_hashmap *map, __u64 key)
+{
+    struct mcontainer_hashmap_entry *e = key ? mcontainer_hashmap_find(map, key, 0) : NULL;
+    return e ? mcontainer_load(&e->value) : 0;
+}
+
+static inline void mcontainer_hashmap_remove(struct mcontainer_hashmap *map, __u64 key)
+{
+    struct mcontainer_hashmap_entry *e = key ? mcontainer_hashmap_find(map, key, 0) : NULL;
+    if (e)
+        mcontainer_store(&e->value, 0);
+}
+
+/*
+ * Allocator of fixed-size blocks. Free blocks form a stack threaded
+ * through a separate array of next indices; the head carries a tag that
+ * changes on every update so a stale compare-and-swap cannot succeed.
+ * Blocks are named by index, which every task can turn into a pointer.
+ */
+struct mcontainer_freelist
+{
+    __u64 magic;
+    __u32 block_size, nr_blocks;
+    char pad0[MCONTAINER_CACHE_LINE - 16];
+    // tag << 32 | (index of the first free block + 1)
+    __u64 head;
+    char pad1[MCONTAINER_CACHE_LINE - 8];
+};
+
+static inline size_t mcontainer_freelist_blocks_offset(__u32 nr_blocks)
+{
+    size_t offset = sizeof(struct mcontainer_freelist) + (size_t)nr_blocks * sizeof(__u32);
+    return (offset + MCONTAINER_CACHE_LINE - 1) & ~(size_t)(MCONTAINER_CACHE_LINE - 1);
+}
+
+static inline size_t mcontainer_freelist_bytes(__u32 nr_blocks, __u32 block_size)
+{
+    return mcontainer_freelist_blocks_offset(nr_blocks) + (size_t)nr_blocks * block_size;
+}
+
+static inline __u32 *mcontainer_freelist_next(struct mcontainer_freelist *fl)
+{
+    return (__u32 *)(fl + 1);
+}
+
+static inline void *mcontainer_freelist_block(struct mcontainer_freelist *fl, __u32 index)
+{
+    return (char *)fl + mcontainer_freelist_blocks_offset(fl->nr_blocks) + (size_t)index * fl->block_size;
+}
+
+static inline struct mcontainer_freelist *mcontainer_freelist_init(void *mem, size_t bytes, __u32 nr_blocks,
+                                                                   __u32 block_size)
+{
+    struct mcontainer_freelist *fl = (struct mcontainer_freelist *)mem;
+    __u32 i;
+
+    if (!nr_blocks || bytes < mcontainer_freelist_bytes(nr_blocks, block_size))
+        return NULL;
+    memset(fl, 0, sizeof(*fl));
+    fl->block_size = block_size;
+    fl->nr_blocks = nr_blocks;
+    for (i = 0; i < nr_blocks; i++)
+        mcontainer_freelist_next(fl)[i] = i + 1 < nr_blocks ? i + 2 : 0;
+    fl->head = 1;
+    return (struct mcontainer_freelist *)mcontainer_publish(mem, &fl->magic, MCONTAINER_FREELIST_MAGIC);
+}
+
+static inline struct mcontainer_freelist *mcontainer_freelist_attach(void *mem)
+{
+    struct mcontainer_freelist *fl = (struct mcontainer_freelist *)mem;
+    return mcontainer_load(&fl->magic) == MCONTAINER_FREELIST_MAGIC ? fl : NULL;
+}
+
+// index of a free block, or -1 if there is none.
+static inline long mcontainer_freelist_alloc(struct mcontainer_freelist *fl)
+{
+    __u64 head = mcontainer_load(&fl->head), next;
+
+    do
+    {
+        if ((__u32)head == 0)
+            return -1;
+        next = __atomic_load_n(&mcontainer_freelist_next(fl)[(__u32)head - 1], __ATOMIC_RELAXED);
+        next |= ((head >> 32) + 1) << 32;
+    } while (!mcontainer_cas(&fl->head, &head, next));
+    return (long)(__u32)head - 1;
+}
+
+static inline void mcontainer_freelist_free(struct mcontainer_freelist *fl, __u32 index)
+{
+    __u64 head = mcontainer_load(&fl->head), next;
+
+    do
+    {
+        __atomic_store_n(&mcontainer_freelist_next(fl)[index], (__u32)head, __ATOMIC_RELAXED);
+        next = ((head >> 32) + 1) << 32 | (index + 1);
+    } while (!mcontainer_cas(&fl->head, &head, next));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1160 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Userspace Mock of the Memory Container Kernel Module
+//
+//     Containers live in a POSIX shared memory registry and objects in one
+//     shared memory segment each, so tasks of different processes see the
+//     same objects just as they would through /dev/mcontainer. Like the
+//     module, containers and objects outlive the tasks that use them; the
+//     segments go away with shm_unlink, or a reboot.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "mock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define MOCK_DEFAULT_NAME "/mcontainer-mock"
+#define MOCK_MAX_CONTAINERS 4096
+#define MOCK_LOCK_SLOTS 8192
+#define MOCK_STAT_CPUS 256
+#define MOCK_SYNC_SLOTS 256
+
+struct mock_container
+{
+    int used;
+    __u64 cid;
+    // last generation handed out to any of its objects; never goes back.
+    __u64 generation;
+};
+
+// a held object lock; slots are found by linear probing on (container, oid).
+struct mock_lock
+{
+    int state;
+    int container;
+    __u64 oid;
+    pid_t holder;
+};
+
+enum
+{
+    MOCK_LOCK_EMPTY,
+    MOCK_LOCK_HELD,
+    MOCK_LOCK_DELETED
+};
+
+// a barrier or condition variable somebody waits on, as in the module.
+struct mock_sync
+{
+    int used;
+    int container;
+    int type;
+    __u64 id;
+    unsigned int waiters, arrived, count, tokens, seq;
+};
+
+enum
+{
+    MOCK_SYNC_BARRIER,
+    MOCK_SYNC_COND
+};
+
+// the counters of one CPU, on cache lines of their own.
+struct mock_stat_cpu
+{
+    __u64 count[MCONTAINER_STAT_NR];
+} __attribute__((aligned(128)));
+
+struct mock_registry
+{
+    pthread_mutex_t lock;
+    // broadcast whenever an object lock is released
+    pthread_cond_t lock_released;
+    struct mock_container containers[MOCK_MAX_CONTAINERS];
+    struct mock_lock locks[MOCK_LOCK_SLOTS];
+    // broadcast whenever a barrier completes or a condition is signalled
+    pthread_cond_t sync_changed;
+    struct mock_sync syncs[MOCK_SYNC_SLOTS];
+    struct mock_stat_cpu stats[MOCK_STAT_CPUS];
+};
+
+static struct mock_registry *registry;
+static int registry_fd = -1;
+static const char *registry_name;
+static pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+// MCONTAINER_MOCK_STATS=0 turns counting off, to measure what it costs
+static int stats_enabled;
+
+// the metadata pages of each container, mapped by this process on first use.
+static struct memory_container_meta *meta_map[MOCK_MAX_CONTAINERS];
+
+// the container of the calling task; tasks are threads, as in the module.
+static __thread pid_t task_tid;
+static __thread struct mock_container *task_container;
+
+static pid_t mock_gettid(void)
+{
+    return (pid_t)syscall(SYS_gettid);
+}
+
+static void mock_mutex_init(pthread_mutex_t *mutex)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+// a task that died holding the lock leaves the objects as they were.
+static void mock_mutex_lock(pthread_mutex_t *mutex)
+{
+    if (pthread_mutex_lock(mutex) == EOWNERDEAD)
+        pthread_mutex_consistent(mutex);
+}
+
+static void registry_setup(void)
+{
+    struct stat st;
+    int fd;
+
+    registry_name = getenv("MCONTAINER_MOCK_NAME");
+    if (!registry_name)
+        registry_name = MOCK_DEFAULT_NAME;
+    stats_enabled = !getenv("MCONTAINER_MOCK_STATS") || strcmp(getenv("MCONTAINER_MOCK_STATS"), "0") != 0;
+    fd = shm_open(registry_name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+        return;
+    // whoever gets here first with an empty segment sets it up.
+    flock(fd, LOCK_EX);
+    if (fstat(fd, &st) < 0 || (st.st_size == 0 && ftruncate(fd, sizeof(struct mock_registry)) < 0) ||
+        (st.st_size != 0 && st.st_size != sizeof(struct mock_registry)))
+    {
+        // a registry left behind by a different version of the library
+        errno = EINVAL;
+        flock(fd, LOCK_UN);
+        close(fd);
+        return;
+    }
+    registry = (struct mock_registry *)mmap(0, sizeof(struct mock_registry), PROT_READ | PROT_WRITE, MAP_SHARED,
+                                            fd, 0);
+    if (registry == MAP_FAILED)
+    {
+        registry = NULL;
+        flock(fd, LOCK_UN);
+        close(fd);
+        return;
+    }
+    if (st.st_size == 0)
+    {
+        pthread_condattr_t attr;
+        mock_mutex_init(&registry->lock);
+        pthread_condattr_init(&attr);
+        pthread_condattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_cond_init(&registry->lock_released, &attr);
+        pthread_cond_init(&registry->sync_changed, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+    flock(fd, LOCK_UN);
+    registry_fd = fd;
+}
+
+static struct mock_registry *get_registry(void)
+{
+    pthread_once(&registry_once, registry_setup);
+    return registry;
+}
+
+// like the module's per-CPU counters; tasks sharing a CPU slot need the atomic.
+static void stat_add(int item, __u64 n)
+{
+    int cpu;
+
+    if (!stats_enabled || !registry)
+        return;
+    cpu = sched_getcpu();
+    if (cpu < 0)
+        cpu = 0;
+    __atomic_fetch_add(&registry->stats[cpu % MOCK_STAT_CPUS].count[item], n, __ATOMIC_RELAXED);
+}
+
+// the container of the calling task, or NULL if it never joined one.
+static struct mock_container *current_container(void)
+{
+    return task_tid == mock_gettid() ? task_container : NULL;
+}
+
+static void object_name(char *name, size_t len, struct mock_container *container, __u64 oid)
+{
+    snprintf(name, len, "%s.%llu.%llu", registry_name, (unsigned long long)container->cid,
+             (unsigned long long)oid);
+}
+
+// metadata pages live in a segment of their own per container, always
+// kept up to date. Called with the registry lock held.
+static struct memory_container_meta *container_meta(struct mock_container *container)
+{
+    int index = (int)(container - registry->containers);
+    size_t size = MCONTAINER_META_PAGES * getpagesize();
+    char name[256];
+    void *mapped_data;
+    int fd;
+
+    if (meta_map[index])
+        return meta_map[index];
+    snprintf(name, sizeof(name), "%s.meta.%llu", registry_name, (unsigned long long)container->cid);
+    fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+        return NULL;
+    if (ftruncate(fd, size) < 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    mapped_data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped_data == MAP_FAILED)
+        return NULL;
+    meta_map[index] = (struct memory_container_meta *)mapped_data;
+    return meta_map[index];
+}
+
+// a generation no object of the container has had yet, so a freed and
+// recreated oid never repeats one. Called with the registry lock held.
+static __u64 next_generation(struct mock_container *container)
+{
+    return ++container->generation;
+}
+
+// move seq on around a lock holder's writes, and the generation on unlock,
+// as the module does. Called with the registry lock held.
+static void meta_bump(struct mock_container *container, __u64 oid, int unlock)
+{
+    struct memory_container_meta *meta = container_meta(container);
+
+    if (!meta || oid >= MCONTAINER_META_SLOTS)
+        return;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&meta[oid].seq, meta[oid].seq + 1, __ATOMIC_RELAXED);
+    if (unlock)
+        __atomic_store_n(&meta[oid].generation, next_generation(container), __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+// called with the registry lock held.
+static int object_is_sealed(struct mock_container *container, __u64 oid)
+{
+    struct memory_container_meta *meta = container_meta(container);
+    return meta && oid < MCONTAINER_META_SLOTS && (meta[oid].flags & MCONTAINER_META_SEALED);
+}
+
+/**
+ * Stands in for opening /dev/mcontainer: returns a descriptor of the
+ * registry for the devfd arguments, which the mock otherwise ignores.
+ */
+int mock_open(void)
+{
+    if (!get_registry())
+        return -1;
+    return dup(registry_fd);
+}
+
+int mock_create(int devfd, int cid)
+{
+    struct mock_registry *r = get_registry();
+    struct mock_container *temp_container = NULL;
+    int i, slot;
+
+    (void)devfd;
+    if (!r)
+        return -1;
+    mock_mutex_lock(&r->lock);
+    // open addressing on cid; containers are never removed.
+    for (i = 0; i < MOCK_MAX_CONTAINERS; i++)
+    {
+        slot = (int)(((__u64)(unsigned int)cid + i) % MOCK_MAX_CONTAINERS);
+        if (!r->containers[slot].used)
+        {
+            temp_container = &r->containers[slot];
+            temp_container->used = 1;
+            temp_container->cid = (unsigned int)cid;
+            break;
+        }
+        if (r->containers[slot].cid == (unsigned int)cid)
+        {
+            temp_container = &r->containers[slot];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+    if (!temp_container)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    task_tid = mock_gettid();
+    task_container = temp_container;
+    stat_add(MCONTAINER_STAT_CREATE, 1);
+    return 0;
+}
+
+int mock_delete(int devfd)
+{
+    (void)devfd;
+    stat_add(MCONTAINER_STAT_DELETE, 1);
+    if (!current_container())
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    task_container = NULL;
+    return 0;
+}
+
+static __u64 page_align(__u64 size)
+{
+    return ((size + getpagesize() - 1) / getpagesize()) * getpagesize();
+}
+
+void *mock_alloc(int devfd, __u64 offset, __u64 size)
+{
+    struct mock_container *temp_container = current_container();
+    __u64 aligned_size = page_align(size);
+    char name[256];
+    struct stat st;
+    void *mapped_data;
+    int fd, prot = PROT_READ | PROT_WRITE, existing = (offset & MCONTAINER_MAP_EXISTING) != 0;
+
+    (void)devfd;
+    offset &= ~MCONTAINER_MAP_EXISTING;
+    if (!temp_container)
+    {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    object_name(name, sizeof(name), temp_container, offset);
+    // the registry lock makes sure only the first task sizes the object.
+    mock_mutex_lock(&registry->lock);
+    if (object_is_sealed(temp_container, offset))
+        prot = PROT_READ;
+    fd = shm_open(name, (prot & PROT_WRITE ? O_RDWR : O_RDONLY) | (existing ? 0 : O_CREAT), 0600);
+    if (fd >= 0 && fstat(fd, &st) == 0)
+    {
+        if (st.st_size == 0 && existing)
+        {
+            close(fd);
+            fd = -1;
+            errno = ENOENT;
+        }
+        else if (st.st_size == 0 && ftruncate(fd, aligned_size) < 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        else if (st.st_size == 0)
+            stat_add(MCONTAINER_STAT_OBJECT_ALLOC, 1);
+        // like the module, an existing object only grows through resize.
+        else if (st.st_size && aligned_size > page_align(st.st_size))
+        {
+            close(fd);
+            fd = -1;
+            errno = EINVAL;
+        }
+    }
+    pthread_mutex_unlock(&registry->lock);
+    if (fd < 0)
+        return MAP_FAILED;
+    mapped_data = mmap(0, aligned_size, prot, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped_data != MAP_FAILED)
+        stat_add(MCONTAINER_STAT_MMAP, 1);
+    return mapped_data;
+}
+
+static struct mock_lock *lock_slot(struct mock_container *container, __u64 oid, int create)
+{
+    int index = (int)(container - registry->containers);
+    __u64 hash = (oid * 0x9e3779b97f4a7c15ULL) ^ (__u64)index;
+    struct mock_lock *reuse = NULL;
+    int i;
+
+    for (i = 0; i < MOCK_LOCK_SLOTS; i++)
+    {
+        struct mock_lock *slot = &registry->locks[(hash + i) % MOCK_LOCK_SLOTS];
+        if (slot->state == MOCK_LOCK_HELD && slot->container == index && slot->oid == oid)
+            return slot;
+        if (slot->state == MOCK_LOCK_DELETED && !reuse)
+            reuse = slot;
+        if (slot->state == MOCK_LOCK_EMPTY)
+        {
+            if (!reuse)
+                reuse = slot;
+            break;
+        }
+    }
+    if (!create || !reuse)
+        return NULL;
+    reuse->container = index;
+    reuse->oid = oid;
+    reuse->holder = 0;
+    return reuse;
+}
+
+static void lock_slot_release(struct mock_lock *slot)
+{
+    // the slot can go back to empty if nothing was ever probed past it
+    int i = (int)(slot - registry->locks);
+    slot->state = registry->locks[(i + 1) % MOCK_LOCK_SLOTS].state == MOCK_LOCK_EMPTY ? MOCK_LOCK_EMPTY :
+                  MOCK_LOCK_DELETED;
+    while (slot->state == MOCK_LOCK_EMPTY)
+    {
+        i = (i + MOCK_LOCK_SLOTS - 1) % MOCK_LOCK_SLOTS;
+        slot = &registry->locks[i];
+        if (slot->state != MOCK_LOCK_DELETED)
+            break;
+        slot->state = MOCK_LOCK_EMPTY;
+    }
+}
+
+/**
+ * Take the locks of all of oids or, on error, none of them, waiting
+ * for whichever are held unless MCONTAINER_LOCK_TRY is set. Same rules
+ * as the module: nothing is held while waiting, so callers cannot
+ * deadlock each other.
+ */
+// batches leave sealed objects out, as the module does; a single sealed
+// object fails with EROFS.
+static int lock_objects(int devfd, const __u64 *oids, int n, int flags, int batch)
+{
+    struct mock_container *temp_container = current_container();
+    pid_t tid = mock_gettid();
+    int i, busy, locked = 0;
+
+    (void)devfd;
+    if (!temp_container || n <= 0 || n > MCONTAINER_LOCK_MANY_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    mock_mutex_lock(&registry->lock);
+    for (i = 0; i < n && !batch; i++)
+    {
+        if (object_is_sealed(temp_container, oids[i]))
+        {
+            pthread_mutex_unlock(&registry->lock);
+            errno = EROFS;
+            return -1;
+        }
+    }
+    for (;;)
+    {
+        busy = 0;
+        for (i = 0; i < n && !busy; i++)
+        {
+            struct mock_lock *slot;
+            if (object_is_sealed(temp_container, oids[i]))
+                continue;
+            slot = lock_slot(temp_container, oids[i], 0);
+            if (slot)
+                busy = slot->holder == tid ? -EDEADLK : 1;
+        }
+        if (!busy)
+            break;
+        stat_add(MCONTAINER_STAT_LOCK_CONTENDED, 1);
+        if (busy < 0 || (flags & MCONTAINER_LOCK_TRY))
+        {
+            pthread_mutex_unlock(&registry->lock);
+            errno = busy < 0 ? EDEADLK : EBUSY;
+            return -1;
+        }
+        if (pthread_cond_wait(&registry->lock_released, &registry->lock) == EOWNERDEAD)
+            pthread_mutex_consistent(&registry->lock);
+    }
+    for (i = 0; i < n; i++)
+    {
+        struct mock_lock *slot;
+        if (object_is_sealed(temp_container, oids[i]))
+            continue;
+        slot = lock_slot(temp_container, oids[i], 1);
+        if (!slot)
+        {
+            while (i--)
+            {
+                slot = lock_slot(temp_container, oids[i], 0);
+                if (slot)
+                    lock_slot_release(slot);
+            }
+            pthread_mutex_unlock(&registry->lock);
+            errno = ENOMEM;
+            return -1;
+        }
+        // a repeated oid finds its own slot already held by us
+        slot->state = MOCK_LOCK_HELD;
+        slot->holder = tid;
+        meta_bump(temp_container, oids[i], 0);
+        locked++;
+    }
+    pthread_mutex_unlock(&registry->lock);
+    stat_add(MCONTAINER_STAT_LOCK, locked);
+    return 0;
+}
+
+int mock_lock_many(int devfd, const __u64 *oids, int n, int flags)
+{
+    return lock_objects(devfd, oids, n, flags, 1);
+}
+
+static int unlock_objects(int devfd, const __u64 *oids, int n, int batch)
+{
+    struct mock_container *temp_container = current_container();
+    pid_t tid = mock_gettid();
+    int i, released = 0, sealed = 0;
+
+    (void)devfd;
+    if (!temp_container)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    mock_mutex_lock(&registry->lock);
+    for (i = 0; i < n; i++)
+    {
+        struct mock_lock *slot = lock_slot(temp_container, oids[i], 0);
+        if (slot && slot->holder == tid)
+        {
+            lock_slot_release(slot);
+            meta_bump(temp_container, oids[i], 1);
+            released++;
+        }
+        sealed += object_is_sealed(temp_container, oids[i]);
+    }
+    if (released)
+        pthread_cond_broadcast(&registry->lock_released);
+    pthread_mutex_unlock(&registry->lock);
+    // a batch of nothing but sealed objects had nothing to release
+    if (!released && !(batch && sealed == n))
+    {
+        errno = sealed && !batch ? EROFS : EPERM;
+        return -1;
+    }
+    stat_add(MCONTAINER_STAT_UNLOCK, released);
+    return 0;
+}
+
+int mock_unlock_many(int devfd, const __u64 *oids, int n)
+{
+    return unlock_objects(devfd, oids, n, 1);
+}
+
+int mock_lock(int devfd, __u64 offset)
+{
+    return lock_objects(devfd, &offset, 1, 0, 0);
+}
+
+int mock_unlock(int devfd, __u64 offset)
+{
+    return unlock_objects(devfd, &offset, 1, 0);
+}
+
+// few tasks wait at once, so a linear search does.
+static struct mock_sync *sync_slot(struct mock_container *container, int type, __u64 id, int create)
+{
+    int index = (int)(container - registry->containers);
+    struct mock_sync *free_slot = NULL;
+    int i;
+
+    for (i = 0; i < MOCK_SYNC_SLOTS; i++)
+    {
+        struct mock_sync *slot = &registry->syncs[i];
+        if (slot->used && slot->container == index && slot->type == type && slot->id == id)
+            return slot;
+        if (!slot->used && !free_slot)
+            free_slot = slot;
+    }
+    if (!create || !free_slot)
+        return NULL;
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->used = 1;
+    free_slot->container = index;
+    free_slot->type = type;
+    free_slot->id = id;
+    return free_slot;
+}
+
+static void sync_slot_release(struct mock_sync *slot)
+{
+    if (!slot->waiters && !slot->arrived)
+        slot->used = 0;
+}
+
+static void sync_wait(void)
+{
+    if (pthread_cond_wait(&registry->sync_changed, &registry->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&registry->lock);
+}
+
+int mock_barrier_wait(int devfd, __u64 id, int n)
+{
+    struct mock_container *temp_container = current_container();
+    struct mock_sync *slot;
+    unsigned int seq;
+
+    (void)devfd;
+    if (!temp_container || n <= 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    stat_add(MCONTAINER_STAT_OTHER, 1);
+    mock_mutex_lock(&registry->lock);
+    slot = sync_slot(temp_container, MOCK_SYNC_BARRIER, id, 1);
+    if (!slot || (slot->arrived && slot->count != (unsigned int)n))
+    {
+        pthread_mutex_unlock(&registry->lock);
+        errno = slot ? EINVAL : ENOMEM;
+        return -1;
+    }
+    slot->count = n;
+    if (++slot->arrived == slot->count)
+    {
+        slot->arrived = 0;
+        slot->seq++;
+        sync_slot_release(slot);
+        pthread_cond_broadcast(&registry->sync_changed);
+        pthread_mutex_unlock(&registry->lock);
+        return 1;
+    }
+    seq = slot->seq;
+    slot->waiters++;
+    while (slot->seq == seq)
+        sync_wait();
+    slot->waiters--;
+    sync_slot_release(slot);
+    pthread_mutex_unlock(&registry->lock);
+    return 0;
+}
+
+int mock_cond_wait(int devfd, __u64 id, __u64 offset)
+{
+    struct mock_container *temp_container = current_container();
+    struct mock_lock *lock;
+    struct mock_sync *slot;
+    unsigned int seq;
+
+    if (!temp_container)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    stat_add(MCONTAINER_STAT_OTHER, 1);
+    mock_mutex_lock(&registry->lock);
+    lock = lock_slot(temp_container, offset, 0);
+    if (!lock || lock->holder != mock_gettid())
+    {
+        pthread_mutex_unlock(&registry->lock);
+        errno = EPERM;
+        return -1;
+    }
+    slot = sync_slot(temp_container, MOCK_SYNC_COND, id, 1);
+    if (!slot)
+    {
+        pthread_mutex_unlock(&registry->lock);
+        errno = ENOMEM;
+        return -1;
+    }
+    lock_slot_release(lock);
+    meta_bump(temp_container, offset, 1);
+    pthread_cond_broadcast(&registry->lock_released);
+    stat_add(MCONTAINER_STAT_UNLOCK, 1);
+
+    seq = slot->seq;
+    slot->waiters++;
+    while (!slot->tokens || slot->seq == seq)
+        sync_wait();
+    slot->tokens--;
+    slot->waiters--;
+    sync_slot_release(slot);
+    pthread_mutex_unlock(&registry->lock);
+    return mock_lock(devfd, offset);
+}
+
+int mock_cond_signal(int devfd, __u64 id, int flags)
+{
+    struct mock_container *temp_container = current_container();
+    struct mock_sync *slot;
+
+    (void)devfd;
+    if (!temp_container)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    stat_add(MCONTAINER_STAT_OTHER, 1);
+    mock_mutex_lock(&registry->lock);
+    slot = sync_slot(temp_container, MOCK_SYNC_COND, id, 0);
+    if (slot && slot->waiters > slot->tokens)
+    {
+        slot->tokens = (flags & MCONTAINER_COND_BROADCAST) ? slot->waiters : slot->tokens + 1;
+        slot->seq++;
+        pthread_cond_broadcast(&registry->sync_changed);
+    }
+    pthread_mutex_unlock(&registry->lock);
+    return 0;
+}
+
+int mock_free(int devfd, __u64 offset)
+{
+    struct mock_container *temp_container = current_container();
+    struct memory_container_meta *meta;
+    char name[256];
+
+    (void)devfd;
+    stat_add(MCONTAINER_STAT_FREE, 1);
+    if (!temp_container)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    object_name(name, sizeof(name), temp_container, offset);
+    mock_mutex_lock(&registry->lock);
+    meta = container_meta(temp_container);
+    if (meta && offset < MCONTAINER_META_SLOTS)
+    {
+        meta[offset].flags = 0;
+        meta[offset].generation = 0;
+    }
+    pthread_mutex_unlock(&registry->lock);
+    // existing mappings keep the old memory; the next alloc starts afresh.
+    if (shm_unlink(name) != 0)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    stat_add(MCONTAINER_STAT_OBJECT_FREE, 1);
+    return 0;
+}
+
+// free the objects of a container from first up to end, found by listing
+// the shared memory segments rather than trying every oid in between.
+// Returns how many there were.
+static __u64 unlink_objects(struct mock_container *container, __u64 first, __u64 end)
+{
+    struct memory_container_meta *meta;
+    struct dirent *entry;
+    char prefix[256], name[256], *tail;
+    unsigned long long oid;
+    __u64 freed = 0;
+    size_t len;
+    DIR *dir;
+
+    // /dev/shm lists the segments without the leading slash
+    snprintf(prefix, sizeof(prefix), "%s.%llu.", registry_name + (registry_name[0] == '/'),
+             (unsigned long long)container->cid);
+    len = strlen(prefix);
+    dir = opendir("/dev/shm");
+    if (!dir)
+        return 0;
+    while ((entry = readdir(dir)))
+    {
+        if (strncmp(entry->d_name, prefix, len) != 0 || entry->d_name[len] == '\0')
+            continue;
+        oid = strtoull(entry->d_name + len, &tail, 10);
+        if (*tail || oid < first || oid >= end)
+            continue;
+        object_name(name, sizeof(name), container, oid);
+        if (shm_unlink(name) != 0)
+            continue;
+        freed++;
+        mock_mutex_lock(&registry->lock);
+        meta = container_meta(container);
+        if (meta && oid < MCONTAINER_META_SLOTS)
+        {
+            meta[oid].flags = 0;
+            meta[oid].generation = 0;
+        }
+        pthread_mutex_unlock(&registry->lock);
+    }
+    closedir(dir);
+    stat_add(MCONTAINER_STAT_OBJECT_FREE, freed);
+    return freed;
+}
+
+/**
+ * Free the objects from offset to offset + count - 1 that exist.
+ * Returns how many there were.
+ */
+int mock_free_range(int devfd, __u64 offset, __u64 count)
+{
+    struct mock_container *temp_container = current_container();
+    __u64 end = offset + count;
+
+    (void)devfd;
+    if (!temp_container)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (end < offset || end > MCONTAINER_RESERVED_OID)
+        end = MCONTAINER_RESERVED_OID;
+    stat_add(MCONTAINER_STAT_FREE, 1);
+    return (int)unlink_objects(temp_container, offset, end);
+}
+
+/**
+ * Free every object of the caller's container and drop its locks. The
+ * registry keeps the empty container, and only the caller leaves it:
+ * other tasks carry on in it rather than finding it gone.
+ */
+int mock_destroy(int devfd)
+{
+    struct mock_container *temp_container = current_container();
+    int i, index;
+
+    (void)devfd;
+    if (!temp_container)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    stat_add(MCONTAINER_STAT_DELETE, 1);
+    unlink_objects(temp_container, 0, MCONTAINER_RESERVED_OID);
+    index = (int)(temp_container - registry->containers);
+    mock_mutex_lock(&registry->lock);
+    for (i = 0; i < MOCK_LOCK_SLOTS; i++)
+    {
+        if (registry->locks[i].state == MOCK_LOCK_HELD && registry->locks[i].container == index)
+            registry->locks[i].state = MOCK_LOCK_DELETED;
+    }
+    pthread_cond_broadcast(&registry->lock_released);
+    pthread_mutex_unlock(&registry->lock);
+    task_container = NULL;
+    return 0;
+}
+
+// the oids of the container a walk started with, as listing /dev/shm
+// anew for each batch would make walking a big container quadratic.
+static __thread __u64 *walk_oids;
+static __thread size_t walk_nr;
+
+static int compare_oid(const void *a, const void *b)
+{
+    __u64 x = *(const __u64 *)a, y = *(const __u64 *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void walk_start(struct mock_container *container)
+{
+    struct dirent *entry;
+    char prefix[256], *tail;
+    size_t len, capacity = 1024;
+    DIR *dir;
+
+    free(walk_oids);
+    walk_oids = (__u64 *)malloc(capacity * sizeof(__u64));
+    walk_nr = 0;
+    snprintf(prefix, sizeof(prefix), "%s.%llu.", registry_name + (registry_name[0] == '/'),
+             (unsigned long long)container->cid);
+    len = strlen(prefix);
+    dir = opendir("/dev/shm");
+    while (dir && walk_oids && (entry = readdir(dir)))
+    {
+        if (strncmp(entry->d_name, prefix, len) != 0 || entry->d_name[len] == '\0')
+            continue;
+        if (walk_nr == capacity)
+        {
+            capacity *= 2;
+            walk_oids = (__u64 *)realloc(walk_oids, capacity * sizeof(__u64));
+            if (!walk_oids)
+                break;
+        }
+        walk_oids[walk_nr] = strtoull(entry->d_name + len, &tail, 10);
+        if (!*tail)
+            walk_nr++;
+    }
+    if (dir)
+        closedir(dir);
+    if (!walk_oids)
+        walk_nr = 0;
+    qsort(walk_oids, walk_nr, sizeof(__u64), compare_oid);
+}
+
+/**
+ * Objects are found by listing the container's segments when a walk
+ * starts at cursor 0; later batches go on from that list, skipping the
+ * objects freed since. Resident pages are the blocks the segment holds.
+ */
+int mock_enumerate(int devfd, __u64 *cursor, struct memory_container_object_info *objects, int nr)
+{
+    struct mock_container *temp_container = current_container();
+    struct memory_container_meta *meta;
+    struct mock_lock *slot;
+    size_t lo = 0, hi;
+    char name[256];
+    struct stat st;
+    int fd, filled = 0;
+
+    (void)devfd;
+    if (!temp_container || nr <= 0 || nr > MCONTAINER_ENUMERATE_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    stat_add(MCONTAINER_STAT_OTHER, 1);
+    if (*cursor == 0 || !walk_oids)
+        walk_start(temp_container);
+    hi = walk_nr;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (walk_oids[mid] < *cursor)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < walk_nr && filled < nr; lo++)
+    {
+        struct memory_container_object_info *info = &objects[filled];
+
+        object_name(name, sizeof(name), temp_container, walk_oids[lo]);
+        fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0)
+            continue;
+        if (fstat(fd, &st) < 0 || st.st_size == 0)
+        {
+            close(fd);
+            continue;
+        }
+        close(fd);
+        info->oid = walk_oids[lo];
+        info->size = st.st_size;
+        info->resident_pages = (__u64)st.st_blocks * 512 / getpagesize();
+        mock_mutex_lock(&registry->lock);
+        slot = lock_slot(temp_container, info->oid, 0);
+        info->lock_holder = slot && slot->state == MOCK_LOCK_HELD ? slot->holder : 0;
+        meta = container_meta(temp_container);
+        info->flags = meta && info->oid < MCONTAINER_META_SLOTS ? (__u32)meta[info->oid].flags : 0;
+        pthread_mutex_unlock(&registry->lock);
+        *cursor = info->oid + 1;
+        filled++;
+    }
+    return filled;
+}
+
+static __u64 mock_size_class(__u64 nr_pages)
+{
+    __u64 size_class = 0;
+    while ((1ULL << size_class) < nr_pages)
+        size_class++;
+    return size_class;
+}
+
+// objects are shm segments sized to their exact size; mappings round it up.
+int mock_size(int devfd, __u64 offset, struct memory_container_size *size)
+{
+    struct mock_container *temp_container = current_container();
+    char name[256];
+    struct stat st;
+    int fd;
+
+    (void)devfd;
+    if (!temp_container)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    object_name(name, sizeof(name), temp_container, offset);
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    stat_add(MCONTAINER_STAT_OTHER, 1);
+    size->oid = offset;
+    size->size = st.st_size;
+    size->nr_pages = page_align(st.st_size) / getpagesize();
+    size->size_class = mock_size_class(size->nr_pages);
+    return 0;
+}
+
+void *mock_resize(int devfd, __u64 offset, void *mapped_data, __u64 old_size, __u64 new_size)
+{
+    struct mock_container *temp_container = current_container();
+    char name[256];
+    void *new_data;
+    int fd, ret;
+
+    if (!temp_container || new_size == 0)
+    {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    object_name(name, sizeof(name), temp_container, offset);
+    fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return MAP_FAILED;
+    // a shrink followed by a grow brings back zeroes, as in the module.
+    mock_mutex_lock(&registry->lock);
+    if (object_is_sealed(temp_container, offset))
+    {
+        errno = EROFS;
+        ret = -1;
+    }
+    else
+        ret = ftruncate(fd, new_size);
+    pthread_mutex_unlock(&registry->lock);
+    close(fd);
+    stat_add(MCONTAINER_STAT_RESIZE, 1);
+    if (ret < 0)
+        return MAP_FAILED;
+    new_data = mock_alloc(devfd, offset, new_size);
+    if (new_data != MAP_FAILED && mapped_data)
+        munmap(mapped_data, page_align(old_size));
+    return new_data;
+}
+
+int mock_stats(int devfd, struct memory_container_stats *stats)
+{
+    int cpu, i;
+
+    (void)devfd;
+    if (!get_registry())
+        return -1;
+    stat_add(MCONTAINER_STAT_OTHER, 1);
+    memset(stats, 0, sizeof(struct memory_container_stats));
+    for (cpu = 0; cpu < MOCK_STAT_CPUS; cpu++)
+    {
+        for (i = 0; i < MCONTAINER_STAT_NR; i++)
+            stats->count[i] += __atomic_load_n(&registry->stats[cpu].count[i], __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+/**
+ * Sealing only marks the object: mappings made before stay writable in
+ * the mock, while later ones are read-only and locking it fails.
+ */
+int mock_seal(int devfd, __u64 offset)
+{
+    struct mock_container *temp_container = current_container();
+    struct memory_container_meta *meta;
+    char name[256];
+    int fd, ret = 0;
+
+    (void)devfd;
+    if (!temp_container)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    stat_add(MCONTAINER_STAT_OTHER, 1);
+    object_name(name, sizeof(name), temp_container, offset);
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return -1;
+    close(fd);
+    mock_mutex_lock(&registry->lock);
+    meta = container_meta(temp_container);
+    if (!meta || offset >= MCONTAINER_META_SLOTS)
+    {
+        // the mock keeps the seal in the metadata slot
+        errno = ERANGE;
+        ret = -1;
+    }
+    else if (lock_slot(temp_container, offset, 0))
+    {
+        errno = EBUSY;
+        ret = -1;
+    }
+    else
+    {
+        __atomic_store_n(&meta[offset].flags, meta[offset].flags | MCONTAINER_META_SEALED, __ATOMIC_RELEASE);
+        __atomic_store_n(&meta[offset].generation, next_generation(temp_container), __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&registry->lock);
+    return ret;
+}
+
+// a read-only mapping of the container's metadata segment, like the module's.
+const struct memory_container_meta *mock_map_meta(int devfd)
+{
+    struct mock_container *temp_container = current_container();
+    char name[256];
+    void *mapped_data;
+    int fd;
+
+    (void)devfd;
+    if (!temp_container)
+    {
+        errno = EINVAL;
+        return (const struct memory_container_meta *)MAP_FAILED;
+    }
+    mock_mutex_lock(&registry->lock);
+    if (!container_meta(temp_container))
+    {
+        pthread_mutex_unlock(&registry->lock);
+        return (const struct memory_container_meta *)MAP_FAILED;
+    }
+    pthread_mutex_unlock(&registry->lock);
+    snprintf(name, sizeof(name), "%s.meta.%llu", registry_name, (unsigned long long)temp_container->cid);
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return (const struct memory_container_meta *)MAP_FAILED;
+    mapped_data = mmap(0, MCONTAINER_META_PAGES * getpagesize(), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    stat_add(MCONTAINER_STAT_MMAP, 1);
+    return (const struct memory_container_meta *)mapped_data;
+}
+
+/**
+ * Reclaim, transfer, export, save/restore, watching and windows need the
+ * kernel module; the mock answers like a module without them would.
+ */
+int mock_unsupported(void)
+{
+    stat_add(MCONTAINER_STAT_OTHER, 1);
+    errno = ENOTTY;
+    return -1;
+}
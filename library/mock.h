@@ -0,0 +1,60 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Userspace Mock of the Memory Container Kernel Module
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef MCONTAINER_MOCK_H
+#define MCONTAINER_MOCK_H
+
+#include <linux/types.h>
+#include <memory_container/memory_container.h>
+
+int mock_open(void);
+int mock_delete(int devfd);
+int mock_create(int devfd, int cid);
+void *mock_alloc(int devfd, __u64 offset, __u64 size);
+int mock_lock(int devfd, __u64 offset);
+int mock_unlock(int devfd, __u64 offset);
+int mock_lock_many(int devfd, const __u64 *oids, int n, int flags);
+int mock_unlock_many(int devfd, const __u64 *oids, int n);
+int mock_barrier_wait(int devfd, __u64 id, int n);
+int mock_cond_wait(int devfd, __u64 id, __u64 offset);
+int mock_cond_signal(int devfd, __u64 id, int flags);
+int mock_seal(int devfd, __u64 offset);
+int mock_free(int devfd, __u64 offset);
+int mock_free_range(int devfd, __u64 offset, __u64 count);
+int mock_destroy(int devfd);
+int mock_size(int devfd, __u64 offset, struct memory_container_size *size);
+int mock_enumerate(int devfd, __u64 *cursor, struct memory_container_object_info *objects, int nr);
+void *mock_resize(int devfd, __u64 offset, void *mapped_data, __u64 old_size, __u64 new_size);
+int mock_stats(int devfd, struct memory_container_stats *stats);
+const struct memory_container_meta *mock_map_meta(int devfd);
+int mock_unsupported(void);
+
+#endif
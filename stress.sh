@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# Sweeps processes x threads x containers x objects x sizes through
+# benchmark/stress, appending throughput per configuration to a CSV file.
+# On a kernel built with kernel_module/debug.config (run it in a VM), any
+# lockdep, KASAN or other splat in the kernel log fails the run.
+
+csv=${1:-stress.csv}
+seconds=${STRESS_SECONDS:-5}
+failed=0
+
+if [ "$MCONTAINER_BACKEND" != "mock" ]; then
+    sudo insmod kernel_module/memory_container.ko
+    sudo chmod 777 /dev/mcontainer
+    sudo dmesg -C
+fi
+
+for processes in 1 4 16; do
+    for threads in 1 4; do
+        for containers in 1 4; do
+            for objects in 16 1024; do
+                for size in 4096 65536; do
+                    if ! ./benchmark/stress -p $processes -t $threads -c $containers -o $objects -s $size \
+                            -d $seconds -C "$csv"; then
+                        failed=1
+                    fi
+                    if [ "$MCONTAINER_BACKEND" != "mock" ] && \
+                            sudo dmesg | grep -E "BUG:|WARNING:|KASAN|circular locking|lock held|INFO: task"; then
+                        echo "kernel complained after $processes processes x $threads threads," \
+                             "$containers containers, $objects objects of $size bytes"
+                        failed=1
+                        sudo dmesg -C
+                    fi
+                done
+            done
+        done
+    done
+done
+
+if [ "$MCONTAINER_BACKEND" != "mock" ]; then
+    sudo rmmod memory_container
+else
+    rm -f /dev/shm/${MCONTAINER_MOCK_NAME:-/mcontainer-mock}*
+fi
+exit $failed
@@ -11,14 +11,20 @@ max_size_of_objects=$2
 number_of_processes=$3
 number_of_containers=$4
 
-sudo insmod kernel_module/memory_container.ko
-sudo chmod 777 /dev/mcontainer
+# MCONTAINER_BACKEND=mock runs everything in userspace, without root
+if [ "$MCONTAINER_BACKEND" != "mock" ]; then
+    sudo insmod kernel_module/memory_container.ko
+    sudo chmod 777 /dev/mcontainer
+fi
 ./benchmark/benchmark $1 $2 $3 $4
-cat *.log > trace
-sort -n -k 4 trace > sorted_trace
-./benchmark/validate $1 $2 $4 < sorted_trace
+./benchmark/validate $1 $2 $4 mcontainer.*.log
+./benchmark/mcstat -p
 
 # if you want to see the log for debugging, comment out the following line.
-rm -f *.log trace sorted_trace
+rm -f *.log
 
-sudo rmmod memory_container
\ No newline at end of file
+if [ "$MCONTAINER_BACKEND" != "mock" ]; then
+    sudo rmmod memory_container
+else
+    rm -f /dev/shm/${MCONTAINER_MOCK_NAME:-/mcontainer-mock}*
+fi